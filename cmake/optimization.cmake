@@ -0,0 +1,59 @@
+# build-wide optimization switches, applied to everything configured after the
+# include. the top-level build includes it first; a demo configured on its own
+# includes it itself
+include_guard(GLOBAL)
+
+# link time optimization of Release builds where the toolchain supports it
+option(SANDBOX_ENABLE_LTO "link time optimization for Release builds" ON)
+
+# instruction set every translation unit may assume, e.g. native or x86-64-v3.
+# empty keeps the compiler default; the avx2 kernels are then picked at run time
+set(SANDBOX_ARCH "" CACHE STRING "value of -march, empty for the compiler default")
+
+# profile guided optimization. configure with GENERATE, run the demos on
+# representative workloads, then reconfigure the same build tree with USE; gcc
+# names profiles after the object paths, so both steps share one binary dir
+set(SANDBOX_PGO OFF CACHE STRING "profile guided optimization: OFF, GENERATE or USE")
+set_property(CACHE SANDBOX_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(SANDBOX_PGO_DIR "${CMAKE_BINARY_DIR}/pgo-profiles" CACHE PATH "directory the profiles are written to and read from")
+
+if(SANDBOX_ENABLE_LTO)
+    include(CheckIPOSupported)
+    check_ipo_supported(RESULT SANDBOX_LTO_SUPPORTED OUTPUT SANDBOX_LTO_ERROR LANGUAGES CXX)
+    if(SANDBOX_LTO_SUPPORTED)
+        set(CMAKE_INTERPROCEDURAL_OPTIMIZATION_RELEASE ON)
+    else()
+        message(STATUS "link time optimization not supported: ${SANDBOX_LTO_ERROR}")
+    endif()
+endif()
+
+if(NOT CMAKE_CXX_COMPILER_ID MATCHES "GNU|Clang")
+    if(SANDBOX_ARCH OR NOT SANDBOX_PGO STREQUAL "OFF")
+        message(WARNING "SANDBOX_ARCH and SANDBOX_PGO only apply to gcc and clang, ignored")
+    endif()
+    return()
+endif()
+
+if(SANDBOX_ARCH)
+    add_compile_options(-march=${SANDBOX_ARCH})
+endif()
+
+if(SANDBOX_PGO STREQUAL "GENERATE")
+    # the thread pool runs the hot loops, so counters are updated atomically
+    set(SANDBOX_PGO_FLAGS "-fprofile-generate=${SANDBOX_PGO_DIR} -fprofile-update=atomic")
+elseif(SANDBOX_PGO STREQUAL "USE")
+    if(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+        # counters of concurrent loops can still be slightly inconsistent, and a
+        # profiling run rarely covers every benchmark, so missing files are fine
+        set(SANDBOX_PGO_FLAGS "-fprofile-use=${SANDBOX_PGO_DIR} -fprofile-correction -Wno-missing-profile")
+    else()
+        # clang reads one merged file: llvm-profdata merge -o default.profdata *.profraw
+        set(SANDBOX_PGO_FLAGS "-fprofile-use=${SANDBOX_PGO_DIR}/default.profdata")
+    endif()
+elseif(NOT SANDBOX_PGO STREQUAL "OFF")
+    message(FATAL_ERROR "SANDBOX_PGO must be OFF, GENERATE or USE, not ${SANDBOX_PGO}")
+endif()
+if(SANDBOX_PGO_FLAGS)
+    string(APPEND CMAKE_CXX_FLAGS " ${SANDBOX_PGO_FLAGS}")
+    string(APPEND CMAKE_EXE_LINKER_FLAGS " ${SANDBOX_PGO_FLAGS}")
+endif()
@@ -0,0 +1,7 @@
+#pragma once
+#include <cstdint>
+
+// linking alloc_counter.cpp replaces the global operator new/delete family
+// with versions that count every allocation. memory C libraries such as SDL
+// get from malloc directly is not seen
+std::uint64_t heapAllocationCount();
@@ -0,0 +1,59 @@
+#include "frame_arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+// blocks are cache line aligned, so any alignment up to this is free
+#define FRAME_ARENA_BLOCK_ALIGNMENT 64
+
+FrameArena::~FrameArena() {
+    for (const Block& block : m_blocks) ::operator delete(block.data, std::align_val_t(FRAME_ARENA_BLOCK_ALIGNMENT));
+}
+
+void FrameArena::addBlock(size_t bytes) {
+    size_t size = std::max(bytes, m_nextBlockSize);
+    unsigned char* data = static_cast<unsigned char*>(::operator new(size, std::align_val_t(FRAME_ARENA_BLOCK_ALIGNMENT)));
+    m_blocks.push_back({ data, size });
+    m_nextBlockSize = size * 2;
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment) {
+    for (;;) {
+        if (m_current < m_blocks.size()) {
+            const Block& block = m_blocks[m_current];
+            std::uintptr_t base = reinterpret_cast<std::uintptr_t>(block.data);
+            size_t begin = (size_t)((base + m_offset + alignment - 1) / alignment * alignment - base);
+            if (begin + bytes <= block.size) {
+                m_offset = begin + bytes;
+                return block.data + begin;
+            }
+            if (m_current + 1 < m_blocks.size()) {
+                ++m_current;
+                m_offset = 0;
+                continue;
+            }
+        }
+        // alignment beyond the block alignment needs slack at the front
+        addBlock(bytes + (alignment > FRAME_ARENA_BLOCK_ALIGNMENT ? alignment : 0));
+        m_current = m_blocks.size() - 1;
+        m_offset = 0;
+    }
+}
+
+void FrameArena::reset() {
+    if (m_blocks.size() > 1) {
+        size_t total = capacity();
+        for (const Block& block : m_blocks) ::operator delete(block.data, std::align_val_t(FRAME_ARENA_BLOCK_ALIGNMENT));
+        m_blocks.clear();
+        m_nextBlockSize = total;
+        addBlock(total);
+    }
+    m_current = 0;
+    m_offset = 0;
+}
+
+size_t FrameArena::capacity() const {
+    size_t total = 0;
+    for (const Block& block : m_blocks) total += block.size;
+    return total;
+}
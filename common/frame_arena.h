@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// monotonic allocator for scratch data that lives for one step or call.
+// reset() releases everything at once; when a step overflowed into extra
+// blocks they are replaced by a single block of the combined size, so once
+// the high-water mark fits, steps no longer touch the heap. memory is not
+// initialized and destructors never run
+class FrameArena {
+public:
+    explicit FrameArena(size_t initialBytes = 64 * 1024) : m_nextBlockSize(initialBytes) {}
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment);
+
+    template <typename T>
+    T* allocate(size_t count, size_t alignment = alignof(T)) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is released without destructors");
+        return static_cast<T*>(allocate(count * sizeof(T), alignment));
+    }
+
+    void reset();
+
+    size_t capacity() const;
+
+private:
+    struct Block {
+        unsigned char* data;
+        size_t size;
+    };
+
+    void addBlock(size_t bytes);
+
+    std::vector<Block> m_blocks;
+    size_t m_current = 0;  // block being filled
+    size_t m_offset = 0;   // first free byte in it
+    size_t m_nextBlockSize;
+};
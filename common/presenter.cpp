@@ -0,0 +1,83 @@
+#include "presenter.h"
+#include <algorithm>
+
+Presenter::~Presenter() {
+    close();
+}
+
+bool Presenter::open(SDL_Window* window, Uint32 format, bool vsync, std::string& error) {
+    m_format = format;
+    m_vsync = vsync;
+    m_renderer = SDL_CreateRenderer(window, -1, vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+    if (!m_renderer && vsync) {
+        m_vsync = false;
+        m_renderer = SDL_CreateRenderer(window, -1, 0);
+    }
+    if (!m_renderer) {
+        error = std::string("cannot create renderer: ") + SDL_GetError();
+        return false;
+    }
+
+    int width = 0, height = 0;
+    SDL_GetWindowSize(window, &width, &height);
+    if (!resize(width, height) || !m_surface) {
+        error = m_error;
+        return false;
+    }
+    return true;
+}
+
+bool Presenter::resize(int width, int height) {
+    // a minimized window can report 0 x 0; keep a valid one pixel frame
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    m_error.clear();
+    if (m_surface && width == m_width && height == m_height) return false;
+
+    // the new framebuffer is complete before the old one goes
+    std::vector<Uint32> pixels((size_t)width * height, 0);
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom(pixels.data(), width, height, 32, width * 4, m_format);
+    SDL_Texture* texture = surface ? SDL_CreateTexture(m_renderer, m_format, SDL_TEXTUREACCESS_STREAMING, width, height) : nullptr;
+    if (!texture) {
+        m_error = "cannot create a " + std::to_string(width) + "x" + std::to_string(height) + " framebuffer: " + SDL_GetError();
+        if (surface) SDL_FreeSurface(surface);
+        return false;
+    }
+
+    release();
+    m_pixels.swap(pixels);
+    m_surface = surface;
+    m_texture = texture;
+    m_width = width;
+    m_height = height;
+    return true;
+}
+
+void Presenter::clear(Uint32 color) {
+    std::fill(m_pixels.begin(), m_pixels.end(), color);
+}
+
+void Presenter::present() {
+    // the texture covers the whole output, so the renderer is never cleared
+    if (m_texture) {
+        SDL_UpdateTexture(m_texture, nullptr, m_pixels.data(), m_width * 4);
+        SDL_RenderCopy(m_renderer, m_texture, nullptr, nullptr);
+    }
+    SDL_RenderPresent(m_renderer);
+}
+
+void Presenter::release() {
+    if (m_surface) SDL_FreeSurface(m_surface);
+    if (m_texture) SDL_DestroyTexture(m_texture);
+    m_surface = nullptr;
+    m_texture = nullptr;
+}
+
+void Presenter::close() {
+    release();
+    if (m_renderer) SDL_DestroyRenderer(m_renderer);
+    m_renderer = nullptr;
+    m_pixels = std::vector<Uint32>();
+    m_width = 0;
+    m_height = 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <SDL.h>
+#include <string>
+#include <vector>
+
+// puts frames on screen through an SDL_Renderer instead of the window surface.
+// frames are drawn into a persistent cpu framebuffer, exposed as a 32 bit
+// SDL_Surface so the raster code draws into it unchanged, and present() uploads
+// it into a streaming texture. the framebuffer keeps its contents between
+// frames and follows the size of the window
+class Presenter {
+public:
+    Presenter() = default;
+    ~Presenter();
+
+    Presenter(const Presenter&) = delete;
+    Presenter& operator=(const Presenter&) = delete;
+
+    // format is the layout of the framebuffer pixels, e.g. SDL_PIXELFORMAT_RGBA8888.
+    // with vsync present() waits for the display refresh; when the driver cannot
+    // do that the presenter falls back to presenting immediately
+    bool open(SDL_Window* window, Uint32 format, bool vsync, std::string& error);
+
+    // call on SDL_WINDOWEVENT_SIZE_CHANGED. returns true when the framebuffer
+    // was reallocated, cleared to zero, and the old surface() pointer is no
+    // longer valid. returns false when the size is the same, or when the new
+    // framebuffer cannot be created; then error() says why, the old one and
+    // its size stay, and the next resize tries again
+    bool resize(int width, int height);
+    const std::string& error() const { return m_error; }
+
+    // null until open() succeeds
+    SDL_Surface* surface() const { return m_surface; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    bool vsync() const { return m_vsync; }
+
+    void clear(Uint32 color);
+    void present();
+
+    // destroys the renderer; must run before the window is destroyed
+    void close();
+
+private:
+    void release();
+
+    SDL_Renderer* m_renderer = nullptr;
+    SDL_Texture* m_texture = nullptr;
+    SDL_Surface* m_surface = nullptr;  // wraps m_pixels, owns no memory
+    std::vector<Uint32> m_pixels;
+    Uint32 m_format = 0;
+    int m_width = 0;
+    int m_height = 0;
+    bool m_vsync = false;
+    std::string m_error;  // of the last resize
+};
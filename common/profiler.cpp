@@ -0,0 +1,140 @@
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+std::uint64_t profilerNow() {
+    return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// small stable ids for the trace viewer's thread lanes
+static int currentThreadId() {
+    static std::atomic<int> next{0};
+    thread_local int id = next++;
+    return id;
+}
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+int Profiler::phaseId(const char* name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_phases.size(); ++i) {
+        if (m_phases[i].name == name) return (int)i;
+    }
+    m_phases.emplace_back();
+    m_phases.back().name = name;
+    return (int)m_phases.size() - 1;
+}
+
+int Profiler::bucketFor(std::uint64_t ns) {
+    if (ns < PROFILE_HISTOGRAM_SUBBUCKETS) return (int)ns;
+    int octave = 63;
+    while (!(ns >> octave)) --octave;
+    // the three bits below the leading one pick the sub-bucket
+    int sub = (int)((ns >> (octave - 3)) & (PROFILE_HISTOGRAM_SUBBUCKETS - 1));
+    int bucket = (octave - 2) * PROFILE_HISTOGRAM_SUBBUCKETS + sub;
+    return std::min(bucket, PROFILE_HISTOGRAM_OCTAVES * PROFILE_HISTOGRAM_SUBBUCKETS - 1);
+}
+
+double Profiler::bucketUpperNs(int bucket) {
+    if (bucket < PROFILE_HISTOGRAM_SUBBUCKETS) return bucket + 1;
+    int octave = bucket / PROFILE_HISTOGRAM_SUBBUCKETS + 2;
+    int sub = bucket % PROFILE_HISTOGRAM_SUBBUCKETS;
+    return (double)(((std::uint64_t)(PROFILE_HISTOGRAM_SUBBUCKETS + sub + 1)) << (octave - 3));
+}
+
+void Profiler::record(int phase, std::uint64_t startNs, std::uint64_t endNs) {
+    std::uint64_t duration = endNs - startNs;
+    int thread = currentThreadId();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Phase& p = m_phases[phase];
+    ++p.count;
+    p.totalNs += duration;
+    p.lastNs = duration;
+    ++p.buckets[bucketFor(duration)];
+
+    if (m_events.size() < PROFILE_MAX_TRACE_EVENTS) {
+        // one reservation up front; growing would copy the whole trace mid-run.
+        // untouched pages of it are never committed
+        if (m_events.capacity() == 0) m_events.reserve(PROFILE_MAX_TRACE_EVENTS);
+        m_events.push_back({ phase, thread, startNs, duration });
+    } else {
+        ++m_droppedEvents;
+    }
+}
+
+double Profiler::percentileMs(const Phase& phase, double fraction) const {
+    if (phase.count == 0) return 0.0;
+    std::uint64_t target = (std::uint64_t)(fraction * (phase.count - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (int b = 0; b < PROFILE_HISTOGRAM_OCTAVES * PROFILE_HISTOGRAM_SUBBUCKETS; ++b) {
+        seen += phase.buckets[b];
+        if (seen >= target) return bucketUpperNs(b) * 1e-6;
+    }
+    return bucketUpperNs(PROFILE_HISTOGRAM_OCTAVES * PROFILE_HISTOGRAM_SUBBUCKETS - 1) * 1e-6;
+}
+
+std::vector<PhaseStats> Profiler::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<PhaseStats> result;
+    result.reserve(m_phases.size());
+    for (const auto& phase : m_phases) {
+        double mean = phase.count ? phase.totalNs * 1e-6 / phase.count : 0.0;
+        result.push_back({ phase.name, phase.count, mean, percentileMs(phase, 0.5), percentileMs(phase, 0.99), phase.lastNs * 1e-6 });
+    }
+    return result;
+}
+
+void Profiler::printSummary(std::ostream& out) const {
+    std::vector<PhaseStats> phases = stats();
+    if (phases.empty()) return;
+    out << std::left << std::setw(28) << "phase" << std::right
+        << std::setw(10) << "count" << std::setw(12) << "mean ms"
+        << std::setw(12) << "p50 ms" << std::setw(12) << "p99 ms" << "\n";
+    for (const auto& phase : phases) {
+        out << std::left << std::setw(28) << phase.name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << phase.count << std::setw(12) << phase.meanMs
+            << std::setw(12) << phase.p50Ms << std::setw(12) << phase.p99Ms << "\n";
+    }
+    out << std::defaultfloat;
+}
+
+static void writeJsonString(std::ostream& out, const std::string& text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out << "{\"displayTimeUnit\":\"ms\",\"droppedEvents\":" << m_droppedEvents << ",\"traceEvents\":[";
+    char number[64];
+    for (size_t i = 0; i < m_events.size(); ++i) {
+        const TraceEvent& event = m_events[i];
+        if (i) out << ',';
+        out << "\n{\"name\":";
+        writeJsonString(out, m_phases[event.phase].name);
+        // microseconds with sub-microsecond precision
+        std::snprintf(number, sizeof(number), "%.3f", (event.startNs - m_epochNs) * 1e-3);
+        out << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread << ",\"ts\":" << number;
+        std::snprintf(number, sizeof(number), "%.3f", event.durationNs * 1e-3);
+        out << ",\"dur\":" << number << '}';
+    }
+    out << "\n]}\n";
+    return (bool)out;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// scoped phase timing. PROFILE_SCOPE compiles to nothing unless
+// ENABLE_PROFILING is defined, which the builds do for every non-Release config
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if defined(ENABLE_PROFILING)
+#define PROFILING_ENABLED 1
+#define PROFILE_SCOPE(name)                                                             \
+    static const int PROFILE_CONCAT(profilePhase, __LINE__) = Profiler::instance().phaseId(name); \
+    ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(PROFILE_CONCAT(profilePhase, __LINE__))
+#else
+#define PROFILING_ENABLED 0
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
+
+// log-linear histogram of durations in nanoseconds: 8 sub-buckets per power of two
+#define PROFILE_HISTOGRAM_OCTAVES 40
+#define PROFILE_HISTOGRAM_SUBBUCKETS 8
+// trace events kept for the Chrome trace dump, later events are only counted
+#define PROFILE_MAX_TRACE_EVENTS (1 << 20)
+
+std::uint64_t profilerNow();
+
+struct PhaseStats {
+    std::string name;
+    std::uint64_t count;
+    double meanMs;
+    double p50Ms;
+    double p99Ms;
+    double lastMs;
+};
+
+class Profiler {
+public:
+    static Profiler& instance();
+
+    int phaseId(const char* name);
+    void record(int phase, std::uint64_t startNs, std::uint64_t endNs);
+
+    std::vector<PhaseStats> stats() const;
+    void printSummary(std::ostream& out) const;
+    // chrome://tracing / Perfetto "traceEvents" JSON
+    bool writeChromeTrace(const std::string& path) const;
+
+private:
+    struct Phase {
+        std::string name;
+        std::uint64_t count = 0;
+        std::uint64_t totalNs = 0;
+        std::uint64_t lastNs = 0;
+        std::uint32_t buckets[PROFILE_HISTOGRAM_OCTAVES * PROFILE_HISTOGRAM_SUBBUCKETS] = {};
+    };
+
+    struct TraceEvent {
+        int phase;
+        int thread;
+        std::uint64_t startNs;
+        std::uint64_t durationNs;
+    };
+
+    static int bucketFor(std::uint64_t ns);
+    static double bucketUpperNs(int bucket);
+    double percentileMs(const Phase& phase, double fraction) const;
+
+    mutable std::mutex m_mutex;
+    std::vector<Phase> m_phases;
+    std::vector<TraceEvent> m_events;
+    std::uint64_t m_droppedEvents = 0;
+    std::uint64_t m_epochNs = profilerNow();
+};
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(int phase) : m_phase(phase), m_start(profilerNow()) {}
+    ~ScopedTimer() { Profiler::instance().record(m_phase, m_start, profilerNow()); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    int m_phase;
+    std::uint64_t m_start;
+};
@@ -0,0 +1,119 @@
+#include "profiler_overlay.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include "profiler.h"
+
+struct Glyph {
+    char c;
+    Uint16 bits;  // bit (row * 3 + column) set for lit pixels
+};
+
+static const Glyph FONT[] = {
+    { '0', 0x7B6F },
+    { '1', 0x749A },
+    { '2', 0x73E7 },
+    { '3', 0x79A7 },
+    { '4', 0x49ED },
+    { '5', 0x79CF },
+    { '6', 0x7BCF },
+    { '7', 0x2527 },
+    { '8', 0x7BEF },
+    { '9', 0x79EF },
+    { 'A', 0x5BEA },
+    { 'B', 0x3AEB },
+    { 'C', 0x624E },
+    { 'D', 0x3B6B },
+    { 'E', 0x72CF },
+    { 'F', 0x12CF },
+    { 'G', 0x6B4E },
+    { 'H', 0x5BED },
+    { 'I', 0x7497 },
+    { 'J', 0x2B24 },
+    { 'K', 0x5AED },
+    { 'L', 0x7249 },
+    { 'M', 0x5BFD },
+    { 'N', 0x5B6B },
+    { 'O', 0x2B6A },
+    { 'P', 0x12EB },
+    { 'Q', 0x676A },
+    { 'R', 0x5AEB },
+    { 'S', 0x388E },
+    { 'T', 0x2497 },
+    { 'U', 0x7B6D },
+    { 'V', 0x256D },
+    { 'W', 0x5FED },
+    { 'X', 0x5AAD },
+    { 'Y', 0x24AD },
+    { 'Z', 0x72A7 },
+    { '.', 0x2000 },
+    { ':', 0x0410 },
+    { '-', 0x01C0 },
+    { '_', 0x7000 },
+    { '/', 0x12A4 },
+    { '%', 0x52A5 },
+};
+
+static Uint16 glyphBits(char c) {
+    c = (char)std::toupper((unsigned char)c);
+    for (const Glyph& glyph : FONT) {
+        if (glyph.c == c) return glyph.bits;
+    }
+    return 0;
+}
+
+static void FillRectClipped(SDL_Surface* surface, int x, int y, int w, int h, Uint32 color) {
+    int x0 = std::max(0, x), y0 = std::max(0, y);
+    int x1 = std::min(surface->w, x + w), y1 = std::min(surface->h, y + h);
+    for (int row = y0; row < y1; ++row) {
+        Uint32* pixels = reinterpret_cast<Uint32*>(static_cast<Uint8*>(surface->pixels) + (size_t)row * surface->pitch);
+        std::fill(pixels + x0, pixels + std::max(x0, x1), color);
+    }
+}
+
+void DrawText(SDL_Surface* surface, int x, int y, const char* text, Uint32 color, int scale) {
+    for (; *text; ++text, x += 4 * scale) {
+        Uint16 bits = glyphBits(*text);
+        for (int bit = 0; bit < 15; ++bit) {
+            if (bits & (1 << bit)) FillRectClipped(surface, x + (bit % 3) * scale, y + (bit / 3) * scale, scale, scale, color);
+        }
+    }
+}
+
+void DrawProfilerOverlay(SDL_Surface* surface) {
+    std::vector<PhaseStats> phases = Profiler::instance().stats();
+
+    const int scale = 2;
+    const int lineHeight = 7 * scale;
+    const int barX = 4 + 48 * 4 * scale;
+    const int barWidth = 160;
+    // bars are scaled against one 60 Hz frame
+    const double frameMs = 1000.0 / 60.0;
+
+    Uint32 background = SDL_MapRGB(surface->format, 16, 16, 16);
+    Uint32 text = SDL_MapRGB(surface->format, 230, 230, 230);
+    Uint32 p50Color = SDL_MapRGB(surface->format, 80, 200, 80);
+    Uint32 p99Color = SDL_MapRGB(surface->format, 200, 80, 60);
+
+    int rows = (int)phases.size() + 1;
+    FillRectClipped(surface, 0, 0, barX + barWidth + 4, rows * lineHeight + 4, background);
+
+    char line[128];
+    if (PROFILING_ENABLED) {
+        std::snprintf(line, sizeof(line), "%-28s %8s  %8s", "phase", "p50 ms", "p99 ms");
+    } else {
+        std::snprintf(line, sizeof(line), "profiling disabled in this build");
+    }
+    DrawText(surface, 4, 4, line, text, scale);
+
+    int y = 4 + lineHeight;
+    for (const auto& phase : phases) {
+        std::snprintf(line, sizeof(line), "%-28.28s %8.3f  %8.3f", phase.name.c_str(), phase.p50Ms, phase.p99Ms);
+        DrawText(surface, 4, y, line, text, scale);
+        int p99 = (int)std::min<double>(barWidth, phase.p99Ms / frameMs * barWidth);
+        int p50 = (int)std::min<double>(barWidth, phase.p50Ms / frameMs * barWidth);
+        FillRectClipped(surface, barX, y, p99, 5 * scale, p99Color);
+        FillRectClipped(surface, barX, y, p50, 5 * scale, p50Color);
+        y += lineHeight;
+    }
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <SDL.h>
+
+// draws the p50/p99 of every profiled phase as text and bars in the top-left
+// corner; the surface must be locked and 32 bits per pixel
+void DrawProfilerOverlay(SDL_Surface* surface);
+
+// 3x5 pixel font, uppercase letters, digits and a little punctuation
+void DrawText(SDL_Surface* surface, int x, int y, const char* text, Uint32 color, int scale);
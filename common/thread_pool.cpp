@@ -0,0 +1,125 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+// 0 on every thread that is not a pool worker
+static thread_local unsigned t_threadIndex = 0;
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threadCount; ++i) m_queues.push_back(std::make_unique<Queue>());
+    // queue 0 belongs to the caller of parallelFor
+    for (unsigned i = 1; i < threadCount; ++i) m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads) thread.join();
+}
+
+void ThreadPool::run(size_t first, size_t last, size_t grain, void (*invoke)(void*, size_t, size_t), void* context) {
+    if (first >= last) return;
+    grain = std::max<size_t>(1, grain);
+    size_t chunks = (last - first + grain - 1) / grain;
+
+    if (m_threads.empty() || chunks == 1) {
+        invoke(context, first, last);
+        return;
+    }
+
+    // hand each thread a contiguous run of chunks, stealing evens out the rest
+    unsigned threads = threadCount();
+    m_pending.store(chunks, std::memory_order_relaxed);
+    for (unsigned t = 0; t < threads; ++t) {
+        size_t from = chunks * t / threads;
+        size_t to = chunks * (t + 1) / threads;
+        std::lock_guard<std::mutex> lock(m_queues[t]->mutex);
+        for (size_t c = from; c < to; ++c) {
+            size_t begin = first + c * grain;
+            m_queues[t]->pushBack({ invoke, context, begin, std::min(last, begin + grain) });
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        ++m_generation;
+    }
+    m_wake.notify_all();
+
+    Task task;
+    while (popTask(0, task)) execute(task);
+    while (m_pending.load(std::memory_order_acquire) != 0) std::this_thread::yield();
+}
+
+unsigned ThreadPool::currentThread() {
+    return t_threadIndex;
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+    t_threadIndex = index;
+    std::uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop) return;
+            seen = m_generation;
+        }
+        Task task;
+        while (popTask(index, task)) execute(task);
+    }
+}
+
+bool ThreadPool::popTask(unsigned index, Task& task) {
+    {
+        Queue& own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.popFront(task)) return true;
+    }
+    // steal from the far end so the victim keeps walking its chunks in order
+    unsigned threads = threadCount();
+    for (unsigned offset = 1; offset < threads; ++offset) {
+        Queue& victim = *m_queues[(index + offset) % threads];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.popBack(task)) return true;
+    }
+    return false;
+}
+
+void ThreadPool::Queue::pushBack(const Task& task) {
+    if (size == ring.size()) {
+        std::vector<Task> grown(std::max<size_t>(16, ring.size() * 2));
+        for (size_t i = 0; i < size; ++i) grown[i] = ring[(head + i) % ring.size()];
+        ring.swap(grown);
+        head = 0;
+    }
+    ring[(head + size) % ring.size()] = task;
+    ++size;
+}
+
+bool ThreadPool::Queue::popFront(Task& task) {
+    if (size == 0) return false;
+    task = ring[head];
+    head = (head + 1) % ring.size();
+    --size;
+    return true;
+}
+
+bool ThreadPool::Queue::popBack(Task& task) {
+    if (size == 0) return false;
+    --size;
+    task = ring[(head + size) % ring.size()];
+    return true;
+}
+
+void ThreadPool::execute(const Task& task) {
+    task.invoke(task.context, task.begin, task.end);
+    m_pending.fetch_sub(1, std::memory_order_release);
+}
+
+size_t chunkSize(size_t items, unsigned threads, size_t multiple) {
+    size_t target = items / (std::max(1u, threads) * 8) + 1;
+    return (target + multiple - 1) / multiple * multiple;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// fork-join pool with one task deque per thread; idle threads steal from the
+// others. the thread calling parallelFor works on its own deque too.
+class ThreadPool {
+public:
+    // 0 picks std::thread::hardware_concurrency(); 1 runs everything inline
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned threadCount() const { return (unsigned)m_queues.size(); }
+
+    // index in [0, threadCount()) of the calling thread inside a chunk of
+    // parallelFor, e.g. to pick per-thread scratch; the caller of parallelFor is 0
+    static unsigned currentThread();
+
+    // calls fn(begin, end) for consecutive chunks of at most `grain` items
+    // covering [first, last) and returns once every chunk has finished.
+    // chunk boundaries are first + k * grain. not reentrant.
+    template <typename Fn>
+    void parallelFor(size_t first, size_t last, size_t grain, Fn&& fn) {
+        using Callable = std::remove_reference_t<Fn>;
+        auto invoke = [](void* context, size_t begin, size_t end) {
+            (*static_cast<Callable*>(context))(begin, end);
+        };
+        run(first, last, grain, invoke, const_cast<void*>(static_cast<const void*>(&fn)));
+    }
+
+private:
+    struct Task {
+        void (*invoke)(void*, size_t, size_t);
+        void* context;
+        size_t begin, end;
+    };
+
+    // growable ring of tasks; it keeps its capacity, so once it has held the
+    // largest batch, parallelFor no longer allocates
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Task> ring;
+        size_t head = 0;  // index of the front task
+        size_t size = 0;
+
+        void pushBack(const Task& task);
+        bool popFront(Task& task);
+        bool popBack(Task& task);
+    };
+
+    void run(size_t first, size_t last, size_t grain, void (*invoke)(void*, size_t, size_t), void* context);
+    void workerLoop(unsigned index);
+    bool popTask(unsigned index, Task& task);
+    void execute(const Task& task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    std::uint64_t m_generation = 0;
+    bool m_stop = false;
+
+    std::atomic<size_t> m_pending{0};
+};
+
+// chunk size giving every thread several chunks to balance with, rounded up to `multiple`
+size_t chunkSize(size_t items, unsigned threads, size_t multiple);
@@ -0,0 +1,73 @@
+// google benchmark suite for the n-body hot paths; export results with
+// --benchmark_out=results.json --benchmark_out_format=json
+#include <benchmark/benchmark.h>
+#include <random>
+#include "body_system.h"
+#include "force_engine.h"
+#include "thread_pool.h"
+#ifdef NBODY_BENCH_RENDER
+#include <SDL.h>
+#include "render.h"
+#endif
+
+// n moon-mass bodies spread through a sphere around an earth-moon distance
+static BodySystem randomBodies(size_t n) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    BodySystem bodies;
+    while (bodies.count < n) {
+        Vec3 p = { unit(rng), unit(rng), unit(rng) };
+        if (p.length() > 1.0f) continue;
+        bodies.add({ p * EARTH_MOON_DISTANCE, { 0.0f, 0.0f, 0.0f }, MOON_RADIUS, MOON_MASS, 0xFFFFFFFF });
+    }
+    return bodies;
+}
+
+static void forceBenchmark(benchmark::State& state, ForceMode mode) {
+    BodySystem bodies = randomBodies((size_t)state.range(0));
+    ThreadPool pool((unsigned)state.range(1));
+    ForceSettings settings;
+    settings.mode = mode;
+    std::unique_ptr<ForceEngine> engine = createForceEngine(settings, &pool);
+    for (auto _ : state) {
+        engine->computeAccelerations(bodies);
+        benchmark::DoNotOptimize(bodies.ax.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * bodies.count);
+    state.counters["bodies"] = (double)bodies.count;
+}
+
+static void BM_AllPairs(benchmark::State& state) { forceBenchmark(state, ForceMode::AllPairs); }
+static void BM_BarnesHut(benchmark::State& state) { forceBenchmark(state, ForceMode::BarnesHut); }
+static void BM_Fmm(benchmark::State& state) { forceBenchmark(state, ForceMode::Fmm); }
+
+// (bodies, threads); all-pairs stops earlier since it is quadratic
+BENCHMARK(BM_AllPairs)->ArgsProduct({ { 256, 1024, 4096, 16384 }, { 1, 0 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BarnesHut)->ArgsProduct({ { 256, 1024, 4096, 16384, 65536 }, { 1, 0 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Fmm)->ArgsProduct({ { 1024, 16384, 65536, 262144 }, { 1, 0 } })->Unit(benchmark::kMillisecond);
+
+#ifdef NBODY_BENCH_RENDER
+// fill rate of one shaded sphere of the given pixel radius, centered on a 1024^2 surface
+static void BM_FillSphere(benchmark::State& state) {
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, 1024, 1024, 32, SDL_PIXELFORMAT_ARGB8888);
+    float pixelRadius = (float)state.range(0);
+
+    // camera at the origin looking down +z; at z = FOV the projection halves sizes
+    Camera camera;
+    camera.position = { 0.0f, 0.0f, 0.0f };
+    camera.rotation = { 0.0f, 0.0f, 0.0f };
+    Object obj = { { 0.0f, 0.0f, FOV }, { 0.0f, 0.0f, 0.0f }, 2.0f * pixelRadius / (SCALE * RADIUS_SCALE), 1.0f, 0x3366FFFF };
+
+    for (auto _ : state) {
+        FillSphere(surface, camera, obj);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)(3.14159265f * pixelRadius * pixelRadius));
+    state.SetLabel("items = pixels");
+    SDL_FreeSurface(surface);
+}
+BENCHMARK(BM_FillSphere)->RangeMultiplier(4)->Range(4, 256);
+#endif
+
+BENCHMARK_MAIN();
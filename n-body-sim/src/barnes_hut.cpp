@@ -0,0 +1,175 @@
+#include "barnes_hut.h"
+#include <algorithm>
+#include "profiler.h"
+#include "thread_pool.h"
+
+#define OCTREE_MAX_DEPTH 24
+
+void Octree::build(const BodySystem& bodies, float theta) {
+    PROFILE_SCOPE("octree build");
+    // the pool is regrown, while empty, once the largest tree so far comes
+    // within an eighth of its capacity, and then gets half again as much room,
+    // so slow growth of the tree only rarely reaches the heap. there is no useful
+    // hard bound on the node count (clustered bodies subdivide down to
+    // OCTREE_MAX_DEPTH), so a tree well past the largest so far still regrows
+    // the pool through push_back mid-build; insert() only holds indices across it
+    size_t needed = std::max(bodies.count * 2, m_largestTree + m_largestTree / 8);
+    m_nodes.clear();
+    if (m_nodes.capacity() < needed) m_nodes.reserve(needed + needed / 2);
+    if (bodies.count == 0) return;
+
+    Vec3 lo = bodies.position(0);
+    Vec3 hi = lo;
+    for (size_t i = 1; i < bodies.count; ++i) {
+        lo = { std::min(lo.x, bodies.x[i]), std::min(lo.y, bodies.y[i]), std::min(lo.z, bodies.z[i]) };
+        hi = { std::max(hi.x, bodies.x[i]), std::max(hi.y, bodies.y[i]), std::max(hi.z, bodies.z[i]) };
+    }
+    Vec3 extent = hi - lo;
+    float halfSize = 0.5f * std::max(extent.x, std::max(extent.y, extent.z));
+    // pad so bodies on the upper faces still land inside the root
+    halfSize = halfSize * 1.001f + 1.0f;
+
+    m_nodes.push_back({ (lo + hi) * 0.5f, halfSize, { 0, 0, 0 }, 0.0f, 0.0f, -1, -1 });
+
+    for (size_t i = 0; i < bodies.count; ++i) {
+        if (bodies.mass[i] > 0.0f) insert((int)i, bodies.position(i), bodies.mass[i]);
+    }
+    m_largestTree = std::max(m_largestTree, m_nodes.size());
+
+    // accept a node only when the body is further than size / theta plus the
+    // offset of the mass center, which also keeps a body from accepting its own cell
+    float invTheta = theta > 0.0f ? 1.0f / theta : 1e30f;
+    for (auto& node : m_nodes) {
+        if (node.mass > 0.0f) node.massCenter = node.massCenter * (1.0f / node.mass);
+        float offset = (node.massCenter - node.center).length();
+        float openRadius = 2.0f * node.halfSize * invTheta + offset;
+        node.openRadiusSq = openRadius * openRadius;
+    }
+}
+
+void Octree::insert(int index, const Vec3& position, float mass) {
+    int current = 0;
+    for (int depth = 0;; ++depth) {
+        if (m_nodes[current].firstChild < 0) {
+            OctreeNode& leaf = m_nodes[current];
+            if (leaf.body < 0 && leaf.mass == 0.0f) {
+                leaf.body = index;
+                leaf.mass = mass;
+                leaf.massCenter = position * mass;
+                return;
+            }
+            if (depth >= OCTREE_MAX_DEPTH) {
+                // (nearly) coincident bodies share one aggregate leaf
+                leaf.body = -1;
+                leaf.mass += mass;
+                leaf.massCenter += position * mass;
+                return;
+            }
+
+            int existing = leaf.body;
+            float existingMass = leaf.mass;
+            Vec3 existingPos = leaf.massCenter * (1.0f / existingMass);
+
+            subdivide(current);
+            OctreeNode& parent = m_nodes[current];
+            parent.body = -1;
+            OctreeNode& child = m_nodes[parent.firstChild + childFor(parent, existingPos)];
+            child.body = existing;
+            child.mass = existingMass;
+            child.massCenter = existingPos * existingMass;
+        }
+
+        OctreeNode& node = m_nodes[current];
+        node.mass += mass;
+        node.massCenter += position * mass;
+        current = node.firstChild + childFor(node, position);
+    }
+}
+
+void Octree::subdivide(int node) {
+    int first = (int)m_nodes.size();
+    Vec3 center = m_nodes[node].center;
+    float half = m_nodes[node].halfSize * 0.5f;
+    for (int octant = 0; octant < 8; ++octant) {
+        Vec3 offset = {
+            (octant & 1) ? half : -half,
+            (octant & 2) ? half : -half,
+            (octant & 4) ? half : -half,
+        };
+        m_nodes.push_back({ center + offset, half, { 0, 0, 0 }, 0.0f, 0.0f, -1, -1 });
+    }
+    m_nodes[node].firstChild = first;
+}
+
+int Octree::childFor(const OctreeNode& node, const Vec3& position) const {
+    return (position.x >= node.center.x ? 1 : 0)
+         | (position.y >= node.center.y ? 2 : 0)
+         | (position.z >= node.center.z ? 4 : 0);
+}
+
+Vec3 Octree::accelerationAt(const Vec3& position, int self) const {
+    Vec3 accel = { 0, 0, 0 };
+    if (m_nodes.empty()) return accel;
+
+    int stack[8 * OCTREE_MAX_DEPTH + 8];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const OctreeNode& node = m_nodes[stack[--top]];
+        if (node.mass == 0.0f) continue;
+
+        if (node.firstChild < 0) {
+            if (node.body != self) accel += gravityAcceleration(position, node.massCenter, node.mass);
+            continue;
+        }
+
+        if ((node.massCenter - position).lengthSquared() > node.openRadiusSq) {
+            accel += gravityAcceleration(position, node.massCenter, node.mass);
+        } else {
+            for (int c = 0; c < 8; ++c) stack[top++] = node.firstChild + c;
+        }
+    }
+    return accel;
+}
+
+// the tree still holds every body, only the walks are limited to the active ones
+void BarnesHutEngine::computeAccelerations(BodySystem& bodies, const std::vector<std::uint32_t>& active) {
+    m_tree.build(bodies, m_theta);
+
+    PROFILE_SCOPE("octree walk");
+    auto walk = [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            std::uint32_t i = active[k];
+            Vec3 accel = m_tree.accelerationAt(bodies.position(i), (int)i);
+            bodies.ax[i] = accel.x;
+            bodies.ay[i] = accel.y;
+            bodies.az[i] = accel.z;
+        }
+    };
+    if (m_pool) {
+        m_pool->parallelFor(0, active.size(), chunkSize(active.size(), m_pool->threadCount(), 64), walk);
+    } else {
+        walk(0, active.size());
+    }
+}
+
+void BarnesHutEngine::computeAccelerations(BodySystem& bodies) {
+    m_tree.build(bodies, m_theta);
+
+    PROFILE_SCOPE("octree walk");
+    // the tree is read-only during the walks, each body writes only its own slot
+    auto walk = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Vec3 accel = m_tree.accelerationAt(bodies.position(i), (int)i);
+            bodies.ax[i] = accel.x;
+            bodies.ay[i] = accel.y;
+            bodies.az[i] = accel.z;
+        }
+    };
+    if (m_pool) {
+        m_pool->parallelFor(0, bodies.count, chunkSize(bodies.count, m_pool->threadCount(), 64), walk);
+    } else {
+        walk(0, bodies.count);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include "force_engine.h"
+
+struct OctreeNode {
+    Vec3 center;      // geometric center of the cube
+    float halfSize;
+    Vec3 massCenter;  // mass-weighted sum while building, center of mass afterwards
+    float mass;
+    float openRadiusSq;  // bodies closer than this must open the node
+    int firstChild;   // index of the first of 8 contiguous children, -1 for leaves
+    int body;         // object index for single-body leaves, -1 otherwise
+};
+
+class Octree {
+public:
+    void build(const BodySystem& bodies, float theta);
+    Vec3 accelerationAt(const Vec3& position, int self) const;
+
+    const std::vector<OctreeNode>& nodes() const { return m_nodes; }
+
+private:
+    void insert(int index, const Vec3& position, float mass);
+    void subdivide(int node);
+    int childFor(const OctreeNode& node, const Vec3& position) const;
+
+    // pooled across builds: cleared but never shrunk, see build()
+    std::vector<OctreeNode> m_nodes;
+    size_t m_largestTree = 0;
+};
+
+class BarnesHutEngine : public ForceEngine {
+public:
+    explicit BarnesHutEngine(float theta, ThreadPool* pool = nullptr) : m_theta(theta), m_pool(pool) {}
+
+    const char* name() const override { return "barnes-hut"; }
+    void computeAccelerations(BodySystem& bodies) override;
+    void computeAccelerations(BodySystem& bodies, const std::vector<std::uint32_t>& active) override;
+
+    float theta() const { return m_theta; }
+    void setTheta(float theta) { m_theta = theta; }
+
+private:
+    float m_theta;
+    ThreadPool* m_pool;
+    Octree m_tree;
+};
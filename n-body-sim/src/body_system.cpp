@@ -0,0 +1,172 @@
+#include "body_system.h"
+#include <cstring>
+
+const char* precisionName(Precision precision) {
+    switch (precision) {
+    case Precision::Single: return "single";
+    case Precision::Mixed: return "mixed";
+    case Precision::Double: return "double";
+    }
+    return "unknown";
+}
+
+bool parsePrecision(const char* text, Precision& precision) {
+    if (std::strcmp(text, "single") == 0 || std::strcmp(text, "float") == 0) {
+        precision = Precision::Single;
+    } else if (std::strcmp(text, "mixed") == 0) {
+        precision = Precision::Mixed;
+    } else if (std::strcmp(text, "double") == 0) {
+        precision = Precision::Double;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void BodySystem::resize(size_t n) {
+    size_t padded = paddedSize(n);
+    for (auto* arr : { &x, &y, &z, &vx, &vy, &vz, &mass, &ax, &ay, &az }) {
+        arr->resize(padded, 0.0f);
+    }
+    // clear slots that drop into the padding when shrinking
+    for (size_t i = n; i < padded; ++i) {
+        x[i] = y[i] = z[i] = 0.0f;
+        vx[i] = vy[i] = vz[i] = 0.0f;
+        mass[i] = 0.0f;
+    }
+    radius.resize(n, 0.0f);
+    color.resize(n, 0);
+    if (precise()) {
+        for (auto* arr : { &px, &py, &pz, &pvx, &pvy, &pvz }) arr->resize(n, 0.0);
+    }
+    if (preciseAccelerations()) {
+        for (auto* arr : { &pax, &pay, &paz }) arr->resize(n, 0.0);
+    }
+    count = n;
+}
+
+void BodySystem::reserve(size_t n) {
+    size_t padded = paddedSize(n);
+    for (auto* arr : { &x, &y, &z, &vx, &vy, &vz, &mass, &ax, &ay, &az }) arr->reserve(padded);
+    radius.reserve(n);
+    color.reserve(n);
+    if (precise()) {
+        for (auto* arr : { &px, &py, &pz, &pvx, &pvy, &pvz }) arr->reserve(n);
+    }
+    if (preciseAccelerations()) {
+        for (auto* arr : { &pax, &pay, &paz }) arr->reserve(n);
+    }
+}
+
+void BodySystem::add(const Object& obj) {
+    resize(count + 1);
+    set(count - 1, obj);
+}
+
+Object BodySystem::object(size_t i) const {
+    return { position(i), velocity(i), radius[i], mass[i], color[i] };
+}
+
+void BodySystem::set(size_t i, const Object& obj) {
+    set(i, obj.as<double>());
+}
+
+void BodySystem::set(size_t i, const ObjectD& obj) {
+    x[i] = (float)obj.position.x;
+    y[i] = (float)obj.position.y;
+    z[i] = (float)obj.position.z;
+    vx[i] = (float)obj.velocity.x;
+    vy[i] = (float)obj.velocity.y;
+    vz[i] = (float)obj.velocity.z;
+    mass[i] = (float)obj.mass;
+    radius[i] = (float)obj.radius;
+    color[i] = obj.color;
+    if (precise()) {
+        px[i] = obj.position.x;
+        py[i] = obj.position.y;
+        pz[i] = obj.position.z;
+        pvx[i] = obj.velocity.x;
+        pvy[i] = obj.velocity.y;
+        pvz[i] = obj.velocity.z;
+    }
+}
+
+void BodySystem::setAcceleration(size_t i, const Vec3d& a) {
+    ax[i] = (float)a.x;
+    ay[i] = (float)a.y;
+    az[i] = (float)a.z;
+    if (preciseAccelerations()) {
+        pax[i] = a.x;
+        pay[i] = a.y;
+        paz[i] = a.z;
+    }
+}
+
+void BodySystem::setPrecision(Precision precision) {
+    if (precision == m_precision) return;
+    bool wasPrecise = precise();
+    m_precision = precision;
+    if (!preciseAccelerations()) {
+        for (auto* arr : { &pax, &pay, &paz }) AlignedVector<double>().swap(*arr);
+    } else {
+        storeAccelerationsAsPrecise();
+    }
+    if (!precise()) {
+        for (auto* arr : { &px, &py, &pz, &pvx, &pvy, &pvz }) AlignedVector<double>().swap(*arr);
+    } else if (!wasPrecise) {
+        storeMirrorsAsPrecise();
+    }
+}
+
+void BodySystem::storeAccelerationsAsPrecise() {
+    if (!preciseAccelerations()) return;
+    pax.assign(ax.begin(), ax.begin() + count);
+    pay.assign(ay.begin(), ay.begin() + count);
+    paz.assign(az.begin(), az.begin() + count);
+}
+
+void BodySystem::storeAccelerationsAsPrecise(const std::vector<std::uint32_t>& indices) {
+    if (!preciseAccelerations()) return;
+    for (std::uint32_t i : indices) {
+        pax[i] = ax[i];
+        pay[i] = ay[i];
+        paz[i] = az[i];
+    }
+}
+
+void BodySystem::storeMirrorsAsPrecise() {
+    if (!precise()) return;
+    px.assign(x.begin(), x.begin() + count);
+    py.assign(y.begin(), y.begin() + count);
+    pz.assign(z.begin(), z.begin() + count);
+    pvx.assign(vx.begin(), vx.begin() + count);
+    pvy.assign(vy.begin(), vy.begin() + count);
+    pvz.assign(vz.begin(), vz.begin() + count);
+}
+
+void BodySystem::compact(const std::vector<std::uint8_t>& keep) {
+    size_t out = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!keep[i]) continue;
+        if (out != i) {
+            for (auto* arr : { &x, &y, &z, &vx, &vy, &vz, &mass, &ax, &ay, &az }) (*arr)[out] = (*arr)[i];
+            radius[out] = radius[i];
+            color[out] = color[i];
+            if (precise()) {
+                for (auto* arr : { &px, &py, &pz, &pvx, &pvy, &pvz }) (*arr)[out] = (*arr)[i];
+            }
+            if (preciseAccelerations()) {
+                for (auto* arr : { &pax, &pay, &paz }) (*arr)[out] = (*arr)[i];
+            }
+        }
+        ++out;
+    }
+    resize(out);
+}
+
+BodySystem BodySystem::fromObjects(const std::vector<Object>& objects) {
+    BodySystem bodies;
+    bodies.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) bodies.set(i, objects[i]);
+    return bodies;
+}
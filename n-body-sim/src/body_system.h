@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include "object.h"
+
+// arrays are padded to a multiple of the widest float vector we target (AVX2)
+#define SIMD_WIDTH 8
+#define SIMD_ALIGNMENT 64
+
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(SIMD_ALIGNMENT)));
+    }
+    void deallocate(T* p, std::size_t) { ::operator delete(p, std::align_val_t(SIMD_ALIGNMENT)); }
+
+    template <typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Single keeps the whole state in float. Mixed integrates double positions
+// and velocities; the float arrays become rounded mirrors of them that the
+// float force kernels, rendering and output read. Double also sums the
+// all-pairs forces in double and keeps double accelerations
+enum class Precision {
+    Single,
+    Mixed,
+    Double,
+};
+
+const char* precisionName(Precision precision);
+bool parsePrecision(const char* text, Precision& precision);
+
+// structure-of-arrays body storage; the force kernels only touch the hot
+// position/mass arrays, render data lives in the separate cold arrays
+struct BodySystem {
+    size_t count = 0;
+
+    AlignedVector<float> x, y, z;
+    AlignedVector<float> vx, vy, vz;
+    AlignedVector<float> mass;
+    AlignedVector<float> ax, ay, az;
+
+    std::vector<float> radius;
+    std::vector<std::uint32_t> color;
+
+    // mixed precision state, count wide, empty in single precision. code that
+    // writes x/y/z or vx/vy/vz directly must update these as well
+    AlignedVector<double> px, py, pz;
+    AlignedVector<double> pvx, pvy, pvz;
+    // double precision accelerations, count wide, empty otherwise; ax/ay/az mirror them
+    AlignedVector<double> pax, pay, paz;
+
+    // padding slots are massless bodies at the origin
+    size_t paddedCount() const { return x.size(); }
+    void resize(size_t n);
+    // room for n bodies, so resizing up to n does not reallocate
+    void reserve(size_t n);
+    void add(const Object& obj);
+
+    Vec3 position(size_t i) const { return { x[i], y[i], z[i] }; }
+    Vec3 velocity(size_t i) const { return { vx[i], vy[i], vz[i] }; }
+    Vec3 acceleration(size_t i) const { return { ax[i], ay[i], az[i] }; }
+    Object object(size_t i) const;
+    void set(size_t i, const Object& obj);
+    void set(size_t i, const ObjectD& obj);
+
+    bool precise() const { return m_precision != Precision::Single; }
+    bool preciseAccelerations() const { return m_precision == Precision::Double; }
+    Precision precision() const { return m_precision; }
+    // switching to mixed or double seeds the double state from the floats
+    void setPrecision(Precision precision);
+    // overwrites the double state with the floats, after code that only wrote those
+    void storeMirrorsAsPrecise();
+    // the same for the accelerations of the listed bodies, after a float force engine
+    void storeAccelerationsAsPrecise();
+    void storeAccelerationsAsPrecise(const std::vector<std::uint32_t>& indices);
+    Vec3d precisePosition(size_t i) const { return precise() ? Vec3d{ px[i], py[i], pz[i] } : position(i).as<double>(); }
+    Vec3d preciseVelocity(size_t i) const { return precise() ? Vec3d{ pvx[i], pvy[i], pvz[i] } : velocity(i).as<double>(); }
+    Vec3d preciseAcceleration(size_t i) const {
+        return preciseAccelerations() ? Vec3d{ pax[i], pay[i], paz[i] } : acceleration(i).as<double>();
+    }
+    void setAcceleration(size_t i, const Vec3d& a);
+    ObjectD preciseObject(size_t i) const { return { precisePosition(i), preciseVelocity(i), radius[i], mass[i], color[i] }; }
+
+    // drops every body whose keep flag is 0, preserving the order of the rest
+    void compact(const std::vector<std::uint8_t>& keep);
+
+    static BodySystem fromObjects(const std::vector<Object>& objects);
+
+private:
+    Precision m_precision = Precision::Single;
+};
+
+inline size_t paddedSize(size_t n) {
+    return (n + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+}
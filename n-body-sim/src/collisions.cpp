@@ -0,0 +1,263 @@
+#include "collisions.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "profiler.h"
+
+static std::int64_t cellCoord(float v, float cellSize) {
+    return (std::int64_t)std::floor(v / cellSize);
+}
+
+static std::uint32_t hashCell(std::int64_t ix, std::int64_t iy, std::int64_t iz) {
+    std::uint64_t h = (std::uint64_t)ix * 73856093u ^ (std::uint64_t)iy * 19349663u ^ (std::uint64_t)iz * 83492791u;
+    return (std::uint32_t)(h ^ (h >> 32));
+}
+
+std::uint32_t CollisionSystem::bucketOf(float x, float y, float z) const {
+    return hashCell(cellCoord(x, m_cellSize), cellCoord(y, m_cellSize), cellCoord(z, m_cellSize)) & m_bucketMask;
+}
+
+// cells are a power of two of at least the largest typical diameter, so two
+// overlapping typical bodies always sit in neighbouring cells. the size only
+// changes when bodies outgrow it or shrink to a quarter, keeping the sorted
+// order valid across steps
+void CollisionSystem::chooseCellSize(const BodySystem& bodies) {
+    size_t n = bodies.count;
+    float* radii = m_arena.allocate<float>(n);
+    std::copy(bodies.radius.begin(), bodies.radius.begin() + n, radii);
+    std::nth_element(radii, radii + n / 2, radii + n);
+    float typical = 4.0f * radii[n / 2];
+
+    float largest = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float r = bodies.radius[i];
+        if (r <= typical || typical == 0.0f) largest = std::max(largest, r);
+    }
+    float target = std::max(1.0f, 2.0f * largest);
+    if (target > m_cellSize || target < 0.25f * m_cellSize) {
+        m_cellSize = std::exp2(std::ceil(std::log2(target)));
+        m_sortedCount = 0;
+    }
+    m_largeRadius = 0.5f * m_cellSize;
+
+    // about eight buckets per body, so a neighbour lookup rarely lands on an
+    // unrelated cell that shares its bucket
+    std::uint32_t buckets = 1;
+    while (buckets < 8 * n) buckets <<= 1;
+    if (buckets - 1 != m_bucketMask) {
+        m_bucketMask = buckets - 1;
+        m_sortedCount = 0;
+    }
+}
+
+// bodies that stayed in their bucket keep their relative order, so only the
+// ones that moved are sorted and merged back in
+void CollisionSystem::sortByBucket(const BodySystem& bodies) {
+    size_t n = bodies.count;
+    if (m_sortedCount != n) {
+        m_bucket.resize(n);
+        for (size_t i = 0; i < n; ++i) m_bucket[i] = bucketOf(bodies.x[i], bodies.y[i], bodies.z[i]);
+        m_order.resize(n);
+        std::iota(m_order.begin(), m_order.end(), 0u);
+        std::sort(m_order.begin(), m_order.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return m_bucket[a] != m_bucket[b] ? m_bucket[a] < m_bucket[b] : a < b;
+        });
+        m_sortedCount = n;
+    } else {
+        std::uint32_t* stayed = m_arena.allocate<std::uint32_t>(n);
+        std::uint32_t* moved = m_arena.allocate<std::uint32_t>(n);
+        size_t stayedCount = 0, movedCount = 0;
+        for (std::uint32_t body : m_order) {
+            std::uint32_t bucket = bucketOf(bodies.x[body], bodies.y[body], bodies.z[body]);
+            if (bucket == m_bucket[body]) {
+                stayed[stayedCount++] = body;
+            } else {
+                m_bucket[body] = bucket;
+                moved[movedCount++] = body;
+            }
+        }
+        auto byBucket = [&](std::uint32_t a, std::uint32_t b) {
+            return m_bucket[a] != m_bucket[b] ? m_bucket[a] < m_bucket[b] : a < b;
+        };
+        std::sort(moved, moved + movedCount, byBucket);
+        std::merge(stayed, stayed + stayedCount, moved, moved + movedCount, m_order.begin(), byBucket);
+    }
+
+    size_t buckets = (size_t)m_bucketMask + 1;
+    m_bucketStart = m_arena.allocate<std::uint32_t>(buckets + 1);
+    std::fill(m_bucketStart, m_bucketStart + buckets + 1, 0u);
+    m_occupied = m_arena.allocate<std::uint64_t>((buckets + 63) / 64);
+    std::fill(m_occupied, m_occupied + (buckets + 63) / 64, std::uint64_t(0));
+    for (size_t i = 0; i < n; ++i) {
+        ++m_bucketStart[m_bucket[i] + 1];
+        m_occupied[m_bucket[i] >> 6] |= std::uint64_t(1) << (m_bucket[i] & 63);
+    }
+    for (size_t b = 1; b <= buckets; ++b) m_bucketStart[b] += m_bucketStart[b - 1];
+}
+
+void CollisionSystem::testPair(const BodySystem& bodies, size_t i, size_t j) {
+    ++m_candidates;
+    float dx = bodies.x[j] - bodies.x[i];
+    float dy = bodies.y[j] - bodies.y[i];
+    float dz = bodies.z[j] - bodies.z[i];
+    float reach = bodies.radius[i] + bodies.radius[j];
+    if (dx * dx + dy * dy + dz * dz < reach * reach) {
+        m_pairs.emplace_back((std::uint32_t)std::min(i, j), (std::uint32_t)std::max(i, j));
+    }
+}
+
+// large bodies are handled on their own, so only typical neighbours are tested
+void CollisionSystem::testBucket(const BodySystem& bodies, size_t i, std::uint32_t bucket) {
+    if (!(m_occupied[bucket >> 6] >> (bucket & 63) & 1)) return;
+    for (std::uint32_t k = m_bucketStart[bucket]; k < m_bucketStart[bucket + 1]; ++k) {
+        std::uint32_t j = m_order[k];
+        if (j == i || bodies.radius[j] > m_largeRadius) continue;
+        testPair(bodies, i, j);
+    }
+}
+
+void CollisionSystem::findOverlaps(const BodySystem& bodies) {
+    PROFILE_SCOPE("collision narrow phase");
+    size_t n = bodies.count;
+    m_pairs.clear();
+    m_large = m_arena.allocate<std::uint32_t>(n);
+    m_largeCount = 0;
+    m_candidates = 0;
+
+    // typical bodies look at the 27 cells around their own, each pair once
+    for (size_t i = 0; i < n; ++i) {
+        if (bodies.radius[i] > m_largeRadius) {
+            m_large[m_largeCount++] = (std::uint32_t)i;
+            continue;
+        }
+        std::int64_t cx = cellCoord(bodies.x[i], m_cellSize);
+        std::int64_t cy = cellCoord(bodies.y[i], m_cellSize);
+        std::int64_t cz = cellCoord(bodies.z[i], m_cellSize);
+        for (int dz = -1; dz <= 1; ++dz) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    std::uint32_t bucket = hashCell(cx + dx, cy + dy, cz + dz) & m_bucketMask;
+                    if (!(m_occupied[bucket >> 6] >> (bucket & 63) & 1)) continue;
+                    for (std::uint32_t k = m_bucketStart[bucket]; k < m_bucketStart[bucket + 1]; ++k) {
+                        std::uint32_t j = m_order[k];
+                        if (j > i && bodies.radius[j] <= m_largeRadius) testPair(bodies, i, j);
+                    }
+                }
+            }
+        }
+    }
+
+    // a large body reaches typical bodies up to r + m_largeRadius away; when
+    // that block of cells outnumbers the bodies a plain scan is cheaper
+    for (size_t l = 0; l < m_largeCount; ++l) {
+        std::uint32_t i = m_large[l];
+        float reach = bodies.radius[i] + m_largeRadius;
+        std::int64_t lo[3], hi[3];
+        const float p[3] = { bodies.x[i], bodies.y[i], bodies.z[i] };
+        double cells = 1.0;
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = cellCoord(p[a] - reach, m_cellSize);
+            hi[a] = cellCoord(p[a] + reach, m_cellSize);
+            cells *= (double)(hi[a] - lo[a] + 1);
+        }
+        if (cells > (double)n) {
+            for (size_t j = 0; j < n; ++j) {
+                if (bodies.radius[j] <= m_largeRadius) testPair(bodies, i, j);
+            }
+        } else {
+            for (std::int64_t z = lo[2]; z <= hi[2]; ++z) {
+                for (std::int64_t y = lo[1]; y <= hi[1]; ++y) {
+                    for (std::int64_t x = lo[0]; x <= hi[0]; ++x) {
+                        testBucket(bodies, i, hashCell(x, y, z) & m_bucketMask);
+                    }
+                }
+            }
+        }
+    }
+    for (size_t a = 0; a < m_largeCount; ++a) {
+        for (size_t b = a + 1; b < m_largeCount; ++b) testPair(bodies, m_large[a], m_large[b]);
+    }
+
+    // neighbouring cells that hash to the same bucket report their pairs twice
+    std::sort(m_pairs.begin(), m_pairs.end());
+    m_pairs.erase(std::unique(m_pairs.begin(), m_pairs.end()), m_pairs.end());
+}
+
+size_t CollisionSystem::findRoot(size_t i) {
+    while (m_parent[i] != i) {
+        m_parent[i] = m_parent[m_parent[i]];
+        i = m_parent[i];
+    }
+    return i;
+}
+
+// chains of touching bodies become one body at the lowest index of the chain
+size_t CollisionSystem::mergeGroups(BodySystem& bodies) {
+    size_t n = bodies.count;
+    m_parent = m_arena.allocate<size_t>(n);
+    std::iota(m_parent, m_parent + n, (size_t)0);
+    for (const auto& pair : m_pairs) {
+        size_t a = findRoot(pair.first);
+        size_t b = findRoot(pair.second);
+        if (a != b) m_parent[std::max(a, b)] = std::min(a, b);
+    }
+
+    m_keep.assign(n, 1);
+    size_t removed = 0;
+    for (size_t i = 0; i < n; ++i) {
+        size_t root = findRoot(i);
+        if (root == i) continue;
+
+        // the root always has the lower index, so it absorbs in index order
+        float mr = bodies.mass[root];
+        float mi = bodies.mass[i];
+        float m = mr + mi;
+        float wr = m > 0.0f ? mr / m : 0.5f;
+        float wi = 1.0f - wr;
+        bodies.x[root] = bodies.x[root] * wr + bodies.x[i] * wi;
+        bodies.y[root] = bodies.y[root] * wr + bodies.y[i] * wi;
+        bodies.z[root] = bodies.z[root] * wr + bodies.z[i] * wi;
+        bodies.vx[root] = bodies.vx[root] * wr + bodies.vx[i] * wi;
+        bodies.vy[root] = bodies.vy[root] * wr + bodies.vy[i] * wi;
+        bodies.vz[root] = bodies.vz[root] * wr + bodies.vz[i] * wi;
+        if (bodies.precise()) {
+            double dr = m > 0.0f ? (double)mr / ((double)mr + mi) : 0.5;
+            double di = 1.0 - dr;
+            AlignedVector<double>* state[] = { &bodies.px, &bodies.py, &bodies.pz, &bodies.pvx, &bodies.pvy, &bodies.pvz };
+            AlignedVector<float>* mirror[] = { &bodies.x, &bodies.y, &bodies.z, &bodies.vx, &bodies.vy, &bodies.vz };
+            for (int a = 0; a < 6; ++a) {
+                double& value = (*state[a])[root];
+                value = value * dr + (*state[a])[i] * di;
+                (*mirror[a])[root] = (float)value;
+            }
+        }
+        bodies.mass[root] = m;
+        float rr = bodies.radius[root];
+        float ri = bodies.radius[i];
+        bodies.radius[root] = std::cbrt(rr * rr * rr + ri * ri * ri);
+        if (mi > mr) bodies.color[root] = bodies.color[i];
+
+        m_keep[i] = 0;
+        ++removed;
+    }
+    bodies.compact(m_keep);
+    return removed;
+}
+
+size_t CollisionSystem::resolve(BodySystem& bodies) {
+    PROFILE_SCOPE("collisions");
+    if (bodies.count < 2) return 0;
+    m_arena.reset();
+    {
+        PROFILE_SCOPE("collision broad phase");
+        chooseCellSize(bodies);
+        sortByBucket(bodies);
+    }
+    findOverlaps(bodies);
+    if (m_pairs.empty()) return 0;
+
+    size_t removed = mergeGroups(bodies);
+    // indices have shifted, the next call sorts from scratch
+    m_sortedCount = 0;
+    return removed;
+}
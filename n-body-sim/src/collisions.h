@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "body_system.h"
+#include "frame_arena.h"
+
+// merges overlapping bodies (|pi - pj| < ri + rj) into one that keeps the
+// total mass, momentum and volume. the broad phase is a spatial hash of
+// body centres that is kept sorted between calls, so a step where few
+// bodies change cell costs O(N) plus a sort of the bodies that moved
+class CollisionSystem {
+public:
+    // detects and merges all overlaps, compacting bodies in place. returns
+    // the number of bodies removed; when it is nonzero, indices have shifted
+    // and integrators/position histories must be invalidated
+    size_t resolve(BodySystem& bodies);
+
+    // candidate pairs from the last broad phase, before the sphere test
+    size_t candidatePairs() const { return m_candidates; }
+
+private:
+    void chooseCellSize(const BodySystem& bodies);
+    std::uint32_t bucketOf(float x, float y, float z) const;
+    void sortByBucket(const BodySystem& bodies);
+    void findOverlaps(const BodySystem& bodies);
+    void testBucket(const BodySystem& bodies, size_t i, std::uint32_t bucket);
+    void testPair(const BodySystem& bodies, size_t i, size_t j);
+    size_t mergeGroups(BodySystem& bodies);
+    size_t findRoot(size_t i);
+
+    float m_cellSize = 0.0f;
+    float m_largeRadius = 0.0f;  // bodies above this query every cell they can reach
+    std::uint32_t m_bucketMask = 0;
+    size_t m_sortedCount = 0;    // 0 forces a full re-sort
+
+    // kept between calls for the incremental sort
+    std::vector<std::uint32_t> m_bucket;  // per body, as of the last sort
+    std::vector<std::uint32_t> m_order;   // body indices sorted by bucket
+
+    // per-call scratch, carved from m_arena
+    FrameArena m_arena;
+    std::uint32_t* m_bucketStart = nullptr;  // m_order range of each bucket
+    std::uint64_t* m_occupied = nullptr;     // one bit per bucket, small enough to stay cached
+    std::uint32_t* m_large = nullptr;
+    size_t m_largeCount = 0;
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> m_pairs;
+    std::vector<std::uint8_t> m_keep;
+    size_t* m_parent = nullptr;
+    size_t m_candidates = 0;
+};
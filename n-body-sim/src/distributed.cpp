@@ -0,0 +1,562 @@
+#include "distributed.h"
+#include <iostream>
+
+#ifdef NBODY_MPI
+#include <mpi.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <vector>
+#include "alloc_counter.h"
+#include "barnes_hut.h"
+#include "gravity_kernel.h"
+#include "headless.h"
+#include "integrator.h"
+#include "profiler.h"
+#include "scenario.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+
+// bisection steps per ORB cut, each one allreduce of the left weight of every group
+#define ORB_BISECTION_STEPS 32
+
+// a body moving between ranks. doubles so mixed and double precision state
+// survives the move, and accelerations so leapfrog's closing kick stays valid
+struct BodyRecord {
+    double x, y, z, vx, vy, vz, ax, ay, az;
+    float mass, radius;
+    std::uint32_t color;
+    std::uint64_t id;  // index in the initial conditions, orders gathered outputs
+};
+
+// remote body, or a whole remote octree cell, of a locally essential tree
+struct PointMass {
+    float x, y, z, mass;
+};
+
+// empty while lo > hi
+struct Bounds {
+    float lo[3], hi[3];
+};
+
+template <typename T>
+static MPI_Datatype contiguousType() {
+    static MPI_Datatype type = [] {
+        MPI_Datatype t;
+        MPI_Type_contiguous((int)sizeof(T), MPI_BYTE, &t);
+        MPI_Type_commit(&t);
+        return t;
+    }();
+    return type;
+}
+
+// keeps capacity ahead of the largest size seen, so a rank whose share
+// slowly grows only rarely reaches the heap
+template <typename T>
+static void resizePooled(std::vector<T>& v, size_t n) {
+    if (v.capacity() < n) v.reserve(n + n / 2);
+    v.resize(n);
+}
+
+// the same for a body system
+static void resizePooled(BodySystem& bodies, size_t n) {
+    if (bodies.x.capacity() < paddedSize(n)) bodies.reserve(n + n / 2);
+    bodies.resize(n);
+}
+
+// exclusive prefix sum of counts into offsets, returns the total
+static int prefixOffsets(const std::vector<int>& counts, std::vector<int>& offsets) {
+    int total = 0;
+    for (size_t r = 0; r < counts.size(); ++r) {
+        offsets[r] = total;
+        total += counts[r];
+    }
+    return total;
+}
+
+static Bounds boundsOf(const BodySystem& bodies) {
+    const float inf = std::numeric_limits<float>::infinity();
+    Bounds b = { { inf, inf, inf }, { -inf, -inf, -inf } };
+    for (size_t i = 0; i < bodies.count; ++i) {
+        const float p[3] = { bodies.x[i], bodies.y[i], bodies.z[i] };
+        for (int a = 0; a < 3; ++a) {
+            b.lo[a] = std::min(b.lo[a], p[a]);
+            b.hi[a] = std::max(b.hi[a], p[a]);
+        }
+    }
+    return b;
+}
+
+static BodyRecord recordOf(const BodySystem& bodies, size_t i, std::uint64_t id) {
+    Vec3d p = bodies.precisePosition(i), v = bodies.preciseVelocity(i), a = bodies.preciseAcceleration(i);
+    return { p.x, p.y, p.z, v.x, v.y, v.z, a.x, a.y, a.z, bodies.mass[i], bodies.radius[i], bodies.color[i], id };
+}
+
+static void storeRecord(BodySystem& bodies, size_t i, const BodyRecord& r) {
+    bodies.set(i, ObjectD{ { r.x, r.y, r.z }, { r.vx, r.vy, r.vz }, r.radius, r.mass, r.color });
+    bodies.setAcceleration(i, { r.ax, r.ay, r.az });
+}
+
+// force engine of one rank: imports the locally essential trees of all other
+// ranks and runs the configured engine on the local bodies plus those
+class DistributedEngine : public ForceEngine {
+public:
+    DistributedEngine(const ForceSettings& settings, ThreadPool* pool, int rank, int ranks)
+        : m_inner(createForceEngine(settings, pool)),
+          // all-pairs stays exact by exporting every remote body
+          m_exportTheta(settings.mode == ForceMode::AllPairs ? 0.0f : settings.theta),
+          m_rank(rank), m_ranks(ranks),
+          m_bounds(ranks), m_sendCounts(ranks), m_sendOffsets(ranks), m_recvCounts(ranks), m_recvOffsets(ranks) {}
+
+    const char* name() const override { return m_inner->name(); }
+    void computeAccelerations(BodySystem& bodies) override;
+
+    // wall time of the local force evaluations so far, the load measure of rebalancing
+    double forceSeconds() const { return m_forceSeconds; }
+    // remote bodies and cells received, summed over all evaluations
+    std::uint64_t imported() const { return m_imported; }
+    std::uint64_t evaluations() const { return m_evaluations; }
+
+private:
+    void exportTo(const BodySystem& bodies, const Bounds& box);
+
+    std::unique_ptr<ForceEngine> m_inner;
+    float m_exportTheta;
+    int m_rank, m_ranks;
+
+    Octree m_tree;  // of the local bodies, walked once per remote rank
+    std::vector<int> m_stack;
+    std::vector<Bounds> m_bounds;  // every rank's bodies
+    std::vector<PointMass> m_send, m_received;
+    std::vector<int> m_sendCounts, m_sendOffsets, m_recvCounts, m_recvOffsets;
+
+    BodySystem m_work;  // the local bodies followed by the imported ones
+    std::vector<std::uint32_t> m_active;
+    double m_forceSeconds = 0.0;
+    std::uint64_t m_imported = 0;
+    std::uint64_t m_evaluations = 0;
+};
+
+// cells the nearest point of the box accepts are accepted by all of it; the
+// rest are opened down to their leaves, which go out as the bodies themselves
+void DistributedEngine::exportTo(const BodySystem& bodies, const Bounds& box) {
+    const std::vector<OctreeNode>& nodes = m_tree.nodes();
+    if (nodes.empty()) return;
+    m_stack.clear();
+    m_stack.push_back(0);
+    while (!m_stack.empty()) {
+        const OctreeNode& node = nodes[m_stack.back()];
+        m_stack.pop_back();
+        if (node.mass == 0.0f) continue;
+
+        bool accept = node.firstChild < 0;
+        if (!accept) {
+            const float c[3] = { node.massCenter.x, node.massCenter.y, node.massCenter.z };
+            float distSq = 0.0f;
+            for (int a = 0; a < 3; ++a) {
+                float d = std::max(box.lo[a] - c[a], std::max(0.0f, c[a] - box.hi[a]));
+                distSq += d * d;
+            }
+            accept = distSq > node.openRadiusSq;
+        }
+        if (accept && node.body >= 0) {
+            // exact, where massCenter went through (p * m) / m in float
+            size_t i = (size_t)node.body;
+            m_send.push_back({ bodies.x[i], bodies.y[i], bodies.z[i], bodies.mass[i] });
+        } else if (accept) {
+            m_send.push_back({ node.massCenter.x, node.massCenter.y, node.massCenter.z, node.mass });
+        } else {
+            for (int c = 0; c < 8; ++c) m_stack.push_back(node.firstChild + c);
+        }
+    }
+}
+
+void DistributedEngine::computeAccelerations(BodySystem& bodies) {
+    {
+        PROFILE_SCOPE("mpi tree exchange");
+        Bounds local = boundsOf(bodies);
+        MPI_Allgather(&local, 6, MPI_FLOAT, m_bounds.data(), 6, MPI_FLOAT, MPI_COMM_WORLD);
+
+        m_tree.build(bodies, m_exportTheta);
+        m_send.clear();
+        for (int r = 0; r < m_ranks; ++r) {
+            m_sendOffsets[r] = (int)m_send.size();
+            const Bounds& box = m_bounds[r];
+            if (r != m_rank && box.lo[0] <= box.hi[0]) exportTo(bodies, box);
+            m_sendCounts[r] = (int)m_send.size() - m_sendOffsets[r];
+        }
+        MPI_Alltoall(m_sendCounts.data(), 1, MPI_INT, m_recvCounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+        resizePooled(m_received, (size_t)prefixOffsets(m_recvCounts, m_recvOffsets));
+        MPI_Alltoallv(m_send.data(), m_sendCounts.data(), m_sendOffsets.data(), contiguousType<PointMass>(),
+                      m_received.data(), m_recvCounts.data(), m_recvOffsets.data(), contiguousType<PointMass>(),
+                      MPI_COMM_WORLD);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t n = bodies.count;
+    resizePooled(m_work, n + m_received.size());
+    std::copy(bodies.x.begin(), bodies.x.begin() + n, m_work.x.begin());
+    std::copy(bodies.y.begin(), bodies.y.begin() + n, m_work.y.begin());
+    std::copy(bodies.z.begin(), bodies.z.begin() + n, m_work.z.begin());
+    std::copy(bodies.mass.begin(), bodies.mass.begin() + n, m_work.mass.begin());
+    for (size_t k = 0; k < m_received.size(); ++k) {
+        m_work.x[n + k] = m_received[k].x;
+        m_work.y[n + k] = m_received[k].y;
+        m_work.z[n + k] = m_received[k].z;
+        m_work.mass[n + k] = m_received[k].mass;
+    }
+    if (m_active.size() != n) {
+        resizePooled(m_active, n);
+        std::iota(m_active.begin(), m_active.end(), 0u);
+    }
+    m_inner->computeAccelerations(m_work, m_active);
+
+    std::copy(m_work.ax.begin(), m_work.ax.begin() + n, bodies.ax.begin());
+    std::copy(m_work.ay.begin(), m_work.ay.begin() + n, bodies.ay.begin());
+    std::copy(m_work.az.begin(), m_work.az.begin() + n, bodies.az.begin());
+    for (size_t i = n; i < bodies.paddedCount(); ++i) bodies.ax[i] = bodies.ay[i] = bodies.az[i] = 0.0f;
+    m_forceSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m_imported += m_received.size();
+    ++m_evaluations;
+}
+
+// orthogonal recursive bisection over the ranks. each cut splits a rank group
+// along the longest axis of its bodies so that both halves carry weight in
+// proportion to their rank counts; every rank builds the same cut tree from
+// allreduced sums, all groups of a level at once
+class Partition {
+public:
+    Partition(int rank, int ranks) : m_rank(rank), m_ranks(ranks), m_counts(ranks), m_offsets(ranks), m_recvCounts(ranks), m_recvOffsets(ranks) {}
+
+    // moves every body to the rank owning its part; weight is the cost of one local body
+    void rebalance(BodySystem& bodies, std::vector<std::uint64_t>& ids, double weight);
+
+private:
+    struct Node {
+        int firstRank, endRank;
+        int children;  // index of the lower half, the upper one follows; -1 for single ranks
+    };
+
+    void bisect(const BodySystem& bodies, double weight);
+
+    int m_rank, m_ranks;
+    std::vector<Node> m_nodes;
+    std::vector<int> m_bodyNode;  // node of every local body
+    std::vector<int> m_open, m_slot;
+    std::vector<float> m_extent, m_low, m_high;
+    std::vector<int> m_axis;
+    std::vector<double> m_target, m_left;
+
+    std::vector<BodyRecord> m_outgoing, m_incoming;
+    std::vector<int> m_counts, m_offsets, m_recvCounts, m_recvOffsets;
+};
+
+void Partition::bisect(const BodySystem& bodies, double weight) {
+    const float* coordinate[3] = { bodies.x.data(), bodies.y.data(), bodies.z.data() };
+    m_nodes.clear();
+    m_nodes.push_back({ 0, m_ranks, -1 });
+    resizePooled(m_bodyNode, bodies.count);
+    std::fill(m_bodyNode.begin(), m_bodyNode.end(), 0);
+    m_open.assign(m_ranks > 1 ? 1 : 0, 0);
+
+    while (!m_open.empty()) {
+        size_t groups = m_open.size();
+        m_slot.assign(m_nodes.size(), -1);
+        for (size_t k = 0; k < groups; ++k) m_slot[m_open[k]] = (int)k;
+
+        // bounds of every group, the upper ones negated so one MPI_MIN does both
+        m_extent.assign(6 * groups, std::numeric_limits<float>::infinity());
+        m_left.assign(groups, 0.0);
+        for (size_t i = 0; i < bodies.count; ++i) {
+            int k = m_slot[m_bodyNode[i]];
+            if (k < 0) continue;
+            for (int a = 0; a < 3; ++a) {
+                m_extent[6 * k + a] = std::min(m_extent[6 * k + a], coordinate[a][i]);
+                m_extent[6 * k + 3 + a] = std::min(m_extent[6 * k + 3 + a], -coordinate[a][i]);
+            }
+            m_left[k] += weight;
+        }
+        MPI_Allreduce(MPI_IN_PLACE, m_extent.data(), (int)m_extent.size(), MPI_FLOAT, MPI_MIN, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, m_left.data(), (int)groups, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+        m_axis.resize(groups);
+        m_low.resize(groups);
+        m_high.resize(groups);
+        m_target.resize(groups);
+        for (size_t k = 0; k < groups; ++k) {
+            const float* lo = &m_extent[6 * k];
+            const float* negatedHi = &m_extent[6 * k + 3];
+            int axis = 0;
+            for (int a = 1; a < 3; ++a) {
+                if (-negatedHi[a] - lo[a] > -negatedHi[axis] - lo[axis]) axis = a;
+            }
+            m_axis[k] = axis;
+            m_low[k] = lo[axis] <= -negatedHi[axis] ? lo[axis] : 0.0f;
+            m_high[k] = lo[axis] <= -negatedHi[axis] ? -negatedHi[axis] : 0.0f;
+            const Node& node = m_nodes[m_open[k]];
+            int lower = (node.endRank - node.firstRank) / 2;
+            m_target[k] = m_left[k] * lower / (node.endRank - node.firstRank);
+        }
+
+        // bodies below the cut go to the lower half; keeps left(low) < target <= left(high)
+        for (int step = 0; step < ORB_BISECTION_STEPS; ++step) {
+            m_left.assign(groups, 0.0);
+            for (size_t i = 0; i < bodies.count; ++i) {
+                int k = m_slot[m_bodyNode[i]];
+                if (k < 0) continue;
+                if (coordinate[m_axis[k]][i] < 0.5f * (m_low[k] + m_high[k])) m_left[k] += weight;
+            }
+            MPI_Allreduce(MPI_IN_PLACE, m_left.data(), (int)groups, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+            for (size_t k = 0; k < groups; ++k) {
+                float cut = 0.5f * (m_low[k] + m_high[k]);
+                if (m_left[k] < m_target[k]) {
+                    m_low[k] = cut;
+                } else {
+                    m_high[k] = cut;
+                }
+            }
+        }
+
+        for (size_t k = 0; k < groups; ++k) {
+            int first = m_nodes[m_open[k]].firstRank, end = m_nodes[m_open[k]].endRank;
+            int middle = first + (end - first) / 2;
+            m_nodes[m_open[k]].children = (int)m_nodes.size();
+            m_nodes.push_back({ first, middle, -1 });
+            m_nodes.push_back({ middle, end, -1 });
+        }
+        for (size_t i = 0; i < bodies.count; ++i) {
+            int k = m_slot[m_bodyNode[i]];
+            if (k < 0) continue;
+            bool upper = coordinate[m_axis[k]][i] >= m_high[k];
+            m_bodyNode[i] = m_nodes[m_open[k]].children + (upper ? 1 : 0);
+        }
+        m_open.clear();
+        for (size_t c = m_slot.size(); c < m_nodes.size(); ++c) {
+            if (m_nodes[c].endRank - m_nodes[c].firstRank > 1) m_open.push_back((int)c);
+        }
+    }
+}
+
+void Partition::rebalance(BodySystem& bodies, std::vector<std::uint64_t>& ids, double weight) {
+    PROFILE_SCOPE("mpi rebalance");
+    bisect(bodies, weight);
+
+    // counting sort of the outgoing bodies by destination
+    std::fill(m_counts.begin(), m_counts.end(), 0);
+    for (size_t i = 0; i < bodies.count; ++i) ++m_counts[m_nodes[m_bodyNode[i]].firstRank];
+    resizePooled(m_outgoing, (size_t)prefixOffsets(m_counts, m_offsets));
+    for (size_t i = 0; i < bodies.count; ++i) {
+        m_outgoing[m_offsets[m_nodes[m_bodyNode[i]].firstRank]++] = recordOf(bodies, i, ids[i]);
+    }
+    prefixOffsets(m_counts, m_offsets);
+
+    MPI_Alltoall(m_counts.data(), 1, MPI_INT, m_recvCounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    resizePooled(m_incoming, (size_t)prefixOffsets(m_recvCounts, m_recvOffsets));
+    MPI_Alltoallv(m_outgoing.data(), m_counts.data(), m_offsets.data(), contiguousType<BodyRecord>(),
+                  m_incoming.data(), m_recvCounts.data(), m_recvOffsets.data(), contiguousType<BodyRecord>(),
+                  MPI_COMM_WORLD);
+
+    resizePooled(bodies, m_incoming.size());
+    resizePooled(ids, m_incoming.size());
+    for (size_t i = 0; i < m_incoming.size(); ++i) {
+        storeRecord(bodies, i, m_incoming[i]);
+        ids[i] = m_incoming[i].id;
+    }
+}
+
+// rank 0 deals out contiguous slices of the initial conditions; the first
+// rebalance then moves them into their domains
+static void scatterBodies(const BodySystem& all, BodySystem& local, std::vector<std::uint64_t>& ids,
+                          std::vector<BodyRecord>& records, int rank, int ranks) {
+    std::uint64_t total = all.count;
+    MPI_Bcast(&total, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    std::vector<int> counts(ranks), offsets(ranks);
+    for (int r = 0; r < ranks; ++r) counts[r] = (int)(total * (r + 1) / ranks - total * r / ranks);
+    prefixOffsets(counts, offsets);
+
+    if (rank == 0) {
+        records.resize(all.count);
+        for (size_t i = 0; i < all.count; ++i) records[i] = recordOf(all, i, i);
+    }
+    std::vector<BodyRecord> mine(counts[rank]);
+    MPI_Scatterv(records.data(), counts.data(), offsets.data(), contiguousType<BodyRecord>(),
+                 mine.data(), counts[rank], contiguousType<BodyRecord>(), 0, MPI_COMM_WORLD);
+    // headroom for the shifts of later rebalances
+    resizePooled(local, mine.size());
+    resizePooled(ids, mine.size());
+    for (size_t i = 0; i < mine.size(); ++i) {
+        storeRecord(local, i, mine[i]);
+        ids[i] = mine[i].id;
+    }
+}
+
+// collects every body on rank 0, in initial condition order, for outputs
+static void gatherBodies(const BodySystem& local, const std::vector<std::uint64_t>& ids, BodySystem& all,
+                         std::vector<BodyRecord>& send, std::vector<BodyRecord>& received,
+                         std::vector<int>& counts, std::vector<int>& offsets, int rank) {
+    PROFILE_SCOPE("mpi gather");
+    resizePooled(send, local.count);
+    for (size_t i = 0; i < local.count; ++i) send[i] = recordOf(local, i, ids[i]);
+    int count = (int)local.count;
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0) resizePooled(received, (size_t)prefixOffsets(counts, offsets));
+    MPI_Gatherv(send.data(), count, contiguousType<BodyRecord>(), received.data(), counts.data(), offsets.data(),
+                contiguousType<BodyRecord>(), 0, MPI_COMM_WORLD);
+    if (rank != 0) return;
+    all.resize(received.size());
+    for (const BodyRecord& r : received) storeRecord(all, (size_t)r.id, r);
+}
+
+static int runRanks(const SimOptions& options, int rank, int ranks) {
+    bool root = rank == 0;
+    if (options.integrator == IntegratorKind::Block) {
+        // block steps evaluate different body subsets per rank, and so would not stay in lockstep
+        if (root) std::cerr << "--mpi runs the euler, leapfrog and yoshida4 integrators\n";
+        return 1;
+    }
+    if (root && options.backend == Backend::Gpu) std::cerr << "--backend=gpu has no effect with --mpi\n";
+    if (root && options.collisions) std::cerr << "--collisions has no effect with --mpi\n";
+
+    ThreadPool pool(options.threads);
+    BodySystem all;  // rank 0: the initial conditions, later the gathered outputs
+    double time = 0.0;
+    long long firstStep = 0;
+    int ok = 1;
+    if (root) {
+        all.setPrecision(options.precision);
+        auto setupStart = std::chrono::steady_clock::now();
+        if (options.inputPath.empty()) {
+            all = generateScenario(options.scenario, &pool);
+        } else if (!loadBodies(options.inputPath, all, time, firstStep)) {
+            ok = 0;
+        }
+        all.setPrecision(options.precision);
+        double setupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setupStart).count();
+        if (ok) {
+            std::cout << "initial conditions from "
+                      << (options.inputPath.empty() ? scenarioName(options.scenario.kind) : options.inputPath.c_str())
+                      << " in " << setupMs << " ms" << std::endl;
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) return 1;
+    MPI_Bcast(&time, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&firstStep, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+
+    BodySystem bodies;
+    bodies.setPrecision(options.precision);
+    std::vector<std::uint64_t> ids;
+    std::vector<BodyRecord> sendRecords, receivedRecords;
+    std::vector<int> counts(ranks), offsets(ranks);
+    scatterBodies(all, bodies, ids, receivedRecords, rank, ranks);
+    std::uint64_t totalCount = all.count;
+    MPI_Bcast(&totalCount, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    DistributedEngine engine(options.force, &pool, rank, ranks);
+    Partition partition(rank, ranks);
+    partition.rebalance(bodies, ids, 1.0);
+    Integrator integrator(options.integrator);
+
+    SnapshotWriter snapshots;
+    if (root && !options.snapshotPath.empty()) {
+        // a series starts with the initial state; an appended one already ends with it
+        // when the run continues from its last frame
+        ok = snapshots.open(options.snapshotPath, options.appendSnapshot)
+            && (snapshots.endsAtStep(firstStep) || snapshots.writeFrame(all, time, firstStep));
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) return 1;
+
+    if (root) {
+        std::cout << totalCount << " bodies on " << ranks << " ranks, " << options.steps << " steps of " << options.dt << " s, "
+                  << engine.name() << " (" << gravityKernelName() << " kernel, " << pool.threadCount() << " threads per rank), "
+                  << integratorName(options.integrator) << ", " << precisionName(bodies.precision()) << " precision" << std::endl;
+    }
+
+    long long lastStep = firstStep + options.steps;
+    // as in runHeadless. a rebalance that gives a rank half again as many bodies
+    // as it ever had still grows its buffers
+    const long long warmupSteps = 8;
+    std::uint64_t steadyAllocations = 0;
+    long long rebalances = 0;
+    double balancedSeconds = 0.0;  // engine.forceSeconds() at the last rebalance
+    auto start = std::chrono::steady_clock::now();
+    for (long long step = firstStep + 1; step <= lastStep; ++step) {
+        std::uint64_t allocationsBefore = heapAllocationCount();
+        integrator.step(bodies, engine, options.dt);
+        time += options.dt;
+        if (options.rebalanceEvery > 0 && (step - firstStep) % options.rebalanceEvery == 0 && step != lastStep) {
+            double seconds = engine.forceSeconds() - balancedSeconds;
+            balancedSeconds = engine.forceSeconds();
+            partition.rebalance(bodies, ids, bodies.count ? seconds / bodies.count : 0.0);
+            ++rebalances;
+        }
+        if (step - firstStep > warmupSteps) steadyAllocations += heapAllocationCount() - allocationsBefore;
+
+        bool output = step == lastStep || (options.outputEvery > 0 && (step - firstStep) % options.outputEvery == 0);
+        if (!output || (options.outputPath.empty() && options.snapshotPath.empty())) continue;
+        gatherBodies(bodies, ids, all, sendRecords, receivedRecords, counts, offsets, rank);
+        if (root) {
+            if (!options.outputPath.empty() && !writeBodiesCsv(outputPath(options.outputPath, step), all)) ok = 0;
+            if (ok && !options.snapshotPath.empty() && !snapshots.writeFrame(all, time, step)) {
+                std::cerr << "cannot append to " << options.snapshotPath << "\n";
+                ok = 0;
+            }
+        }
+        MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (!ok) return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // force time of the slowest rank against the mean shows what rebalancing left over
+    double forceSeconds = engine.forceSeconds(), maxForceSeconds = 0.0, sumForceSeconds = 0.0;
+    MPI_Reduce(&forceSeconds, &maxForceSeconds, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&forceSeconds, &sumForceSeconds, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    std::uint64_t local[3] = { integrator.forceEvaluations(), engine.imported(), engine.evaluations() };
+    std::uint64_t summed[3] = { 0, 0, 0 };
+    MPI_Reduce(local, summed, 3, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+    std::uint64_t maxAllocations = 0;
+    MPI_Reduce(&steadyAllocations, &maxAllocations, 1, MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (!root) return options.checkAllocs && steadyAllocations > 0 ? 1 : 0;
+
+    std::cout << "simulated " << options.steps * (double)options.dt << " s in " << seconds << " s wall ("
+              << (seconds > 0.0 ? options.steps / seconds : 0.0) << " steps/s)" << std::endl;
+    std::cout << summed[0] << " body force evaluations, " << summed[1] / (double)std::max<std::uint64_t>(1, summed[2])
+              << " remote bodies and cells imported per rank and evaluation" << std::endl;
+    std::cout << rebalances << " rebalances, slowest rank spent " << maxForceSeconds << " s on forces, "
+              << (sumForceSeconds > 0.0 ? maxForceSeconds * ranks / sumForceSeconds : 1.0) << "x the mean" << std::endl;
+
+    if (options.checkAllocs) {
+        long long checked = std::max(0LL, options.steps - warmupSteps);
+        std::cout << maxAllocations << " heap allocations in " << checked << " steady-state steps on the busiest rank" << std::endl;
+    }
+
+    if (PROFILING_ENABLED) Profiler::instance().printSummary(std::cout);
+    if (!options.profileTracePath.empty() && !Profiler::instance().writeChromeTrace(options.profileTracePath)) {
+        std::cerr << "cannot write " << options.profileTracePath << "\n";
+        return 1;
+    }
+    return options.checkAllocs && maxAllocations > 0 ? 1 : 0;
+}
+
+int runDistributed(int argc, char* argv[], const SimOptions& options) {
+    MPI_Init(&argc, &argv);
+    int rank = 0, ranks = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    int code = runRanks(options, rank, ranks);
+    MPI_Finalize();
+    return code;
+}
+
+#else
+
+int runDistributed(int, char*[], const SimOptions&) {
+    std::cerr << "built without the mpi mode (NBODY_ENABLE_MPI=OFF)\n";
+    return 1;
+}
+
+#endif
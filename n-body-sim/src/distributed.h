@@ -0,0 +1,12 @@
+#pragma once
+#include "options.h"
+
+// headless run spread over the ranks of an MPI job (--mpi, NBODY_ENABLE_MPI=ON).
+// rank 0 loads the initial conditions and scatters them; every rank then owns
+// the bodies of one box of an orthogonal recursive bisection, weighted by the
+// measured force time so slow ranks get fewer bodies, and repartitions every
+// --rebalance-every steps. before each force evaluation the ranks swap their
+// locally essential trees: the bodies and Barnes-Hut cells each other rank
+// needs, given its bounding box. only outputs are gathered on rank 0.
+// returns the process exit code
+int runDistributed(int argc, char* argv[], const SimOptions& options);
@@ -0,0 +1,571 @@
+#include "fmm.h"
+#include <algorithm>
+#include <cmath>
+#include "profiler.h"
+#include "thread_pool.h"
+
+// notation: multi-indices n = (i, j, k) with |n| = i + j + k <= order, monomials
+// v^n = vx^i vy^j vz^k and C(n, m) the product of the per-axis binomials.
+//   multipole  Q_a = sum m v^a, v = body - source center
+//   local      l_b, with phi(target center + u) = -G sum l_b u^b
+//   1/|R + h| = sum t_n(R) h^n, t_n the Taylor coefficients of 1/r at R
+//   M2L        l_b += sum_a (-1)^|a| C(a + b, b) Q_a t_{a+b}(target - source)
+//   M2M        Q_a(parent) += sum_{k<=a} C(a, k) Q_k(child) d^(a-k)
+//   L2L        l_g(child) += sum_{b>=g} C(b, g) l_b(parent) d^(b-g)
+
+// keeps capacity ahead of the largest size seen, as Octree::build does, so a
+// slowly growing tree only rarely reaches the heap
+template <typename T>
+static void resizePooled(std::vector<T>& v, size_t n) {
+    if (v.capacity() < n) v.reserve(n + n / 2);
+    v.resize(n);
+}
+
+// spreads the low 21 bits of v to every third bit
+static std::uint64_t spreadBits(std::uint64_t v) {
+    v &= 0x1FFFFF;
+    v = (v | v << 32) & 0x1F00000000FFFFull;
+    v = (v | v << 16) & 0x1F0000FF0000FFull;
+    v = (v | v << 8) & 0x100F00F00F00F00Full;
+    v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+FmmEngine::FmmEngine(int order, float theta, ThreadPool* pool)
+    : m_order(std::min(FMM_MAX_ORDER, std::max(1, order))), m_theta(theta), m_pool(pool),
+      m_scratch(pool ? pool->threadCount() : 1) {
+    buildTables();
+    m_levelStart.reserve(FMM_MAX_DEPTH + 2);
+}
+
+template <typename Fn>
+void FmmEngine::forEach(size_t count, size_t grain, Fn&& fn) {
+    if (m_pool) {
+        m_pool->parallelFor(0, count, chunkSize(count, m_pool->threadCount(), grain), fn);
+    } else if (count) {
+        fn(0, count);
+    }
+}
+
+void FmmEngine::buildTables() {
+    const int p = m_order;
+    std::vector<int> index((p + 1) * (p + 1) * (p + 1), -1);
+    std::vector<int> exponent;
+    auto at = [&](int i, int j, int k) -> int {
+        if (i < 0 || j < 0 || k < 0 || i + j + k > p) return -1;
+        return index[(i * (p + 1) + j) * (p + 1) + k];
+    };
+    // terms ordered by degree, so every term comes after the ones it is built from
+    for (int d = 0; d <= p; ++d) {
+        for (int i = d; i >= 0; --i) {
+            for (int j = d - i; j >= 0; --j) {
+                index[(i * (p + 1) + j) * (p + 1) + (d - i - j)] = (int)exponent.size() / 3;
+                exponent.insert(exponent.end(), { i, j, d - i - j });
+            }
+        }
+    }
+    m_terms = exponent.size() / 3;
+
+    m_term.assign(m_terms, Term{});
+    for (size_t t = 0; t < m_terms; ++t) {
+        const int* e = &exponent[3 * t];
+        Term& term = m_term[t];
+        term.degree = e[0] + e[1] + e[2];
+        for (int a = 0; a < 3; ++a) {
+            int lower1[3] = { e[0], e[1], e[2] };
+            int lower2[3] = { e[0], e[1], e[2] };
+            lower1[a] -= 1;
+            lower2[a] -= 2;
+            term.less1[a] = (std::int16_t)at(lower1[0], lower1[1], lower1[2]);
+            term.less2[a] = (std::int16_t)at(lower2[0], lower2[1], lower2[2]);
+        }
+        for (int a = 0; a < 3; ++a) {
+            if (term.less1[a] < 0) term.less1[a] = (std::int16_t)m_terms;
+            if (term.less2[a] < 0) term.less2[a] = (std::int16_t)m_terms;
+        }
+        term.first = t ? -(2.0 * term.degree - 1) / term.degree : 0.0;
+        term.second = t ? -(term.degree - 1.0) / term.degree : 0.0;
+        term.from = 0;
+        term.axis = 0;
+        for (int a = 0; a < 3 && t > 0; ++a) {
+            if (e[a] > 0) {
+                term.from = (std::uint16_t)term.less1[a];
+                term.axis = (std::uint8_t)a;
+                break;
+            }
+        }
+    }
+
+    double binomial[FMM_MAX_ORDER + 1][FMM_MAX_ORDER + 1] = {};
+    for (int n = 0; n <= p; ++n) {
+        binomial[n][0] = 1.0;
+        for (int k = 1; k <= n; ++k) binomial[n][k] = binomial[n - 1][k - 1] + (k <= n - 1 ? binomial[n - 1][k] : 0.0);
+    }
+
+    m_multipoleShift.clear();
+    m_localShift.clear();
+    m_gradient.clear();
+    for (size_t a = 0; a < m_terms; ++a) {
+        const int* ea = &exponent[3 * a];
+        for (size_t b = 0; b < m_terms; ++b) {
+            const int* eb = &exponent[3 * b];
+            // b <= a componentwise: M2M from b into a, L2L from a into b
+            if (eb[0] <= ea[0] && eb[1] <= ea[1] && eb[2] <= ea[2]) {
+                double c = binomial[ea[0]][eb[0]] * binomial[ea[1]][eb[1]] * binomial[ea[2]][eb[2]];
+                std::uint16_t power = (std::uint16_t)at(ea[0] - eb[0], ea[1] - eb[1], ea[2] - eb[2]);
+                m_multipoleShift.push_back({ (std::uint16_t)a, (std::uint16_t)b, power, c });
+                m_localShift.push_back({ (std::uint16_t)b, (std::uint16_t)a, power, c });
+            }
+        }
+        // d(u^a)/du_k = a_k u^(a - e_k)
+        for (int k = 0; k < 3; ++k) {
+            if (ea[k] == 0) continue;
+            m_gradient.push_back({ (std::uint16_t)k, (std::uint16_t)a, (std::uint16_t)m_term[a].less1[k], (double)ea[k] });
+        }
+    }
+    m_factorial.resize(m_terms);
+    m_scale.resize(m_terms);
+    m_sumStart.clear();
+    m_sumIndex.clear();
+    for (size_t t = 0; t < m_terms; ++t) {
+        const int* e = &exponent[3 * t];
+        double f = 1.0;
+        for (int a = 0; a < 3; ++a) {
+            for (int k = 2; k <= e[a]; ++k) f *= k;
+        }
+        m_factorial[t] = f;
+        m_scale[t] = (m_term[t].degree & 1 ? -1.0 : 1.0) / f;
+
+        // terms are ordered by degree, so the a with |a| <= order - |b| are a prefix
+        m_sumStart.push_back((std::uint32_t)m_sumIndex.size());
+        for (size_t a = 0; a < m_terms && m_term[a].degree + m_term[t].degree <= p; ++a) {
+            const int* ea = &exponent[3 * a];
+            m_sumIndex.push_back((std::uint16_t)at(ea[0] + e[0], ea[1] + e[1], ea[2] + e[2]));
+        }
+    }
+    m_sumStart.push_back((std::uint32_t)m_sumIndex.size());
+}
+
+void FmmEngine::powers(double x, double y, double z, double* out) const {
+    const double v[3] = { x, y, z };
+    out[0] = 1.0;
+    for (size_t t = 1; t < m_terms; ++t) out[t] = out[m_term[t].from] * v[m_term[t].axis];
+}
+
+// radix sort of the Morton keys, 11 bits per pass
+void FmmEngine::sortBodies(const BodySystem& bodies) {
+    PROFILE_SCOPE("fmm sort");
+    size_t n = bodies.count;
+    float lo[3] = { bodies.x[0], bodies.y[0], bodies.z[0] };
+    float hi[3] = { lo[0], lo[1], lo[2] };
+    for (size_t i = 1; i < n; ++i) {
+        lo[0] = std::min(lo[0], bodies.x[i]);
+        lo[1] = std::min(lo[1], bodies.y[i]);
+        lo[2] = std::min(lo[2], bodies.z[i]);
+        hi[0] = std::max(hi[0], bodies.x[i]);
+        hi[1] = std::max(hi[1], bodies.y[i]);
+        hi[2] = std::max(hi[2], bodies.z[i]);
+    }
+    m_size = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2])) * 1.001f + 1.0f;
+    std::copy(lo, lo + 3, m_lo);
+
+    resizePooled(m_keys, n);
+    resizePooled(m_keyScratch, n);
+    resizePooled(m_bodyIndex, n);
+    resizePooled(m_indexScratch, n);
+    const float scale = (float)(1 << FMM_MAX_DEPTH) / m_size;
+    const std::uint64_t top = (1u << FMM_MAX_DEPTH) - 1;
+    forEach(n, 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            std::uint64_t qx = std::min(top, (std::uint64_t)((bodies.x[i] - m_lo[0]) * scale));
+            std::uint64_t qy = std::min(top, (std::uint64_t)((bodies.y[i] - m_lo[1]) * scale));
+            std::uint64_t qz = std::min(top, (std::uint64_t)((bodies.z[i] - m_lo[2]) * scale));
+            m_keys[i] = spreadBits(qx) << 2 | spreadBits(qy) << 1 | spreadBits(qz);
+            m_bodyIndex[i] = (std::uint32_t)i;
+        }
+    });
+
+    const int digitBits = 11;
+    const size_t buckets = size_t(1) << digitBits;
+    size_t count[1 << 11];
+    for (int shift = 0; shift < 3 * FMM_MAX_DEPTH; shift += digitBits) {
+        std::fill(count, count + buckets, size_t(0));
+        for (size_t i = 0; i < n; ++i) ++count[(m_keys[i] >> shift) & (buckets - 1)];
+        // a pass where every key has the same digit changes nothing
+        if (*std::max_element(count, count + buckets) == n) continue;
+        size_t offset = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            size_t c = count[b];
+            count[b] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            size_t slot = count[(m_keys[i] >> shift) & (buckets - 1)]++;
+            m_keyScratch[slot] = m_keys[i];
+            m_indexScratch[slot] = m_bodyIndex[i];
+        }
+        m_keys.swap(m_keyScratch);
+        m_bodyIndex.swap(m_indexScratch);
+    }
+
+    for (auto* arr : { &m_x, &m_y, &m_z, &m_mass, &m_ax, &m_ay, &m_az }) resizePooled(*arr, n);
+    forEach(n, 256, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            std::uint32_t i = m_bodyIndex[k];
+            m_x[k] = bodies.x[i];
+            m_y[k] = bodies.y[i];
+            m_z[k] = bodies.z[i];
+            m_mass[k] = bodies.mass[i];
+            m_ax[k] = m_ay[k] = m_az[k] = 0.0f;
+        }
+    });
+}
+
+// cells are split breadth first, so each level is one contiguous run of cells
+void FmmEngine::buildTree() {
+    PROFILE_SCOPE("fmm tree");
+    size_t needed = m_cells.capacity() ? m_cells.size() + m_cells.size() / 8 : m_keys.size() / 8 + 1;
+    m_cells.clear();
+    if (m_cells.capacity() < needed) m_cells.reserve(needed + needed / 2);
+    m_levelStart.clear();
+
+    m_cells.push_back({ 0, 0, 0, 0.0f, 0, (std::uint32_t)m_keys.size(), -1, 0, 0, -1 });
+    m_levelStart.push_back(0);
+    for (size_t c = 0; c < m_cells.size(); ++c) {
+        if (m_cells[c].level != m_cells[m_levelStart.back()].level) m_levelStart.push_back((std::uint32_t)c);
+        FmmCell cell = m_cells[c];
+        if (cell.end - cell.begin <= FMM_LEAF_SIZE || cell.level >= FMM_MAX_DEPTH) continue;
+
+        // the octant digit of this level sorts the bodies of the cell
+        int shift = 3 * (FMM_MAX_DEPTH - 1 - cell.level);
+        std::int32_t first = (std::int32_t)m_cells.size();
+        std::uint32_t begin = cell.begin;
+        while (begin < cell.end) {
+            std::uint64_t digit = m_keys[begin] >> shift & 7;
+            std::uint32_t end = (std::uint32_t)(std::upper_bound(m_keys.begin() + begin, m_keys.begin() + cell.end, digit,
+                [&](std::uint64_t d, std::uint64_t key) { return d < (key >> shift & 7); }) - m_keys.begin());
+            m_cells.push_back({ 0, 0, 0, 0.0f, begin, end, -1, 0, (std::uint8_t)(cell.level + 1), (std::int32_t)c });
+            begin = end;
+        }
+        m_cells[c].firstChild = first;
+        m_cells[c].childCount = (std::uint8_t)(m_cells.size() - first);
+    }
+    m_levelStart.push_back((std::uint32_t)m_cells.size());
+
+    resizePooled(m_multipoles, m_cells.size() * m_terms);
+    resizePooled(m_scaled, m_cells.size() * m_terms);
+    resizePooled(m_locals, m_cells.size() * m_terms);
+}
+
+// P2M at the leaves and M2M above them, one level at a time from the bottom
+void FmmEngine::upwardPass() {
+    PROFILE_SCOPE("fmm upward");
+    for (size_t level = m_levelStart.size() - 1; level-- > 0;) {
+        size_t first = m_levelStart[level];
+        size_t count = m_levelStart[level + 1] - first;
+        forEach(count, 16, [&](size_t begin, size_t end) {
+            double v[FMM_MAX_TERMS];
+            for (size_t c = first + begin; c < first + end; ++c) {
+                FmmCell& cell = m_cells[c];
+                double* q = &m_multipoles[c * m_terms];
+                std::fill(q, q + m_terms, 0.0);
+
+                if (cell.firstChild < 0) {
+                    double mass = 0, sx = 0, sy = 0, sz = 0;
+                    for (std::uint32_t k = cell.begin; k < cell.end; ++k) {
+                        mass += m_mass[k];
+                        sx += (double)m_mass[k] * m_x[k];
+                        sy += (double)m_mass[k] * m_y[k];
+                        sz += (double)m_mass[k] * m_z[k];
+                    }
+                    if (mass > 0.0) {
+                        cell.cx = sx / mass;
+                        cell.cy = sy / mass;
+                        cell.cz = sz / mass;
+                    } else {
+                        // massless bodies still need a center for their locals
+                        double inv = 1.0 / (cell.end - cell.begin);
+                        cell.cx = cell.cy = cell.cz = 0.0;
+                        for (std::uint32_t k = cell.begin; k < cell.end; ++k) {
+                            cell.cx += m_x[k] * inv;
+                            cell.cy += m_y[k] * inv;
+                            cell.cz += m_z[k] * inv;
+                        }
+                    }
+                    double radiusSq = 0.0;
+                    for (std::uint32_t k = cell.begin; k < cell.end; ++k) {
+                        double dx = m_x[k] - cell.cx, dy = m_y[k] - cell.cy, dz = m_z[k] - cell.cz;
+                        radiusSq = std::max(radiusSq, dx * dx + dy * dy + dz * dz);
+                        if (m_mass[k] == 0.0f) continue;
+                        powers(dx, dy, dz, v);
+                        for (size_t t = 0; t < m_terms; ++t) q[t] += m_mass[k] * v[t];
+                    }
+                    cell.radius = (float)std::sqrt(radiusSq);
+                    continue;
+                }
+
+                double mass = 0, sx = 0, sy = 0, sz = 0;
+                for (int k = 0; k < cell.childCount; ++k) {
+                    const FmmCell& child = m_cells[cell.firstChild + k];
+                    double m = m_multipoles[(cell.firstChild + k) * m_terms];
+                    mass += m;
+                    sx += m * child.cx;
+                    sy += m * child.cy;
+                    sz += m * child.cz;
+                }
+                if (mass > 0.0) {
+                    cell.cx = sx / mass;
+                    cell.cy = sy / mass;
+                    cell.cz = sz / mass;
+                } else {
+                    const FmmCell& child = m_cells[cell.firstChild];
+                    cell.cx = child.cx;
+                    cell.cy = child.cy;
+                    cell.cz = child.cz;
+                }
+                double radius = 0.0;
+                for (int k = 0; k < cell.childCount; ++k) {
+                    const FmmCell& child = m_cells[cell.firstChild + k];
+                    double dx = child.cx - cell.cx, dy = child.cy - cell.cy, dz = child.cz - cell.cz;
+                    radius = std::max(radius, std::sqrt(dx * dx + dy * dy + dz * dz) + child.radius);
+                    const double* qc = &m_multipoles[(cell.firstChild + k) * m_terms];
+                    powers(dx, dy, dz, v);
+                    for (const Product& t : m_multipoleShift) q[t.out] += t.coefficient * qc[t.in] * v[t.power];
+                }
+                cell.radius = (float)radius;
+            }
+        });
+    }
+
+    // the M2L form of the finished multipoles
+    forEach(m_cells.size(), 64, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            const double* q = &m_multipoles[c * m_terms];
+            double* scaled = &m_scaled[c * m_terms];
+            for (size_t t = 0; t < m_terms; ++t) scaled[t] = q[t] * m_scale[t];
+        }
+    });
+}
+
+void FmmEngine::multipoleToLocal(const FmmCell& target, const FmmCell& source, double* local) const {
+    double rx = target.cx - source.cx, ry = target.cy - source.cy, rz = target.cz - source.cz;
+    double invRSq = 1.0 / (rx * rx + ry * ry + rz * rz);
+    const double r[3] = { rx, ry, rz };
+
+    // m r^2 t_n = -(2m - 1) sum_i R_i t_{n-e_i} - (m - 1) sum_i t_{n-2e_i}, m = |n|.
+    // missing lower terms index the zero past the end
+    double t[FMM_MAX_TERMS + 1];
+    t[0] = std::sqrt(invRSq);
+    t[m_terms] = 0.0;
+    for (size_t n = 1; n < m_terms; ++n) {
+        const Term& term = m_term[n];
+        double first = r[0] * t[term.less1[0]] + r[1] * t[term.less1[1]] + r[2] * t[term.less1[2]];
+        double second = t[term.less2[0]] + t[term.less2[1]] + t[term.less2[2]];
+        t[n] = (term.first * first + term.second * second) * invRSq;
+    }
+    for (size_t n = 0; n < m_terms; ++n) t[n] *= m_factorial[n];
+
+    const double* scaled = &m_scaled[(&source - m_cells.data()) * m_terms];
+    for (size_t b = 0; b < m_terms; ++b) {
+        const std::uint16_t* sum = &m_sumIndex[m_sumStart[b]];
+        size_t count = m_sumStart[b + 1] - m_sumStart[b];
+        double acc = 0.0;
+        for (size_t a = 0; a < count; ++a) acc += scaled[a] * t[sum[a]];
+        local[b] += acc / m_factorial[b];
+    }
+}
+
+// direct sum with the 1m cutoff of gravityAcceleration; also covers target == source
+void FmmEngine::nearField(const FmmCell& target, const FmmCell& source) {
+    for (std::uint32_t i = target.begin; i < target.end; ++i) {
+        if (!isTarget(i)) continue;
+        float xi = m_x[i], yi = m_y[i], zi = m_z[i];
+        float ax = 0.0f, ay = 0.0f, az = 0.0f;
+        for (std::uint32_t j = source.begin; j < source.end; ++j) {
+            float dx = m_x[j] - xi, dy = m_y[j] - yi, dz = m_z[j] - zi;
+            float distSq = dx * dx + dy * dy + dz * dz;
+            float s = distSq >= 1.0f ? m_mass[j] / (distSq * std::sqrt(distSq)) : 0.0f;
+            ax += dx * s;
+            ay += dy * s;
+            az += dz * s;
+        }
+        m_ax[i] += G * ax;
+        m_ay[i] += G * ay;
+        m_az[i] += G * az;
+    }
+}
+
+// dual tree walk for one target cell against the queued source cells: well
+// separated pairs become M2L, touching leaves are summed directly, and
+// everything else splits the larger of the two cells
+void FmmEngine::interact(std::int32_t target, Scratch& scratch, int depth) {
+    std::vector<std::int32_t>& queue = scratch.queue[depth];
+    std::vector<std::int32_t>& deferred = scratch.deferred[depth];
+    deferred.clear();
+
+    const FmmCell& a = m_cells[target];
+    bool targetLeaf = a.firstChild < 0;
+    double* local = &m_locals[target * m_terms];
+    float theta = std::min(m_theta, FMM_MAX_THETA);
+    for (size_t k = 0; k < queue.size(); ++k) {
+        const FmmCell& b = m_cells[queue[k]];
+        double dx = a.cx - b.cx, dy = a.cy - b.cy, dz = a.cz - b.cz;
+        double reach = (double)a.radius + b.radius;
+        bool sourceLeaf = b.firstChild < 0;
+        if (reach * reach < theta * theta * (dx * dx + dy * dy + dz * dz)) {
+            multipoleToLocal(a, b, local);
+        } else if (targetLeaf && sourceLeaf) {
+            nearField(a, b);
+        } else if (sourceLeaf || (!targetLeaf && a.radius >= b.radius)) {
+            deferred.push_back(queue[k]);
+        } else {
+            for (int c = 0; c < b.childCount; ++c) queue.push_back(b.firstChild + c);
+        }
+    }
+    queue.clear();
+    if (deferred.empty()) return;
+
+    for (int c = 0; c < a.childCount; ++c) {
+        if (!isTarget(m_cells[a.firstChild + c])) continue;
+        scratch.queue[depth + 1].assign(deferred.begin(), deferred.end());
+        interact(a.firstChild + c, scratch, depth + 1);
+    }
+}
+
+void FmmEngine::evaluateLocal(const FmmCell& cell, const double* local) {
+    double u[FMM_MAX_TERMS];
+    for (std::uint32_t k = cell.begin; k < cell.end; ++k) {
+        if (!isTarget(k)) continue;
+        powers(m_x[k] - cell.cx, m_y[k] - cell.cy, m_z[k] - cell.cz, u);
+        double a[3] = { 0.0, 0.0, 0.0 };
+        for (const Product& p : m_gradient) a[p.out] += p.coefficient * local[p.in] * u[p.power];
+        m_ax[k] += (float)(G * a[0]);
+        m_ay[k] += (float)(G * a[1]);
+        m_az[k] += (float)(G * a[2]);
+    }
+}
+
+// L2L from every parent, one level at a time from the top, then L2P at the leaves
+void FmmEngine::downwardPass() {
+    PROFILE_SCOPE("fmm downward");
+    for (size_t level = 1; level + 1 < m_levelStart.size(); ++level) {
+        size_t first = m_levelStart[level];
+        size_t count = m_levelStart[level + 1] - first;
+        forEach(count, 16, [&](size_t begin, size_t end) {
+            double d[FMM_MAX_TERMS];
+            for (size_t c = first + begin; c < first + end; ++c) {
+                const FmmCell& cell = m_cells[c];
+                if (!isTarget(cell)) continue;
+                const FmmCell& parent = m_cells[cell.parent];
+                double* local = &m_locals[c * m_terms];
+                const double* parentLocal = &m_locals[cell.parent * m_terms];
+                powers(cell.cx - parent.cx, cell.cy - parent.cy, cell.cz - parent.cz, d);
+                for (const Product& p : m_localShift) local[p.out] += p.coefficient * parentLocal[p.in] * d[p.power];
+            }
+        });
+    }
+
+    forEach(m_cells.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            if (m_cells[c].firstChild < 0 && isTarget(m_cells[c])) evaluateLocal(m_cells[c], &m_locals[c * m_terms]);
+        }
+    });
+}
+
+void FmmEngine::computeAccelerations(BodySystem& bodies) {
+    PROFILE_SCOPE("gravity fmm");
+    m_subset = false;
+    evaluate(bodies);
+}
+
+void FmmEngine::computeAccelerations(BodySystem& bodies, const std::vector<std::uint32_t>& active) {
+    PROFILE_SCOPE("gravity fmm subset");
+    m_subset = true;
+    resizePooled(m_activeFlag, bodies.count);
+    std::fill(m_activeFlag.begin(), m_activeFlag.end(), std::uint8_t(0));
+    for (std::uint32_t i : active) m_activeFlag[i] = 1;
+    evaluate(bodies);
+}
+
+void FmmEngine::evaluate(BodySystem& bodies) {
+    size_t n = bodies.count;
+    for (size_t i = n; i < bodies.paddedCount(); ++i) bodies.ax[i] = bodies.ay[i] = bodies.az[i] = 0.0f;
+    if (n == 0) return;
+
+    sortBodies(bodies);
+    if (m_subset) {
+        resizePooled(m_activeBefore, n + 1);
+        m_activeBefore[0] = 0;
+        for (size_t k = 0; k < n; ++k) m_activeBefore[k + 1] = m_activeBefore[k] + m_activeFlag[m_bodyIndex[k]];
+    }
+    buildTree();
+    upwardPass();
+
+    {
+        PROFILE_SCOPE("fmm interactions");
+        std::fill(m_locals.begin(), m_locals.end(), 0.0);
+
+        // targets are split into subtrees of about n / FMM_TASKS bodies; each walks
+        // the whole source tree and writes only its own cells and bodies. the split
+        // does not depend on the thread count, so neither do the results
+        size_t taskBodies = std::max<size_t>(FMM_LEAF_SIZE, n / FMM_TASKS);
+        // there are never more tasks than cells
+        for (auto* v : { &m_tasks, &m_frontier, &m_nextFrontier }) {
+            if (v->capacity() < m_cells.size()) v->reserve(m_cells.size() + m_cells.size() / 2);
+        }
+        m_tasks.clear();
+        m_frontier.assign(1, 0);
+        while (!m_frontier.empty()) {
+            m_nextFrontier.clear();
+            for (std::int32_t c : m_frontier) {
+                const FmmCell& cell = m_cells[c];
+                if (cell.firstChild >= 0 && cell.end - cell.begin > taskBodies) {
+                    for (int k = 0; k < cell.childCount; ++k) m_nextFrontier.push_back(cell.firstChild + k);
+                } else {
+                    m_tasks.push_back(c);
+                }
+            }
+            m_frontier.swap(m_nextFrontier);
+        }
+
+        // a walk can reach a queue no walk has used yet, one level deeper or on
+        // another thread. all queues share one capacity, raised ahead of the
+        // largest any of them needed, so a longer walk only rarely allocates
+        size_t needed = 0;
+        for (const Scratch& scratch : m_scratch) {
+            for (size_t d = 0; d < FMM_MAX_DEPTH + 2; ++d) {
+                needed = std::max(needed, std::max(scratch.queue[d].capacity(), scratch.deferred[d].capacity()));
+            }
+        }
+        if (needed > m_queueCapacity || m_queueCapacity == 0) {
+            m_queueCapacity = std::max<size_t>(64, needed + needed / 2);
+            for (Scratch& scratch : m_scratch) {
+                for (size_t d = 0; d < FMM_MAX_DEPTH + 2; ++d) {
+                    scratch.queue[d].reserve(m_queueCapacity);
+                    scratch.deferred[d].reserve(m_queueCapacity);
+                }
+            }
+        }
+
+        auto walk = [&](size_t begin, size_t end) {
+            Scratch& scratch = m_scratch[m_pool ? ThreadPool::currentThread() : 0];
+            for (size_t t = begin; t < end; ++t) {
+                if (!isTarget(m_cells[m_tasks[t]])) continue;
+                scratch.queue[0].assign(1, 0);
+                interact(m_tasks[t], scratch, 0);
+            }
+        };
+        forEach(m_tasks.size(), 1, walk);
+    }
+
+    downwardPass();
+
+    for (size_t k = 0; k < n; ++k) {
+        if (!isTarget((std::uint32_t)k)) continue;
+        std::uint32_t i = m_bodyIndex[k];
+        bodies.ax[i] = m_ax[k];
+        bodies.ay[i] = m_ay[k];
+        bodies.az[i] = m_az[k];
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "force_engine.h"
+
+// highest supported expansion order; the M2L table grows as order^6/36
+#define FMM_MAX_ORDER 8
+// terms of an expansion of order FMM_MAX_ORDER
+#define FMM_MAX_TERMS ((FMM_MAX_ORDER + 1) * (FMM_MAX_ORDER + 2) * (FMM_MAX_ORDER + 3) / 6)
+// bodies per leaf cell, below this the near field is summed directly
+#define FMM_LEAF_SIZE 64
+// Morton key bits per axis, and so the deepest level of the tree
+#define FMM_MAX_DEPTH 21
+// target subtrees the interaction pass is split into
+#define FMM_TASKS 256
+// r_a + r_b < theta * d keeps the expansions convergent only for theta < 1
+#define FMM_MAX_THETA 0.9f
+
+// cell of the FMM tree. bodies of a cell are contiguous in Morton order and
+// the tree is stored level by level, children of a cell are contiguous too
+struct FmmCell {
+    double cx, cy, cz;  // expansion center, the center of mass
+    float radius;       // bound on the distance of any body from the center
+    std::uint32_t begin, end;  // sorted body range
+    std::int32_t firstChild;   // -1 for leaves
+    std::uint8_t childCount;
+    std::uint8_t level;
+    std::int32_t parent;
+};
+
+// Cartesian fast multipole method: Taylor expansions of 1/r up to `order`
+// about cell centers, a dual tree walk that turns well separated cell pairs
+// into multipole-to-local translations and the rest into direct sums.
+// upward, interaction and downward passes all run on the pool. an active
+// subset still builds the whole tree, but only walks and evaluates the
+// target cells that hold active bodies
+class FmmEngine : public ForceEngine {
+public:
+    FmmEngine(int order, float theta, ThreadPool* pool = nullptr);
+
+    const char* name() const override { return "fmm"; }
+    void computeAccelerations(BodySystem& bodies) override;
+    void computeAccelerations(BodySystem& bodies, const std::vector<std::uint32_t>& active) override;
+
+    int order() const { return m_order; }
+    float theta() const { return m_theta; }
+    void setTheta(float theta) { m_theta = theta; }
+
+private:
+    // per pool thread, kept so steady-state steps do not allocate. a thread
+    // reuses its queues for every task it runs, so they stop growing once
+    // they have held the largest walk
+    struct Scratch {
+        std::vector<std::int32_t> queue[FMM_MAX_DEPTH + 2];
+        std::vector<std::int32_t> deferred[FMM_MAX_DEPTH + 2];
+    };
+
+    void buildTables();
+    void evaluate(BodySystem& bodies);
+    void sortBodies(const BodySystem& bodies);
+    void buildTree();
+    void upwardPass();
+    void interact(std::int32_t target, Scratch& scratch, int depth);
+    void downwardPass();
+
+    void powers(double x, double y, double z, double* out) const;
+    void multipoleToLocal(const FmmCell& target, const FmmCell& source, double* local) const;
+    void nearField(const FmmCell& target, const FmmCell& source);
+    void evaluateLocal(const FmmCell& cell, const double* local);
+
+    // with a subset only the active sorted bodies, and the cells holding any, are targets
+    bool isTarget(std::uint32_t k) const { return !m_subset || m_activeBefore[k + 1] != m_activeBefore[k]; }
+    bool isTarget(const FmmCell& cell) const { return !m_subset || m_activeBefore[cell.end] != m_activeBefore[cell.begin]; }
+
+    template <typename Fn>
+    void forEach(size_t count, size_t grain, Fn&& fn);
+
+    int m_order;
+    float m_theta;
+    ThreadPool* m_pool;
+    size_t m_terms = 0;  // multi-indices of degree <= order
+
+    // multi-index tables, see buildTables(). out[o] += coefficient * in[i] * power[p]
+    struct Product {
+        std::uint16_t out, in, power;
+        double coefficient;
+    };
+    struct Term {
+        std::uint16_t from;  // this term's monomial is from's times one coordinate
+        std::uint8_t axis;
+        std::int16_t less1[3], less2[3];  // the index lowered by one/two along each axis, or m_terms
+        int degree;
+        double first, second;  // M2L recurrence weights of the less1 and less2 sums
+    };
+    std::vector<Term> m_term;
+    std::vector<Product> m_multipoleShift;  // M2M
+    std::vector<Product> m_localShift;      // L2L
+    // M2L: l_b = 1/b! sum_a S_a D_{a+b} with the scaled multipoles S_a =
+    // (-1)^|a| Q_a / a! and the derivatives D_n = n! t_n. for every b the
+    // indices of a + b over |a| <= order - |b| are stored contiguously
+    std::vector<std::uint16_t> m_sumIndex;
+    std::vector<std::uint32_t> m_sumStart;  // per b, into m_sumIndex
+    std::vector<double> m_factorial;        // n! per term
+    std::vector<double> m_scale;            // (-1)^|a| / a! per term
+    std::vector<Product> m_gradient;        // L2P, `out` is the axis
+
+    // bodies in Morton order
+    std::vector<std::uint64_t> m_keys, m_keyScratch;
+    std::vector<std::uint32_t> m_bodyIndex, m_indexScratch;
+    std::vector<float> m_x, m_y, m_z, m_mass;
+    std::vector<float> m_ax, m_ay, m_az;
+    // active subset: flags by body index, and active sorted bodies before each position
+    bool m_subset = false;
+    std::vector<std::uint8_t> m_activeFlag;
+    std::vector<std::uint32_t> m_activeBefore;
+    float m_lo[3] = { 0, 0, 0 };
+    float m_size = 1.0f;
+
+    std::vector<FmmCell> m_cells;
+    std::vector<std::uint32_t> m_levelStart;  // m_cells range of every level, plus the end
+    std::vector<double> m_multipoles;         // m_terms per cell
+    std::vector<double> m_scaled;             // S_a per cell, see m_sumIndex
+    std::vector<double> m_locals;
+
+    std::vector<std::int32_t> m_tasks;        // target cells walked independently
+    std::vector<std::int32_t> m_frontier, m_nextFrontier;  // cells still to split into tasks
+    std::vector<Scratch> m_scratch;           // per pool thread
+    size_t m_queueCapacity = 0;               // of every scratch vector
+};
@@ -0,0 +1,109 @@
+#include "force_engine.h"
+#include <algorithm>
+#include <cstring>
+#include "barnes_hut.h"
+#include "fmm.h"
+#include "gravity_kernel.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+void AllPairsEngine::computeAccelerations(BodySystem& bodies) {
+    PROFILE_SCOPE("gravity all-pairs");
+    size_t padded = bodies.paddedCount();
+    auto accumulate = [&](size_t begin, size_t end) {
+        if (bodies.preciseAccelerations()) {
+            accumulateAllPairsDouble(bodies, begin, end);
+        } else {
+            accumulateAllPairs(bodies, begin, end);
+        }
+    };
+    if (!m_pool) {
+        accumulate(0, padded);
+        return;
+    }
+    // every chunk owns its slice of the acceleration arrays, no synchronization needed
+    size_t grain = chunkSize(padded, m_pool->threadCount(), SIMD_WIDTH);
+    m_pool->parallelFor(0, padded, grain, accumulate);
+}
+
+// active bodies are gathered into padded target blocks for the vector kernels
+void AllPairsEngine::computeAccelerations(BodySystem& bodies, const std::vector<std::uint32_t>& active) {
+    PROFILE_SCOPE("gravity all-pairs subset");
+    size_t n = active.size();
+    if (bodies.preciseAccelerations()) {
+        // the double kernel reads the bodies in place, no gather
+        auto accumulate = [&](size_t begin, size_t end) { accumulateAllPairsDouble(bodies, active.data() + begin, end - begin); };
+        if (m_pool) {
+            m_pool->parallelFor(0, n, chunkSize(n, m_pool->threadCount(), 1), accumulate);
+        } else {
+            accumulate(0, n);
+        }
+        return;
+    }
+    size_t padded = paddedSize(n);
+    m_arena.reset();
+    float* tx = m_arena.allocate<float>(padded, SIMD_ALIGNMENT);
+    float* ty = m_arena.allocate<float>(padded, SIMD_ALIGNMENT);
+    float* tz = m_arena.allocate<float>(padded, SIMD_ALIGNMENT);
+    float* ax = m_arena.allocate<float>(padded, SIMD_ALIGNMENT);
+    float* ay = m_arena.allocate<float>(padded, SIMD_ALIGNMENT);
+    float* az = m_arena.allocate<float>(padded, SIMD_ALIGNMENT);
+    for (size_t k = 0; k < n; ++k) {
+        tx[k] = bodies.x[active[k]];
+        ty[k] = bodies.y[active[k]];
+        tz[k] = bodies.z[active[k]];
+    }
+    // padding targets sit at the origin, their results are dropped
+    std::fill(tx + n, tx + padded, 0.0f);
+    std::fill(ty + n, ty + padded, 0.0f);
+    std::fill(tz + n, tz + padded, 0.0f);
+
+    auto accumulate = [&](size_t begin, size_t end) {
+        accumulateAllPairsAt(bodies, tx + begin, ty + begin, tz + begin, end - begin, ax + begin, ay + begin, az + begin);
+    };
+    if (m_pool) {
+        m_pool->parallelFor(0, padded, chunkSize(padded, m_pool->threadCount(), SIMD_WIDTH), accumulate);
+    } else {
+        accumulate(0, padded);
+    }
+
+    for (size_t k = 0; k < n; ++k) {
+        bodies.ax[active[k]] = ax[k];
+        bodies.ay[active[k]] = ay[k];
+        bodies.az[active[k]] = az[k];
+    }
+}
+
+std::unique_ptr<ForceEngine> createForceEngine(const ForceSettings& settings, ThreadPool* pool) {
+    switch (settings.mode) {
+    case ForceMode::BarnesHut: return std::make_unique<BarnesHutEngine>(settings.theta, pool);
+    case ForceMode::Fmm: return std::make_unique<FmmEngine>(settings.fmmOrder, settings.fmmTheta, pool);
+    case ForceMode::AllPairs: break;
+    }
+    return std::make_unique<AllPairsEngine>(pool);
+}
+
+const char* forceModeName(ForceMode mode) {
+    switch (mode) {
+    case ForceMode::AllPairs: return "all-pairs";
+    case ForceMode::BarnesHut: return "barnes-hut";
+    case ForceMode::Fmm: return "fmm";
+    }
+    return "unknown";
+}
+
+bool parseForceMode(const char* text, ForceMode& mode) {
+    if (std::strcmp(text, "all-pairs") == 0 || std::strcmp(text, "exact") == 0) {
+        mode = ForceMode::AllPairs;
+        return true;
+    }
+    if (std::strcmp(text, "barnes-hut") == 0 || std::strcmp(text, "bh") == 0) {
+        mode = ForceMode::BarnesHut;
+        return true;
+    }
+    if (std::strcmp(text, "fmm") == 0) {
+        mode = ForceMode::Fmm;
+        return true;
+    }
+    return false;
+}
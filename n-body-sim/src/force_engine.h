@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "body_system.h"
+#include "frame_arena.h"
+
+class ThreadPool;
+
+enum class ForceMode {
+    AllPairs,   // exact O(N^2) reference
+    BarnesHut,  // octree approximation, O(N log N)
+    Fmm,        // fast multipole method, O(N)
+};
+
+class ForceEngine {
+public:
+    virtual ~ForceEngine() = default;
+
+    virtual const char* name() const = 0;
+
+    // writes the gravitational acceleration of every body into bodies.ax/ay/az
+    virtual void computeAccelerations(BodySystem& bodies) = 0;
+
+    // only the listed bodies get new accelerations, from all bodies at their
+    // current positions; the rest keep theirs. engines without a cheaper
+    // path fall back to computing everything
+    virtual void computeAccelerations(BodySystem& bodies, const std::vector<std::uint32_t>& active) {
+        computeAccelerations(bodies);
+        (void)active;
+    }
+
+    // whether the engine fills pax/pay/paz of a Precision::Double system.
+    // the integrator widens the float results of engines that do not
+    virtual bool writesPreciseAccelerations() const { return false; }
+};
+
+struct ForceSettings {
+    ForceMode mode = ForceMode::AllPairs;
+    float theta = 0.5f;     // Barnes-Hut opening angle
+    float fmmTheta = 0.7f;  // FMM cell separation, (r_a + r_b) / d below which cells interact by M2L
+    int fmmOrder = 4;       // FMM expansion order, 1 to FMM_MAX_ORDER
+};
+
+// pool may be null, in which case the engine runs on the calling thread
+std::unique_ptr<ForceEngine> createForceEngine(const ForceSettings& settings, ThreadPool* pool);
+const char* forceModeName(ForceMode mode);
+bool parseForceMode(const char* text, ForceMode& mode);
+
+// acceleration of a caused by b; pairs closer than 1m are ignored. the
+// SIMD kernels in gravity_kernel.cpp apply the same rule to whole arrays
+inline Vec3 gravityAcceleration(const Vec3& a, const Vec3& b, float bMass) {
+    Vec3 diff = b - a;
+    float distSq = diff.lengthSquared();
+    float dist = std::sqrt(distSq);
+    if (dist < 1.0f) return { 0, 0, 0 };
+
+    Vec3 dir = diff * (1.0f / dist);
+    return dir * (G * bMass / distSq);
+}
+
+class AllPairsEngine : public ForceEngine {
+public:
+    explicit AllPairsEngine(ThreadPool* pool = nullptr) : m_pool(pool) {}
+
+    const char* name() const override { return "all-pairs"; }
+    void computeAccelerations(BodySystem& bodies) override;
+    void computeAccelerations(BodySystem& bodies, const std::vector<std::uint32_t>& active) override;
+    bool writesPreciseAccelerations() const override { return true; }
+
+private:
+    ThreadPool* m_pool;
+    FrameArena m_arena;  // gathered active positions and their accelerations
+};
@@ -0,0 +1,283 @@
+#include "gpu_backend.h"
+
+#ifdef NBODY_GPU
+#include <SDL.h>
+#include <SDL_opengl.h>
+#include "object.h"
+#include "profiler.h"
+
+#define GPU_GROUP_SIZE 256
+#define GPU_GROUP_SIZE_STRING "256"
+
+// core profile entry points are not exported by every platform's GL library, so
+// all of them go through SDL_GL_GetProcAddress
+typedef const GLubyte* (APIENTRY* GetStringProc)(GLenum name);
+typedef GLenum (APIENTRY* GetErrorProc)(void);
+
+#define GPU_GL_FUNCTIONS(X) \
+    X(GetStringProc, glGetString) \
+    X(GetErrorProc, glGetError) \
+    X(PFNGLCREATESHADERPROC, glCreateShader) \
+    X(PFNGLSHADERSOURCEPROC, glShaderSource) \
+    X(PFNGLCOMPILESHADERPROC, glCompileShader) \
+    X(PFNGLGETSHADERIVPROC, glGetShaderiv) \
+    X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog) \
+    X(PFNGLDELETESHADERPROC, glDeleteShader) \
+    X(PFNGLCREATEPROGRAMPROC, glCreateProgram) \
+    X(PFNGLATTACHSHADERPROC, glAttachShader) \
+    X(PFNGLLINKPROGRAMPROC, glLinkProgram) \
+    X(PFNGLGETPROGRAMIVPROC, glGetProgramiv) \
+    X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog) \
+    X(PFNGLDELETEPROGRAMPROC, glDeleteProgram) \
+    X(PFNGLUSEPROGRAMPROC, glUseProgram) \
+    X(PFNGLUNIFORM1UIPROC, glUniform1ui) \
+    X(PFNGLUNIFORM1FPROC, glUniform1f) \
+    X(PFNGLUNIFORM1IPROC, glUniform1i) \
+    X(PFNGLGENBUFFERSPROC, glGenBuffers) \
+    X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers) \
+    X(PFNGLBINDBUFFERPROC, glBindBuffer) \
+    X(PFNGLBUFFERDATAPROC, glBufferData) \
+    X(PFNGLGETBUFFERSUBDATAPROC, glGetBufferSubData) \
+    X(PFNGLBINDBUFFERBASEPROC, glBindBufferBase) \
+    X(PFNGLDISPATCHCOMPUTEPROC, glDispatchCompute) \
+    X(PFNGLMEMORYBARRIERPROC, glMemoryBarrier)
+
+struct GlFunctions {
+#define GPU_DECLARE(type, name) type name = nullptr;
+    GPU_GL_FUNCTIONS(GPU_DECLARE)
+#undef GPU_DECLARE
+
+    bool load(std::string& error) {
+#define GPU_LOAD(type, name) \
+        name = reinterpret_cast<type>(SDL_GL_GetProcAddress(#name)); \
+        if (!name) { error = "missing GL entry point " #name; return false; }
+        GPU_GL_FUNCTIONS(GPU_LOAD)
+#undef GPU_LOAD
+        return true;
+    }
+};
+
+static GlFunctions gl;
+
+// one invocation per body; each work group stages GPU_GROUP_SIZE sources in
+// shared memory at a time. w holds the mass, padding bodies have none
+static const char* forceShader =
+    "#version 430\n"
+    "layout(local_size_x = " GPU_GROUP_SIZE_STRING ") in;\n"
+    "layout(std430, binding = 0) readonly buffer Positions { vec4 pos[]; };\n"
+    "layout(std430, binding = 2) writeonly buffer Accelerations { vec4 acc[]; };\n"
+    "layout(location = 0) uniform uint paddedCount;\n"
+    "layout(location = 1) uniform float G;\n"
+    "shared vec4 tile[" GPU_GROUP_SIZE_STRING "];\n"
+    "void main() {\n"
+    "    uint i = gl_GlobalInvocationID.x;\n"
+    "    vec3 p = pos[i].xyz;\n"
+    "    vec3 a = vec3(0.0);\n"
+    "    for (uint base = 0u; base < paddedCount; base += gl_WorkGroupSize.x) {\n"
+    "        tile[gl_LocalInvocationID.x] = pos[base + gl_LocalInvocationID.x];\n"
+    "        barrier();\n"
+    "        for (uint j = 0u; j < gl_WorkGroupSize.x; ++j) {\n"
+    "            vec3 d = tile[j].xyz - p;\n"
+    "            float distSq = dot(d, d);\n"
+    "            if (distSq < 1.0) continue;\n"
+    "            float inv = inversesqrt(distSq);\n"
+    "            a += d * (G * tile[j].w * inv * inv * inv);\n"
+    "        }\n"
+    "        barrier();\n"
+    "    }\n"
+    "    acc[i] = vec4(a, 0.0);\n"
+    "}\n";
+
+// half kick, optionally followed by a full drift
+static const char* integrateShader =
+    "#version 430\n"
+    "layout(local_size_x = " GPU_GROUP_SIZE_STRING ") in;\n"
+    "layout(std430, binding = 0) buffer Positions { vec4 pos[]; };\n"
+    "layout(std430, binding = 1) buffer Velocities { vec4 vel[]; };\n"
+    "layout(std430, binding = 2) readonly buffer Accelerations { vec4 acc[]; };\n"
+    "layout(location = 0) uniform uint count;\n"
+    "layout(location = 1) uniform float halfDt;\n"
+    "layout(location = 2) uniform float dt;\n"
+    "layout(location = 3) uniform int drift;\n"
+    "void main() {\n"
+    "    uint i = gl_GlobalInvocationID.x;\n"
+    "    if (i >= count) return;\n"
+    "    vec3 v = vel[i].xyz + acc[i].xyz * halfDt;\n"
+    "    vel[i].xyz = v;\n"
+    "    if (drift != 0) pos[i].xyz += v * dt;\n"
+    "}\n";
+
+static GLuint compileProgram(const char* source, const char* label, std::string& error) {
+    GLuint shader = gl.glCreateShader(GL_COMPUTE_SHADER);
+    gl.glShaderSource(shader, 1, &source, nullptr);
+    gl.glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    char log[1024] = {};
+    gl.glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        gl.glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        error = std::string(label) + " shader: " + log;
+        gl.glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint program = gl.glCreateProgram();
+    gl.glAttachShader(program, shader);
+    gl.glLinkProgram(program);
+    gl.glDeleteShader(shader);
+    gl.glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        gl.glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        error = std::string(label) + " program: " + log;
+        gl.glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+std::unique_ptr<GpuSimulation> GpuSimulation::create(const BodySystem& bodies, std::string& error) {
+    std::unique_ptr<GpuSimulation> simulation(new GpuSimulation());
+    if (!simulation->init(bodies, error)) return nullptr;
+    return simulation;
+}
+
+bool GpuSimulation::init(const BodySystem& bodies, std::string& error) {
+    // reference counted by SDL, so this also works next to the demo's window
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+        error = std::string("cannot initialize SDL video: ") + SDL_GetError();
+        return false;
+    }
+    m_videoInitialized = true;
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    m_window = SDL_CreateWindow("n-body compute", 0, 0, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    if (!m_window) {
+        error = std::string("cannot create GL window: ") + SDL_GetError();
+        return false;
+    }
+    m_context = SDL_GL_CreateContext(m_window);
+    if (!m_context) {
+        error = std::string("no OpenGL 4.3 context: ") + SDL_GetError();
+        return false;
+    }
+    if (!gl.load(error)) return false;
+
+    const char* renderer = reinterpret_cast<const char*>(gl.glGetString(GL_RENDERER));
+    m_deviceName = renderer ? renderer : "unknown device";
+
+    m_forceProgram = compileProgram(forceShader, "force", error);
+    if (!m_forceProgram) return false;
+    m_integrateProgram = compileProgram(integrateShader, "integrate", error);
+    if (!m_integrateProgram) return false;
+
+    // one upload of the whole state; accelerations start from a force pass
+    m_count = bodies.count;
+    m_paddedCount = (m_count + GPU_GROUP_SIZE - 1) / GPU_GROUP_SIZE * GPU_GROUP_SIZE;
+    std::vector<float> position(m_paddedCount * 4, 0.0f);
+    std::vector<float> velocity(m_paddedCount * 4, 0.0f);
+    for (size_t i = 0; i < m_count; ++i) {
+        position[i * 4 + 0] = bodies.x[i];
+        position[i * 4 + 1] = bodies.y[i];
+        position[i * 4 + 2] = bodies.z[i];
+        position[i * 4 + 3] = bodies.mass[i];
+        velocity[i * 4 + 0] = bodies.vx[i];
+        velocity[i * 4 + 1] = bodies.vy[i];
+        velocity[i * 4 + 2] = bodies.vz[i];
+    }
+    const float* initial[3] = { position.data(), velocity.data(), nullptr };
+    gl.glGenBuffers(3, m_buffers);
+    for (GLuint binding = 0; binding < 3; ++binding) {
+        gl.glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[binding]);
+        gl.glBufferData(GL_SHADER_STORAGE_BUFFER, m_paddedCount * 4 * sizeof(float), initial[binding], GL_DYNAMIC_COPY);
+        gl.glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, m_buffers[binding]);
+    }
+
+    gl.glUseProgram(m_forceProgram);
+    gl.glUniform1ui(0, (GLuint)m_paddedCount);
+    gl.glUniform1f(1, G);
+    gl.glDispatchCompute((GLuint)(m_paddedCount / GPU_GROUP_SIZE), 1, 1);
+    gl.glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if (gl.glGetError() != GL_NO_ERROR) {
+        error = "GL error while uploading bodies";
+        return false;
+    }
+    return true;
+}
+
+GpuSimulation::~GpuSimulation() {
+    if (m_context) {
+        SDL_GL_MakeCurrent(m_window, m_context);
+        if (m_buffers[0]) gl.glDeleteBuffers(3, m_buffers);
+        if (m_forceProgram) gl.glDeleteProgram(m_forceProgram);
+        if (m_integrateProgram) gl.glDeleteProgram(m_integrateProgram);
+        SDL_GL_DeleteContext(m_context);
+    }
+    if (m_window) SDL_DestroyWindow(m_window);
+    if (m_videoInitialized) SDL_QuitSubSystem(SDL_INIT_VIDEO);
+}
+
+void GpuSimulation::step(float dt, int steps) {
+    PROFILE_SCOPE("gpu step");
+    SDL_GL_MakeCurrent(m_window, m_context);
+    GLuint groups = (GLuint)(m_paddedCount / GPU_GROUP_SIZE);
+
+    // the uniforms only change with dt, so they are set once per batch
+    gl.glUseProgram(m_integrateProgram);
+    gl.glUniform1ui(0, (GLuint)m_count);
+    gl.glUniform1f(1, 0.5f * dt);
+    gl.glUniform1f(2, dt);
+    for (int s = 0; s < steps; ++s) {
+        gl.glUseProgram(m_integrateProgram);
+        gl.glUniform1i(3, 1);
+        gl.glDispatchCompute(groups, 1, 1);
+        gl.glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        gl.glUseProgram(m_forceProgram);
+        gl.glDispatchCompute(groups, 1, 1);
+        gl.glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        gl.glUseProgram(m_integrateProgram);
+        gl.glUniform1i(3, 0);
+        gl.glDispatchCompute(groups, 1, 1);
+        gl.glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+}
+
+void GpuSimulation::readback(BodySystem& bodies) {
+    PROFILE_SCOPE("gpu readback");
+    SDL_GL_MakeCurrent(m_window, m_context);
+    m_staging.resize(m_count * 4);
+    size_t bytes = m_count * 4 * sizeof(float);
+
+    // reading a buffer waits for the dispatches that write it
+    gl.glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[0]);
+    gl.glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, m_staging.data());
+    for (size_t i = 0; i < m_count; ++i) {
+        bodies.x[i] = m_staging[i * 4 + 0];
+        bodies.y[i] = m_staging[i * 4 + 1];
+        bodies.z[i] = m_staging[i * 4 + 2];
+    }
+    gl.glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffers[1]);
+    gl.glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, m_staging.data());
+    for (size_t i = 0; i < m_count; ++i) {
+        bodies.vx[i] = m_staging[i * 4 + 0];
+        bodies.vy[i] = m_staging[i * 4 + 1];
+        bodies.vz[i] = m_staging[i * 4 + 2];
+    }
+}
+
+#else
+
+std::unique_ptr<GpuSimulation> GpuSimulation::create(const BodySystem&, std::string& error) {
+    error = "built without the gpu backend (NBODY_ENABLE_GPU=OFF, or no SDL2)";
+    return nullptr;
+}
+
+GpuSimulation::~GpuSimulation() = default;
+void GpuSimulation::step(float, int) {}
+void GpuSimulation::readback(BodySystem&) {}
+bool GpuSimulation::init(const BodySystem&, std::string&) { return false; }
+
+#endif
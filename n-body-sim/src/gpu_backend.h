@@ -0,0 +1,72 @@
+#pragma once
+#include <cstring>
+#include <memory>
+#include <string>
+#include "body_system.h"
+
+struct SDL_Window;
+
+enum class Backend {
+    Cpu,  // force engines and integrators on the host
+    Gpu,  // OpenGL 4.3 compute, all-pairs leapfrog on the device
+};
+
+inline const char* backendName(Backend backend) {
+    switch (backend) {
+    case Backend::Cpu: return "cpu";
+    case Backend::Gpu: return "gpu";
+    }
+    return "unknown";
+}
+
+inline bool parseBackend(const char* text, Backend& backend) {
+    if (std::strcmp(text, "cpu") == 0) {
+        backend = Backend::Cpu;
+    } else if (std::strcmp(text, "gpu") == 0) {
+        backend = Backend::Gpu;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// the body arrays are uploaded once into shader storage buffers and stay on the
+// device; forces use a tiled all-pairs kernel with the same 1m cutoff as the CPU
+// kernels and integration is kick-drift-kick leapfrog. the host only sees the
+// state after readback()
+class GpuSimulation {
+public:
+    // initializes SDL video itself and opens a hidden window for its own GL
+    // context; returns null and fills error when that or compute shaders are
+    // unavailable, or when the backend was not built (NBODY_ENABLE_GPU=OFF or no SDL2)
+    static std::unique_ptr<GpuSimulation> create(const BodySystem& bodies, std::string& error);
+    ~GpuSimulation();
+
+    GpuSimulation(const GpuSimulation&) = delete;
+    GpuSimulation& operator=(const GpuSimulation&) = delete;
+
+    const std::string& deviceName() const { return m_deviceName; }
+
+    // queues `steps` leapfrog steps of dt; does not wait for the device
+    void step(float dt, int steps);
+
+    // copies device positions and velocities into bodies, which must be the
+    // system the simulation was created from (same count, mass and order)
+    void readback(BodySystem& bodies);
+
+private:
+    GpuSimulation() = default;
+    bool init(const BodySystem& bodies, std::string& error);
+
+    bool m_videoInitialized = false;
+    SDL_Window* m_window = nullptr;
+    void* m_context = nullptr;
+    std::string m_deviceName;
+
+    size_t m_count = 0;
+    size_t m_paddedCount = 0;  // multiple of the work group size, padding is massless
+    unsigned m_buffers[3] = {};  // position+mass, velocity, acceleration as vec4 arrays
+    unsigned m_forceProgram = 0;
+    unsigned m_integrateProgram = 0;
+    std::vector<float> m_staging;
+};
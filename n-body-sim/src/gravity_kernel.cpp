@@ -0,0 +1,202 @@
+#include "gravity_kernel.h"
+#include <algorithm>
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define GRAVITY_KERNEL_AVX2 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define GRAVITY_KERNEL_NEON 1
+#include <arm_neon.h>
+#endif
+
+// every kernel computes the acceleration at n target points (tx, ty, tz)
+// caused by all bodies; a target sitting exactly on a body skips it
+static void accumulateScalar(const BodySystem& bodies, const float* tx, const float* ty, const float* tz, size_t n,
+                             float* ax, float* ay, float* az) {
+    const float* x = bodies.x.data();
+    const float* y = bodies.y.data();
+    const float* z = bodies.z.data();
+    const float* m = bodies.mass.data();
+
+    for (size_t i = 0; i < n; ++i) {
+        float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+        for (size_t j = 0; j < bodies.count; ++j) {
+            float dx = x[j] - tx[i];
+            float dy = y[j] - ty[i];
+            float dz = z[j] - tz[i];
+            float distSq = dx * dx + dy * dy + dz * dz;
+            // also skips i == j
+            if (distSq < 1.0f) continue;
+            float invDist = 1.0f / std::sqrt(distSq);
+            float s = G * m[j] * invDist * invDist * invDist;
+            sx += dx * s;
+            sy += dy * s;
+            sz += dz * s;
+        }
+        ax[i] = sx;
+        ay[i] = sy;
+        az[i] = sz;
+    }
+}
+
+void accumulateAllPairsScalar(const BodySystem& bodies, size_t begin, size_t end, float* ax, float* ay, float* az) {
+    accumulateScalar(bodies, bodies.x.data() + begin, bodies.y.data() + begin, bodies.z.data() + begin, end - begin,
+                     ax + begin, ay + begin, az + begin);
+}
+
+#if GRAVITY_KERNEL_AVX2
+// eight i bodies per register, every j broadcast; rsqrt plus one Newton step
+// is accurate to ~1e-7 relative, well below the float position error
+__attribute__((target("avx2,fma")))
+static void accumulateAvx2(const BodySystem& bodies, const float* tx, const float* ty, const float* tz, size_t n,
+                           float* ax, float* ay, float* az) {
+    const float* x = bodies.x.data();
+    const float* y = bodies.y.data();
+    const float* z = bodies.z.data();
+    const float* m = bodies.mass.data();
+
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 threeHalves = _mm256_set1_ps(1.5f);
+
+    for (size_t i = 0; i < n; i += 8) {
+        __m256 xi = _mm256_load_ps(tx + i);
+        __m256 yi = _mm256_load_ps(ty + i);
+        __m256 zi = _mm256_load_ps(tz + i);
+        __m256 sx = _mm256_setzero_ps();
+        __m256 sy = _mm256_setzero_ps();
+        __m256 sz = _mm256_setzero_ps();
+
+        for (size_t j = 0; j < bodies.count; ++j) {
+            __m256 dx = _mm256_sub_ps(_mm256_set1_ps(x[j]), xi);
+            __m256 dy = _mm256_sub_ps(_mm256_set1_ps(y[j]), yi);
+            __m256 dz = _mm256_sub_ps(_mm256_set1_ps(z[j]), zi);
+            __m256 distSq = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+
+            __m256 inv = _mm256_rsqrt_ps(distSq);
+            inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(_mm256_mul_ps(half, distSq), _mm256_mul_ps(inv, inv), threeHalves));
+            __m256 s = _mm256_mul_ps(_mm256_set1_ps(G * m[j]), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+            s = _mm256_and_ps(s, _mm256_cmp_ps(distSq, one, _CMP_GE_OQ));
+
+            sx = _mm256_fmadd_ps(dx, s, sx);
+            sy = _mm256_fmadd_ps(dy, s, sy);
+            sz = _mm256_fmadd_ps(dz, s, sz);
+        }
+        _mm256_store_ps(ax + i, sx);
+        _mm256_store_ps(ay + i, sy);
+        _mm256_store_ps(az + i, sz);
+    }
+}
+
+static bool cpuHasAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+}
+#endif
+
+#if GRAVITY_KERNEL_NEON
+static void accumulateNeon(const BodySystem& bodies, const float* tx, const float* ty, const float* tz, size_t n,
+                           float* ax, float* ay, float* az) {
+    const float* x = bodies.x.data();
+    const float* y = bodies.y.data();
+    const float* z = bodies.z.data();
+    const float* m = bodies.mass.data();
+
+    const float32x4_t one = vdupq_n_f32(1.0f);
+
+    for (size_t i = 0; i < n; i += 4) {
+        float32x4_t xi = vld1q_f32(tx + i);
+        float32x4_t yi = vld1q_f32(ty + i);
+        float32x4_t zi = vld1q_f32(tz + i);
+        float32x4_t sx = vdupq_n_f32(0.0f);
+        float32x4_t sy = vdupq_n_f32(0.0f);
+        float32x4_t sz = vdupq_n_f32(0.0f);
+
+        for (size_t j = 0; j < bodies.count; ++j) {
+            float32x4_t dx = vsubq_f32(vdupq_n_f32(x[j]), xi);
+            float32x4_t dy = vsubq_f32(vdupq_n_f32(y[j]), yi);
+            float32x4_t dz = vsubq_f32(vdupq_n_f32(z[j]), zi);
+            float32x4_t distSq = vmlaq_f32(vmlaq_f32(vmulq_f32(dx, dx), dy, dy), dz, dz);
+
+            // the estimate is only ~8 bits, two Newton steps bring it to float precision
+            float32x4_t inv = vrsqrteq_f32(distSq);
+            inv = vmulq_f32(inv, vrsqrtsq_f32(vmulq_f32(distSq, inv), inv));
+            inv = vmulq_f32(inv, vrsqrtsq_f32(vmulq_f32(distSq, inv), inv));
+            float32x4_t s = vmulq_f32(vdupq_n_f32(G * m[j]), vmulq_f32(inv, vmulq_f32(inv, inv)));
+            uint32x4_t near = vcltq_f32(distSq, one);
+            s = vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(s), near));
+
+            sx = vmlaq_f32(sx, dx, s);
+            sy = vmlaq_f32(sy, dy, s);
+            sz = vmlaq_f32(sz, dz, s);
+        }
+        vst1q_f32(ax + i, sx);
+        vst1q_f32(ay + i, sy);
+        vst1q_f32(az + i, sz);
+    }
+}
+#endif
+
+void accumulateAllPairsAt(const BodySystem& bodies, const float* tx, const float* ty, const float* tz, size_t n,
+                          float* ax, float* ay, float* az) {
+#if GRAVITY_KERNEL_AVX2
+    if (cpuHasAvx2()) {
+        accumulateAvx2(bodies, tx, ty, tz, n, ax, ay, az);
+        return;
+    }
+    accumulateScalar(bodies, tx, ty, tz, n, ax, ay, az);
+#elif GRAVITY_KERNEL_NEON
+    accumulateNeon(bodies, tx, ty, tz, n, ax, ay, az);
+#else
+    accumulateScalar(bodies, tx, ty, tz, n, ax, ay, az);
+#endif
+}
+
+void accumulateAllPairs(BodySystem& bodies, size_t begin, size_t end) {
+    accumulateAllPairsAt(bodies, bodies.x.data() + begin, bodies.y.data() + begin, bodies.z.data() + begin, end - begin,
+                         bodies.ax.data() + begin, bodies.ay.data() + begin, bodies.az.data() + begin);
+}
+
+// scalar, the double sums are what this path is for and it only backs the
+// all-pairs reference
+static void accumulateDouble(BodySystem& bodies, size_t i) {
+    const double* x = bodies.px.data();
+    const double* y = bodies.py.data();
+    const double* z = bodies.pz.data();
+    const float* m = bodies.mass.data();
+    const double xi = x[i], yi = y[i], zi = z[i];
+
+    double sx = 0.0, sy = 0.0, sz = 0.0;
+    for (size_t j = 0; j < bodies.count; ++j) {
+        double dx = x[j] - xi;
+        double dy = y[j] - yi;
+        double dz = z[j] - zi;
+        double distSq = dx * dx + dy * dy + dz * dz;
+        if (distSq < 1.0) continue;
+        double invDist = 1.0 / std::sqrt(distSq);
+        double s = (double)G * m[j] * invDist * invDist * invDist;
+        sx += dx * s;
+        sy += dy * s;
+        sz += dz * s;
+    }
+    bodies.setAcceleration(i, { sx, sy, sz });
+}
+
+void accumulateAllPairsDouble(BodySystem& bodies, size_t begin, size_t end) {
+    for (size_t i = begin; i < std::min(end, bodies.count); ++i) accumulateDouble(bodies, i);
+    for (size_t i = std::max(begin, bodies.count); i < end; ++i) bodies.ax[i] = bodies.ay[i] = bodies.az[i] = 0.0f;
+}
+
+void accumulateAllPairsDouble(BodySystem& bodies, const std::uint32_t* indices, size_t n) {
+    for (size_t k = 0; k < n; ++k) accumulateDouble(bodies, indices[k]);
+}
+
+const char* gravityKernelName() {
+#if GRAVITY_KERNEL_AVX2
+    if (cpuHasAvx2()) return "avx2";
+#elif GRAVITY_KERNEL_NEON
+    return "neon";
+#endif
+    return "scalar";
+}
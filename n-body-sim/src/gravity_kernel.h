@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include "body_system.h"
+
+// all-pairs accelerations of bodies [begin, end) against every body in the
+// system, written to bodies.ax/ay/az; begin and end must be multiples of
+// SIMD_WIDTH, so end is usually paddedCount()
+void accumulateAllPairs(BodySystem& bodies, size_t begin, size_t end);
+
+// accelerations at n arbitrary points caused by every body, e.g. a gathered
+// subset of the bodies themselves. n must be a multiple of SIMD_WIDTH and all
+// six arrays SIMD_ALIGNMENT aligned; a point exactly on a body ignores it
+void accumulateAllPairsAt(const BodySystem& bodies, const float* tx, const float* ty, const float* tz, size_t n,
+                          float* ax, float* ay, float* az);
+
+// same contract as accumulateAllPairs, always scalar; kept as the reference for the vector paths
+void accumulateAllPairsScalar(const BodySystem& bodies, size_t begin, size_t end, float* ax, float* ay, float* az);
+
+// double precision all-pairs: reads px/py/pz and sums in double, so it needs
+// a system in Precision::Double. writes pax/pay/paz and their float mirrors
+// for bodies [begin, end) clamped to count, or for the listed bodies
+void accumulateAllPairsDouble(BodySystem& bodies, size_t begin, size_t end);
+void accumulateAllPairsDouble(BodySystem& bodies, const std::uint32_t* indices, size_t n);
+
+// name of the kernel accumulateAllPairs dispatches to on this machine
+const char* gravityKernelName();
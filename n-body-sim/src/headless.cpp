@@ -0,0 +1,167 @@
+#include "headless.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include "alloc_counter.h"
+#include "collisions.h"
+#include "gpu_backend.h"
+#include "gravity_kernel.h"
+#include "integrator.h"
+#include "profiler.h"
+#include "scenario.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+
+// splits a pattern around its step token, a printf-like %d, %Nd or %0Nd. a
+// pattern without '%' has no token; any other '%' makes it invalid
+struct StepPattern {
+    bool hasStep = false;
+    size_t begin = 0, end = 0;  // the token's characters
+    int width = 0;
+    bool zeroPad = false;
+};
+
+static bool parseStepPattern(const std::string& pattern, StepPattern& parsed) {
+    parsed = StepPattern();
+    for (size_t i = pattern.find('%'); i != std::string::npos; i = pattern.find('%', i)) {
+        if (parsed.hasStep) return false;
+        size_t j = i + 1;
+        if (j < pattern.size() && pattern[j] == '0') {
+            parsed.zeroPad = true;
+            ++j;
+        }
+        size_t digits = j;
+        while (j < pattern.size() && pattern[j] >= '0' && pattern[j] <= '9') {
+            parsed.width = parsed.width * 10 + (pattern[j] - '0');
+            ++j;
+        }
+        if (j - digits > 2 || j >= pattern.size() || pattern[j] != 'd') return false;
+        parsed.hasStep = true;
+        parsed.begin = i;
+        parsed.end = i = j + 1;
+    }
+    return true;
+}
+
+bool validOutputPattern(const std::string& pattern) {
+    StepPattern parsed;
+    return parseStepPattern(pattern, parsed);
+}
+
+std::string outputPath(const std::string& pattern, long long step) {
+    StepPattern parsed;
+    if (!parseStepPattern(pattern, parsed) || !parsed.hasStep) return pattern;
+    // steps are never negative, so padding goes in front of the digits
+    std::string digits = std::to_string(step);
+    if (digits.size() < (size_t)parsed.width) digits.insert(0, parsed.width - digits.size(), parsed.zeroPad ? '0' : ' ');
+    return pattern.substr(0, parsed.begin) + digits + pattern.substr(parsed.end);
+}
+
+int runHeadless(const SimOptions& options) {
+    ThreadPool pool(options.threads);
+    BodySystem bodies;
+    double time = 0.0;
+    long long firstStep = 0;
+    // set before loading so CSV rows are read in double
+    bodies.setPrecision(options.precision);
+    auto setupStart = std::chrono::steady_clock::now();
+    if (options.inputPath.empty()) {
+        bodies = generateScenario(options.scenario, &pool);
+    } else if (!loadBodies(options.inputPath, bodies, time, firstStep)) {
+        return 1;
+    }
+    bodies.setPrecision(options.precision);
+    double setupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setupStart).count();
+    std::cout << "initial conditions from "
+              << (options.inputPath.empty() ? scenarioName(options.scenario.kind) : options.inputPath.c_str())
+              << " in " << setupMs << " ms" << std::endl;
+
+    std::unique_ptr<ForceEngine> engine = createForceEngine(options.force, &pool);
+    Integrator integrator(options.integrator);
+
+    // the gpu state is only read back for outputs
+    std::unique_ptr<GpuSimulation> gpu;
+    if (options.backend == Backend::Gpu) {
+        std::string error;
+        gpu = GpuSimulation::create(bodies, error);
+        if (!gpu) std::cerr << "gpu backend unavailable, using the cpu: " << error << "\n";
+    }
+
+    CollisionSystem collisions;
+    size_t merged = 0;
+    if (gpu && options.collisions) std::cerr << "--collisions has no effect with --backend=gpu\n";
+    if (gpu && bodies.precise()) {
+        std::cerr << "--precision=" << precisionName(bodies.precision()) << " has no effect with --backend=gpu\n";
+        bodies.setPrecision(Precision::Single);
+    }
+
+    SnapshotWriter snapshots;
+    if (!options.snapshotPath.empty()) {
+        if (!snapshots.open(options.snapshotPath, options.appendSnapshot)) return 1;
+        // a series starts with the initial state; an appended one already ends with it
+        // when the run continues from its last frame
+        if (!snapshots.endsAtStep(firstStep) && !snapshots.writeFrame(bodies, time, firstStep)) return 1;
+    }
+
+    std::cout << bodies.count << " bodies, " << options.steps << " steps of " << options.dt << " s, ";
+    if (gpu) {
+        std::cout << "all-pairs leapfrog on " << gpu->deviceName() << std::endl;
+    } else {
+        std::cout << engine->name() << " (" << gravityKernelName() << " kernel, " << pool.threadCount() << " threads), "
+                  << integratorName(options.integrator) << ", " << precisionName(bodies.precision()) << " precision" << std::endl;
+    }
+
+    long long lastStep = firstStep + options.steps;
+    // the first steps size every buffer and let the frame arenas settle into
+    // one block; after that a step should not allocate
+    const long long warmupSteps = 8;
+    std::uint64_t steadyAllocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long step = firstStep + 1; step <= lastStep; ++step) {
+        std::uint64_t allocationsBefore = heapAllocationCount();
+        if (gpu) {
+            gpu->step(options.dt, 1);
+        } else {
+            integrator.step(bodies, *engine, options.dt);
+            if (options.collisions) {
+                size_t removed = collisions.resolve(bodies);
+                if (removed) integrator.invalidate();
+                merged += removed;
+            }
+        }
+        time += options.dt;
+        if (step - firstStep > warmupSteps) steadyAllocations += heapAllocationCount() - allocationsBefore;
+
+        bool output = step == lastStep || (options.outputEvery > 0 && (step - firstStep) % options.outputEvery == 0);
+        if (!output) continue;
+        if (gpu) gpu->readback(bodies);
+        if (!options.outputPath.empty() && !writeBodiesCsv(outputPath(options.outputPath, step), bodies)) return 1;
+        if (!options.snapshotPath.empty() && !snapshots.writeFrame(bodies, time, step)) {
+            std::cerr << "cannot append to " << options.snapshotPath << "\n";
+            return 1;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "simulated " << options.steps * (double)options.dt << " s in " << seconds << " s wall ("
+              << (seconds > 0.0 ? options.steps / seconds : 0.0) << " steps/s)" << std::endl;
+    if (!gpu) {
+        std::cout << integrator.forceEvaluations() << " body force evaluations ("
+                  << integrator.forceEvaluations() / (double)std::max<size_t>(1, bodies.count) / options.steps
+                  << " per body and step)" << std::endl;
+    }
+    if (options.collisions) std::cout << merged << " bodies merged, " << bodies.count << " left" << std::endl;
+
+    if (options.checkAllocs) {
+        long long checked = std::max(0LL, options.steps - warmupSteps);
+        std::cout << steadyAllocations << " heap allocations in " << checked << " steady-state steps" << std::endl;
+    }
+
+    if (PROFILING_ENABLED) Profiler::instance().printSummary(std::cout);
+    if (!options.profileTracePath.empty() && !Profiler::instance().writeChromeTrace(options.profileTracePath)) {
+        std::cerr << "cannot write " << options.profileTracePath << "\n";
+        return 1;
+    }
+    return options.checkAllocs && steadyAllocations > 0 ? 1 : 0;
+}
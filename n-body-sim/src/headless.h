@@ -0,0 +1,10 @@
+#pragma once
+#include "options.h"
+
+// runs the simulation without SDL; returns the process exit code
+int runHeadless(const SimOptions& options);
+
+// expands the step token of a pattern such as "state_%06d.csv"; the token is
+// %d, %Nd or %0Nd and may appear once, other '%' sequences are not allowed
+std::string outputPath(const std::string& pattern, long long step);
+bool validOutputPattern(const std::string& pattern);
@@ -0,0 +1,14 @@
+// entry point without SDL: headless and MPI runs only, no window
+#include <iostream>
+#include "distributed.h"
+#include "headless.h"
+#include "options.h"
+
+int main(int argc, char* argv[]) {
+    SimOptions options;
+    if (!parseOptions(argc, argv, options)) return 1;
+    if (options.distributed) return runDistributed(argc, argv, options);
+    if (options.headless) return runHeadless(options);
+    std::cerr << "nbody_headless has no window, run it with --headless or --mpi\n";
+    return 1;
+}
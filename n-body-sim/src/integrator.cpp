@@ -0,0 +1,221 @@
+#include "integrator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "profiler.h"
+
+// w1 = 1 / (2 - 2^(1/3)), w0 = 1 - 2 * w1
+#define YOSHIDA_W1 1.3512071919596578
+#define YOSHIDA_W0 (-1.7024143839193153)
+
+const char* integratorName(IntegratorKind kind) {
+    switch (kind) {
+    case IntegratorKind::Euler: return "euler";
+    case IntegratorKind::Leapfrog: return "leapfrog";
+    case IntegratorKind::Yoshida4: return "yoshida4";
+    case IntegratorKind::Block: return "block";
+    }
+    return "unknown";
+}
+
+bool parseIntegrator(const char* text, IntegratorKind& kind) {
+    if (std::strcmp(text, "euler") == 0) {
+        kind = IntegratorKind::Euler;
+    } else if (std::strcmp(text, "leapfrog") == 0 || std::strcmp(text, "verlet") == 0) {
+        kind = IntegratorKind::Leapfrog;
+    } else if (std::strcmp(text, "yoshida4") == 0 || std::strcmp(text, "yoshida") == 0) {
+        kind = IntegratorKind::Yoshida4;
+    } else if (std::strcmp(text, "block") == 0) {
+        kind = IntegratorKind::Block;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// float force engines leave a double precision system with only float
+// accelerations; widen those so the kicks can read pax/pay/paz
+static void evaluate(ForceEngine& engine, BodySystem& bodies) {
+    engine.computeAccelerations(bodies);
+    if (!engine.writesPreciseAccelerations()) bodies.storeAccelerationsAsPrecise();
+}
+
+static void evaluate(ForceEngine& engine, BodySystem& bodies, const std::vector<std::uint32_t>& active) {
+    engine.computeAccelerations(bodies, active);
+    if (!engine.writesPreciseAccelerations()) bodies.storeAccelerationsAsPrecise(active);
+}
+
+static void kickBody(BodySystem& bodies, size_t i, double dt) {
+    if (bodies.precise()) {
+        Vec3d a = bodies.preciseAcceleration(i);
+        bodies.pvx[i] += a.x * dt;
+        bodies.pvy[i] += a.y * dt;
+        bodies.pvz[i] += a.z * dt;
+        bodies.vx[i] = (float)bodies.pvx[i];
+        bodies.vy[i] = (float)bodies.pvy[i];
+        bodies.vz[i] = (float)bodies.pvz[i];
+        return;
+    }
+    float h = (float)dt;
+    bodies.vx[i] += bodies.ax[i] * h;
+    bodies.vy[i] += bodies.ay[i] * h;
+    bodies.vz[i] += bodies.az[i] * h;
+}
+
+// mixed precision updates the double state and refreshes the float mirrors
+// from it, so rounding never accumulates in the floats
+void kick(BodySystem& bodies, double dt) {
+    if (bodies.precise()) {
+        for (size_t i = 0; i < bodies.count; ++i) kickBody(bodies, i, dt);
+        return;
+    }
+    float h = (float)dt;
+    for (size_t i = 0; i < bodies.count; ++i) {
+        bodies.vx[i] += bodies.ax[i] * h;
+        bodies.vy[i] += bodies.ay[i] * h;
+        bodies.vz[i] += bodies.az[i] * h;
+    }
+}
+
+void drift(BodySystem& bodies, double dt) {
+    if (bodies.precise()) {
+        for (size_t i = 0; i < bodies.count; ++i) {
+            bodies.px[i] += bodies.pvx[i] * dt;
+            bodies.py[i] += bodies.pvy[i] * dt;
+            bodies.pz[i] += bodies.pvz[i] * dt;
+            bodies.x[i] = (float)bodies.px[i];
+            bodies.y[i] = (float)bodies.py[i];
+            bodies.z[i] = (float)bodies.pz[i];
+        }
+        return;
+    }
+    float h = (float)dt;
+    for (size_t i = 0; i < bodies.count; ++i) {
+        bodies.x[i] += bodies.vx[i] * h;
+        bodies.y[i] += bodies.vy[i] * h;
+        bodies.z[i] += bodies.vz[i] * h;
+    }
+}
+
+void Integrator::kickDriftKick(BodySystem& bodies, ForceEngine& engine, double dt) {
+    if (!m_accelerationsValid) {
+        evaluate(engine, bodies);
+        m_forceEvaluations += bodies.count;
+        m_accelerationsValid = true;
+    }
+    kick(bodies, 0.5 * dt);
+    drift(bodies, dt);
+    evaluate(engine, bodies);
+    m_forceEvaluations += bodies.count;
+    kick(bodies, 0.5 * dt);
+}
+
+// largest power-of-two stride below the body's criterion step that also starts
+// on a multiple of itself, so every level stays aligned with the coarser ones.
+// eps is the body radius, or the 1m force cutoff for point masses
+std::uint32_t Integrator::blockStride(const BodySystem& bodies, size_t i, float dt, std::uint32_t now) const {
+    const std::uint32_t ticks = 1u << BLOCK_MAX_LEVEL;
+    float accel = bodies.acceleration(i).length();
+    float eps = std::max(1.0f, bodies.radius[i]);
+    std::uint32_t stride = ticks;
+    if (accel > 0.0f) {
+        float wanted = std::sqrt(2.0f * BLOCK_ETA * eps / accel) / dt * ticks;
+        while (stride > 1 && (float)stride > wanted) stride >>= 1;
+    }
+    while (now % stride != 0) stride >>= 1;
+    return stride;
+}
+
+// hierarchical kick-drift-kick: everything drifts to the next time any body's
+// step ends, only those bodies get new forces, and each is kicked by its own
+// step. at the start and end of dt all bodies are synchronized
+void Integrator::blockStep(BodySystem& bodies, ForceEngine& engine, float dt) {
+    const std::uint32_t ticks = 1u << BLOCK_MAX_LEVEL;
+    const double tick = (double)dt / ticks;
+    size_t n = bodies.count;
+    if (!m_accelerationsValid || m_stride.size() != n) {
+        evaluate(engine, bodies);
+        m_forceEvaluations += n;
+        m_accelerationsValid = true;
+        m_stride.resize(n);
+        for (size_t i = 0; i < n; ++i) m_stride[i] = blockStride(bodies, i, dt, 0);
+    }
+
+    // opening half kicks
+    for (size_t i = 0; i < n; ++i) kickBody(bodies, i, 0.5 * tick * m_stride[i]);
+
+    std::uint32_t now = 0;
+    while (now < ticks) {
+        std::uint32_t next = ticks;
+        for (size_t i = 0; i < n; ++i) next = std::min(next, (now / m_stride[i] + 1) * m_stride[i]);
+        drift(bodies, (next - now) * tick);
+        now = next;
+
+        m_active.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (now % m_stride[i] == 0) m_active.push_back((std::uint32_t)i);
+        }
+        evaluate(engine, bodies, m_active);
+        m_forceEvaluations += m_active.size();
+
+        // closing half kick of the step that ended, opening half of the next
+        // one, which is chosen from the new acceleration
+        for (std::uint32_t i : m_active) {
+            std::uint32_t stride = blockStride(bodies, i, dt, now);
+            kickBody(bodies, i, 0.5 * tick * (m_stride[i] + (now < ticks ? stride : 0)));
+            m_stride[i] = stride;
+        }
+    }
+}
+
+void Integrator::step(BodySystem& bodies, ForceEngine& engine, float dt) {
+    PROFILE_SCOPE("integrator step");
+    switch (m_kind) {
+    case IntegratorKind::Euler:
+        evaluate(engine, bodies);
+        m_forceEvaluations += bodies.count;
+        kick(bodies, dt);
+        drift(bodies, dt);
+        // the stored accelerations belong to the old positions
+        m_accelerationsValid = false;
+        break;
+    case IntegratorKind::Leapfrog:
+        kickDriftKick(bodies, engine, dt);
+        break;
+    case IntegratorKind::Yoshida4:
+        kickDriftKick(bodies, engine, YOSHIDA_W1 * dt);
+        kickDriftKick(bodies, engine, YOSHIDA_W0 * dt);
+        kickDriftKick(bodies, engine, YOSHIDA_W1 * dt);
+        break;
+    case IntegratorKind::Block:
+        blockStep(bodies, engine, dt);
+        break;
+    }
+}
+
+void PositionHistory::capture(const BodySystem& bodies) {
+    x.assign(bodies.x.begin(), bodies.x.begin() + bodies.count);
+    y.assign(bodies.y.begin(), bodies.y.begin() + bodies.count);
+    z.assign(bodies.z.begin(), bodies.z.begin() + bodies.count);
+}
+
+Vec3 PositionHistory::interpolate(const BodySystem& bodies, size_t i, float alpha) const {
+    if (i >= x.size()) return bodies.position(i);
+    return {
+        x[i] + (bodies.x[i] - x[i]) * alpha,
+        y[i] + (bodies.y[i] - y[i]) * alpha,
+        z[i] + (bodies.z[i] - z[i]) * alpha,
+    };
+}
+
+int FixedTimestep::advance(double frameSeconds) {
+    accumulator += frameSeconds * timeScale;
+    int steps = (int)std::floor(accumulator / dt);
+    if (steps > maxStepsPerFrame) {
+        // falling behind: drop the backlog instead of spiraling
+        steps = maxStepsPerFrame;
+        accumulator = steps * (double)dt;
+    }
+    accumulator -= steps * (double)dt;
+    return steps;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "body_system.h"
+#include "force_engine.h"
+
+enum class IntegratorKind {
+    Euler,     // semi-implicit (symplectic) Euler, first order
+    Leapfrog,  // kick-drift-kick velocity Verlet, second order
+    Yoshida4,  // three leapfrog substeps, fourth order
+    Block,     // leapfrog with per-body power-of-two substeps of dt
+};
+
+// finest block substep is dt / 2^BLOCK_MAX_LEVEL
+#define BLOCK_MAX_LEVEL 12
+// accuracy parameter of the block step criterion dt_i = sqrt(2 eta eps / |a_i|)
+#define BLOCK_ETA 0.02f
+
+const char* integratorName(IntegratorKind kind);
+bool parseIntegrator(const char* text, IntegratorKind& kind);
+
+class Integrator {
+public:
+    explicit Integrator(IntegratorKind kind) : m_kind(kind) {}
+
+    IntegratorKind kind() const { return m_kind; }
+    void setKind(IntegratorKind kind) { m_kind = kind; }
+
+    // advances the system by exactly dt
+    void step(BodySystem& bodies, ForceEngine& engine, float dt);
+
+    // leapfrog reuses the closing accelerations of the previous step; call
+    // this whenever bodies are added/removed or moved outside of step()
+    void invalidate() { m_accelerationsValid = false; }
+
+    // bodies whose acceleration was evaluated so far, summed over all steps
+    std::uint64_t forceEvaluations() const { return m_forceEvaluations; }
+
+private:
+    void kickDriftKick(BodySystem& bodies, ForceEngine& engine, double dt);
+    void blockStep(BodySystem& bodies, ForceEngine& engine, float dt);
+    std::uint32_t blockStride(const BodySystem& bodies, size_t i, float dt, std::uint32_t now) const;
+
+    IntegratorKind m_kind;
+    bool m_accelerationsValid = false;
+    std::uint64_t m_forceEvaluations = 0;
+
+    // block steps: each body's step in units of dt / 2^BLOCK_MAX_LEVEL
+    std::vector<std::uint32_t> m_stride;
+    std::vector<std::uint32_t> m_active;
+};
+
+// dt is double so fractional substeps keep their exact share of the step
+void kick(BodySystem& bodies, double dt);
+void drift(BodySystem& bodies, double dt);
+
+// positions before the most recent physics step, so rendering can blend
+// between the previous and current state
+struct PositionHistory {
+    AlignedVector<float> x, y, z;
+
+    void capture(const BodySystem& bodies);
+    Vec3 interpolate(const BodySystem& bodies, size_t i, float alpha) const;
+};
+
+// fixed physics step fed from variable frame times
+struct FixedTimestep {
+    float dt = 1.0f / 120.0f;
+    float timeScale = 1.0f;
+    int maxStepsPerFrame = 32;
+    double accumulator = 0.0;
+
+    // queues frameSeconds of real time, returns how many steps to run now
+    int advance(double frameSeconds);
+    // fraction of a step left in the accumulator, for interpolation
+    float alpha() const { return (float)(accumulator / dt); }
+};
@@ -3,182 +3,273 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include "body_system.h"
+#include "force_engine.h"
+#include "gpu_backend.h"
+#include "gravity_kernel.h"
+#include "integrator.h"
+#include "alloc_counter.h"
+#include "barnes_hut.h"
+#include "collisions.h"
+#include "distributed.h"
+#include "fmm.h"
+#include "headless.h"
+#include "options.h"
+#include "pipeline.h"
+#include "presenter.h"
+#include "profiler.h"
+#include "profiler_overlay.h"
+#include "render.h"
+#include "scenario.h"
+#include "thread_pool.h"
 
+// initial window size, the window can be resized
 #define WIDTH 900
 #define HEIGHT 600
-#define G 6.67430e-11f
-#define EARTH_MASS 5.972e24f
-#define MOON_MASS 7.348e22f
-#define EARTH_RADIUS 6371000.0f
-#define MOON_RADIUS 1737000.0f
-#define EARTH_MOON_DISTANCE 384400000.0f
-#define SCALE 1e-5f
-#define RADIUS_SCALE 300.0f
-
-struct Vec3 {
-    float x, y, z;
-
-    Vec3 operator+(const Vec3& o) const { return { x + o.x, y + o.y, z + o.z }; }
-    Vec3 operator-(const Vec3& o) const { return { x - o.x, y - o.y, z - o.z }; }
-    Vec3 operator*(float s) const { return { x * s, y * s, z * s }; }
-    Vec3& operator+=(const Vec3& o) { x += o.x; y += o.y; z += o.z; return *this; }
-    Vec3& operator-=(const Vec3& o) { x -= o.x; y -= o.y; z -= o.z; return *this; }
-
-    float lengthSquared() const { return x * x + y * y + z * z; }
-    float length() const { return std::sqrt(lengthSquared()); }
-    Vec3 normalized() const {
-        float len = length();
-        return len > 0.0f ? *this * (1.0f / len) : Vec3{0, 0, 0};
-    }
-};
-
-struct Object {
-    Vec3 position;
-    Vec3 velocity;
-    float radius;
-    float mass;
-    Uint32 color;
-};
-
-Vec3 cameraPos = { 0.0f, 0.0f, -EARTH_MOON_DISTANCE * SCALE * 2.5f };
-Vec3 cameraRot = { 0.3f, 0.0f, 0.0f };
-Vec3 lightPos = { 0.0f, 0.0f, -EARTH_MOON_DISTANCE * SCALE * 3.0f };
-
-Vec3 rotateY(const Vec3& v, float angle) {
-    float c = std::cos(angle), s = std::sin(angle);
-    return { c * v.x + s * v.z, v.y, -s * v.x + c * v.z };
-}
 
-Vec3 rotateX(const Vec3& v, float angle) {
-    float c = std::cos(angle), s = std::sin(angle);
-    return { v.x, c * v.y - s * v.z, s * v.y + c * v.z };
-}
+int main(int argc, char* argv[]) {
+    SimOptions options;
+    if (!parseOptions(argc, argv, options)) return 1;
+    if (options.distributed) return runDistributed(argc, argv, options);
+    if (options.headless) return runHeadless(options);
 
-Vec3 worldToCamera(const Vec3& pos) {
-    Vec3 relative = pos - cameraPos;
-    relative = rotateX(relative, cameraRot.x);
-    relative = rotateY(relative, cameraRot.y);
-    return relative;
-}
+    ThreadPool pool(options.threads);
+    BodySystem bodies;
+    double startTime = 0.0;
+    long long startStep = 0;
+    // set before loading so CSV rows are read in double
+    bodies.setPrecision(options.precision);
+    if (options.inputPath.empty()) {
+        bodies = generateScenario(options.scenario, &pool);
+    } else if (!loadBodies(options.inputPath, bodies, startTime, startStep)) {
+        return 1;
+    }
+    bodies.setPrecision(options.precision);
 
-Vec3 projectToScreen(const Vec3& pos) {
-    float fov = 500.0f;
-    float factor = fov / (fov + pos.z);
-    return {
-        WIDTH / 2.0f + pos.x * factor,
-        HEIGHT / 2.0f - pos.y * factor,
-        pos.z
-    };
-}
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) return 1;
+    SDL_Window* window = SDL_CreateWindow("Realistic 3D Orbit Simulation", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT,
+                                          SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    if (!window) return 1;
+    // body colors are 0xRRGGBBAA, so the framebuffer is RGBA8888
+    Presenter presenter;
+    std::string presentError;
+    if (!presenter.open(window, SDL_PIXELFORMAT_RGBA8888, options.vsync, presentError)) {
+        std::cerr << presentError << std::endl;
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+    if (options.vsync && !presenter.vsync()) std::cout << "vsync unavailable, presenting immediately" << std::endl;
 
-Uint32 applyShading(Uint32 baseColor, Vec3 normal, Vec3 toLight) {
-    float intensity = std::max(0.0f, normal.normalized().x * toLight.normalized().x + normal.normalized().y * toLight.normalized().y + normal.normalized().z * toLight.normalized().z);
-    float factor = 0.1f + 0.9f * intensity;
-    Uint8 r = (baseColor >> 24) & 0xFF;
-    Uint8 g = (baseColor >> 16) & 0xFF;
-    Uint8 b = (baseColor >> 8) & 0xFF;
-    Uint8 a = baseColor & 0xFF;
-    r = static_cast<Uint8>(r * factor);
-    g = static_cast<Uint8>(g * factor);
-    b = static_cast<Uint8>(b * factor);
-    return (r << 24) | (g << 16) | (b << 8) | a;
-}
+    Camera camera;
+    BodyRenderer renderer;
+    renderer.mode = options.renderMode;
+    renderer.sphereThreshold = options.sphereThreshold;
+    std::unique_ptr<ForceEngine> engine = createForceEngine(options.force, &pool);
+    std::cout << "force solver: " << engine->name() << " (" << gravityKernelName() << " kernel, "
+              << pool.threadCount() << " threads)" << std::endl;
 
-void FillMarker(SDL_Surface* surface, const Vec3& screenPos, Uint32 color) {
-    SDL_Rect rect = { (int)(screenPos.x - 2), (int)(screenPos.y - 2), 4, 4 };
-    SDL_FillRect(surface, &rect, color);
-}
+    Integrator integrator(options.integrator);
+    PositionHistory history;
+    FixedTimestep timestep;
+    timestep.dt = options.dt;
+    timestep.timeScale = options.timeScale;
 
-void FillSphere(SDL_Surface* surface, const Object& obj) {
-    Vec3 camSpace = worldToCamera(obj.position);
-    if (camSpace.z < 1.0f) return;
-    Vec3 screen = projectToScreen(camSpace);
-    FillMarker(surface, screen, 0xFF00FFFF);
-
-    float radius = obj.radius * SCALE * RADIUS_SCALE * (500.0f / (500.0f + camSpace.z));
-    float r2 = radius * radius;
-
-    for (int x = (int)(screen.x - radius); x < (int)(screen.x + radius); ++x) {
-        for (int y = (int)(screen.y - radius); y < (int)(screen.y + radius); ++y) {
-            float dx = x - screen.x;
-            float dy = y - screen.y;
-            float distSq = dx * dx + dy * dy;
-            if (distSq <= r2) {
-                float dz = std::sqrt(std::max(0.0f, r2 - distSq));
-                Vec3 normal = { dx / radius, -dy / radius, dz / radius };
-                Vec3 lightVec = lightPos - obj.position;
-                Uint32 shaded = applyShading(obj.color, normal, lightVec);
-                SDL_Rect pixel = { x, y, 1, 1 };
-                SDL_FillRect(surface, &pixel, shaded);
+    // --backend=gpu keeps the state on the device and reads it back every
+    // --readback-every steps; without a GL 4.3 driver the cpu path takes over
+    std::unique_ptr<GpuSimulation> gpu;
+    if (options.backend == Backend::Gpu) {
+        std::string error;
+        gpu = GpuSimulation::create(bodies, error);
+        if (gpu) {
+            std::cout << "gpu backend: all-pairs leapfrog on " << gpu->deviceName() << ", readback every "
+                      << options.readbackEvery << " steps" << std::endl;
+            if (options.pipeline) std::cout << "--pipeline has no effect with --backend=gpu" << std::endl;
+            if (bodies.precise()) {
+                std::cout << "--precision=" << precisionName(bodies.precision()) << " has no effect with --backend=gpu" << std::endl;
+                bodies.setPrecision(Precision::Single);
             }
+        } else {
+            std::cerr << "gpu backend unavailable, using the cpu: " << error << std::endl;
         }
     }
-}
-
-void applyGravity(Object& a, const Object& b, float dt) {
-    Vec3 diff = b.position - a.position;
-    float distSq = diff.lengthSquared();
-    float dist = std::sqrt(distSq);
-    if (dist < 1.0f) return;
-
-    Vec3 dir = diff * (1.0f / dist);
-    float force = G * (a.mass * b.mass) / distSq;
-    float accel = force / a.mass;
-
-    a.velocity += dir * (accel * dt);
-}
-
-int main() {
-    if (SDL_Init(SDL_INIT_VIDEO) != 0) return 1;
-    SDL_Window* window = SDL_CreateWindow("Realistic 3D Orbit Simulation", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, SDL_WINDOW_SHOWN);
-    if (!window) return 1;
-    SDL_Surface* surface = SDL_GetWindowSurface(window);
-    SDL_Rect screenRect = { 0, 0, WIDTH, HEIGHT };
+    int stepsSinceReadback = 0;
 
-    std::vector<Object> objects = {
-        {{0, 0, 0}, {0, 0, 0}, EARTH_RADIUS, EARTH_MASS, 0xFFFFFFFF},
-        {{EARTH_MOON_DISTANCE, 0, 0}, {0, 1022, 0}, MOON_RADIUS, MOON_MASS, 0xFFCCCCCC},
-    };
+    // with --pipeline the bodies move to a physics thread and this loop only renders
+    std::unique_ptr<PhysicsPipeline> pipeline;
+    if (options.pipeline && !gpu) {
+        pipeline = std::make_unique<PhysicsPipeline>(std::move(bodies), options.force, options.integrator, timestep, pool);
+        pipeline->setCollisions(options.collisions);
+        pipeline->start();
+    }
+    PositionHistory noHistory;
+    CollisionSystem collisions;
+    if (gpu && options.collisions) std::cout << "--collisions has no effect with --backend=gpu" << std::endl;
 
     Uint64 now = SDL_GetPerformanceCounter();
     Uint64 last = now;
-    float dt = 0.0f;
     bool running = true;
     SDL_Event event;
+    bool showProfiler = options.profileOverlay;
+
+    // --check-allocs: frames after the warm-up should not touch the heap
+    const long long warmupFrames = 60;
+    long long frame = 0;
+    std::uint64_t steadyAllocations = 0;
 
     while (running) {
+        std::uint64_t allocationsBefore = heapAllocationCount();
         last = now;
         now = SDL_GetPerformanceCounter();
-        dt = (float)(now - last) / SDL_GetPerformanceFrequency();
+        double frameSeconds = (double)(now - last) / SDL_GetPerformanceFrequency();
 
-        SDL_FillRect(surface, &screenRect, 0x00000000);
+        {
+            PROFILE_SCOPE("clear");
+            presenter.clear(0x00000000);
+        }
 
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) running = false;
-            if (event.type == SDL_MOUSEMOTION && (event.motion.state & SDL_BUTTON(SDL_BUTTON_RIGHT))) {
-                cameraRot.y += event.motion.xrel * 0.005f;
-                cameraRot.x += event.motion.yrel * 0.005f;
+        {
+            PROFILE_SCOPE("events");
+            while (SDL_PollEvent(&event)) {
+                if (event.type == SDL_QUIT) running = false;
+                if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                    if (!presenter.resize(event.window.data1, event.window.data2) && !presenter.error().empty()) {
+                        std::cerr << presenter.error() << std::endl;
+                    }
+                }
+                if (event.type == SDL_MOUSEMOTION && (event.motion.state & SDL_BUTTON(SDL_BUTTON_RIGHT))) {
+                    camera.rotation.y += event.motion.xrel * 0.005f;
+                    camera.rotation.x += event.motion.yrel * 0.005f;
+                }
+                if (event.type == SDL_MOUSEWHEEL) {
+                    camera.position.z += event.wheel.y * 2000000.0f * SCALE;
+                }
+                if (event.type == SDL_KEYDOWN) {
+                    if (gpu && (event.key.keysym.sym == SDLK_b || event.key.keysym.sym == SDLK_i)) {
+                        std::cout << "the gpu backend only runs all-pairs leapfrog" << std::endl;
+                        continue;
+                    }
+                    // b cycles the solvers, [ and ] tune the opening angle or the FMM separation
+                    if (event.key.keysym.sym == SDLK_b) {
+                        options.force.mode = options.force.mode == ForceMode::AllPairs ? ForceMode::BarnesHut
+                            : options.force.mode == ForceMode::BarnesHut ? ForceMode::Fmm : ForceMode::AllPairs;
+                        if (pipeline) {
+                            pipeline->setForceSettings(options.force);
+                        } else {
+                            engine = createForceEngine(options.force, &pool);
+                            integrator.invalidate();
+                        }
+                        std::cout << "force solver: " << forceModeName(options.force.mode) << std::endl;
+                    }
+                    if (event.key.keysym.sym == SDLK_i) {
+                        options.integrator = options.integrator == IntegratorKind::Euler ? IntegratorKind::Leapfrog
+                            : options.integrator == IntegratorKind::Leapfrog ? IntegratorKind::Yoshida4
+                            : options.integrator == IntegratorKind::Yoshida4 ? IntegratorKind::Block : IntegratorKind::Euler;
+                        if (pipeline) {
+                            pipeline->setIntegrator(options.integrator);
+                        } else {
+                            integrator.setKind(options.integrator);
+                        }
+                        std::cout << "integrator: " << integratorName(options.integrator) << std::endl;
+                    }
+                    if (event.key.keysym.sym == SDLK_c) {
+                        options.collisions = !options.collisions;
+                        if (pipeline) pipeline->setCollisions(options.collisions);
+                        std::cout << "collisions: " << (options.collisions ? "on" : "off") << std::endl;
+                    }
+                    if (event.key.keysym.sym == SDLK_p) showProfiler = !showProfiler;
+                    if (event.key.keysym.sym == SDLK_r) {
+                        renderer.mode = renderer.mode == RenderMode::Spheres ? RenderMode::Points
+                            : renderer.mode == RenderMode::Points ? RenderMode::Density : RenderMode::Spheres;
+                        std::cout << "render mode: " << renderModeName(renderer.mode) << std::endl;
+                    }
+                    if (event.key.keysym.sym == SDLK_LEFTBRACKET || event.key.keysym.sym == SDLK_RIGHTBRACKET) {
+                        float factor = event.key.keysym.sym == SDLK_RIGHTBRACKET ? 1.1f : 1.0f / 1.1f;
+                        bool fmmMode = options.force.mode == ForceMode::Fmm;
+                        float& theta = fmmMode ? options.force.fmmTheta : options.force.theta;
+                        theta = std::min(fmmMode ? FMM_MAX_THETA : 2.0f, std::max(0.05f, theta * factor));
+                        if (pipeline) {
+                            pipeline->setForceSettings(options.force);
+                        } else if (auto* bh = dynamic_cast<BarnesHutEngine*>(engine.get())) {
+                            bh->setTheta(options.force.theta);
+                        } else if (auto* fmm = dynamic_cast<FmmEngine*>(engine.get())) {
+                            fmm->setTheta(options.force.fmmTheta);
+                        }
+                        std::cout << (fmmMode ? "fmm theta: " : "theta: ") << theta << std::endl;
+                    }
+                }
             }
-            if (event.type == SDL_MOUSEWHEEL) {
-                cameraPos.z += event.wheel.y * 2000000.0f * SCALE;
+        }
+
+        const BodySystem* drawn = &bodies;
+        const PositionHistory* drawnHistory = &history;
+        float alpha = 0.0f;
+        if (pipeline) {
+            drawn = &pipeline->latestFrame().bodies;
+            drawnHistory = &noHistory;
+        } else if (gpu) {
+            PROFILE_SCOPE("physics");
+            // between readbacks the last copied state is drawn as is
+            int steps = timestep.advance(frameSeconds);
+            gpu->step(timestep.dt, steps);
+            stepsSinceReadback += steps;
+            if (stepsSinceReadback >= options.readbackEvery) {
+                gpu->readback(bodies);
+                stepsSinceReadback = 0;
+            }
+            drawnHistory = &noHistory;
+        } else {
+            PROFILE_SCOPE("physics");
+            int steps = timestep.advance(frameSeconds);
+            for (int s = 0; s < steps; ++s) {
+                history.capture(bodies);
+                integrator.step(bodies, *engine, timestep.dt);
+                // merged bodies shift indices, so that step is drawn without blending
+                if (options.collisions && collisions.resolve(bodies)) {
+                    integrator.invalidate();
+                    history.capture(bodies);
+                }
             }
+            alpha = timestep.alpha();
         }
 
-        for (size_t i = 0; i < objects.size(); ++i) {
-            for (size_t j = 0; j < objects.size(); ++j) {
-                if (i != j) applyGravity(objects[i], objects[j], dt);
+        // nothing is drawn while there is no framebuffer to draw into
+        if (SDL_Surface* surface = presenter.surface()) {
+            {
+                PROFILE_SCOPE("render");
+                // with --pipeline the pool belongs to the physics thread, so the renderer runs serially
+                renderer.draw(surface, camera, *drawn, *drawnHistory, alpha, pipeline ? nullptr : &pool);
             }
+            if (showProfiler) DrawProfilerOverlay(surface);
         }
 
-        for (auto& obj : objects) {
-            obj.position += obj.velocity * dt;
-            FillSphere(surface, obj);
+        {
+            PROFILE_SCOPE("present");
+            presenter.present();
         }
 
-        SDL_UpdateWindowSurface(window);
+        if (options.checkAllocs && ++frame > warmupFrames) {
+            std::uint64_t allocations = heapAllocationCount() - allocationsBefore;
+            if (allocations && !steadyAllocations) {
+                std::cout << "frame " << frame << ": " << allocations << " heap allocations" << std::endl;
+            }
+            steadyAllocations += allocations;
+        }
     }
 
+    if (pipeline) pipeline->stop();
+    gpu.reset();
+    presenter.close();
     SDL_DestroyWindow(window);
     SDL_Quit();
+
+    if (options.checkAllocs) {
+        std::cout << steadyAllocations << " heap allocations in " << std::max(0LL, frame - warmupFrames)
+                  << " steady-state frames" << std::endl;
+    }
+    if (PROFILING_ENABLED) Profiler::instance().printSummary(std::cout);
+    if (!options.profileTracePath.empty() && !Profiler::instance().writeChromeTrace(options.profileTracePath)) {
+        std::cerr << "cannot write " << options.profileTracePath << std::endl;
+    }
     return 0;
 }
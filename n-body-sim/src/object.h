@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include "vec3.h"
+
+#define G 6.67430e-11f
+#define EARTH_MASS 5.972e24f
+#define MOON_MASS 7.348e22f
+#define EARTH_RADIUS 6371000.0f
+#define MOON_RADIUS 1737000.0f
+#define EARTH_MOON_DISTANCE 384400000.0f
+
+template <typename T>
+struct ObjectT {
+    Vec3T<T> position;
+    Vec3T<T> velocity;
+    T radius;
+    T mass;
+    std::uint32_t color;
+
+    template <typename U>
+    ObjectT<U> as() const { return { position.template as<U>(), velocity.template as<U>(), (U)radius, (U)mass, color }; }
+};
+
+using Object = ObjectT<float>;
+using ObjectD = ObjectT<double>;
@@ -0,0 +1,180 @@
+#include "options.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "fmm.h"
+#include "headless.h"
+
+static void printUsage(const char* program) {
+    std::cerr << "usage: " << program << " [options]\n"
+              << "  --force=all-pairs|barnes-hut|fmm      force solver (default all-pairs)\n"
+              << "  --theta=<float>                       Barnes-Hut opening angle (default 0.5)\n"
+              << "  --fmm-theta=<float>                   FMM cell separation, above 0 and at most 0.9 (default 0.7)\n"
+              << "  --fmm-order=<p>                       FMM expansion order 1-8, higher is slower and more exact (default 4)\n"
+              << "  --threads=<n>                         force worker threads, 0 = all cores (default 0)\n"
+              << "  --integrator=<kind>                   euler, leapfrog, yoshida4 or block (default leapfrog)\n"
+              << "  --dt=<seconds>                        fixed physics step (default 1/120)\n"
+              << "  --time-scale=<float>                  simulated seconds per real second (default 1)\n"
+              << "  --precision=single|mixed|double       mixed: double positions, float forces; double: all-pairs forces in double too (default single)\n"
+              << "  --pipeline                            run physics on its own thread, render the latest state\n"
+              << "  --backend=cpu|gpu                     where physics runs; gpu is all-pairs leapfrog (default cpu)\n"
+              << "  --readback-every=<n>                  gpu: copy bodies to the host every n steps (default 1)\n"
+              << "  --collisions                          merge bodies whose spheres overlap ('c' toggles)\n"
+              << "  --render=spheres|points|density       body rendering (default spheres)\n"
+              << "  --sphere-threshold=<px>               points/density: shade bodies larger than this (default 2)\n"
+              << "  --no-vsync                            present frames as soon as they are drawn\n"
+              << "  --check-allocs                        count heap allocations after warm-up, fail headless runs that make any\n"
+              << "  --profile-overlay                     show per-phase timings on screen ('p' toggles)\n"
+              << "  --profile-trace=<file.json>           write a Chrome trace of all phases on exit\n"
+              << "  --scenario=<kind>[:n]                 earth-moon, plummer or disk with n bodies (default earth-moon)\n"
+              << "  --seed=<n>                            random seed of the plummer and disk scenarios (default 1)\n"
+              << "  --input=<file>                        CSV or snapshot initial conditions, replaces --scenario\n"
+              << "  --headless                            run without a window\n"
+              << "  --steps=<n>                           headless: number of steps (default 1000)\n"
+              << "  --output=<file.csv>                   headless: final state, %d or %06d expands to the step\n"
+              << "  --output-every=<n>                    headless: also write the state every n steps\n"
+              << "  --snapshot=<file.nbs>                 headless: write output frames to a binary time series\n"
+              << "  --append                              headless: append to an existing snapshot file\n"
+              << "  --mpi                                 headless across the ranks of mpirun, --threads is per rank\n"
+              << "  --rebalance-every=<n>                 mpi: steps between domain rebalances, 0 = never (default 10)\n";
+}
+
+static const char* valueOf(const char* arg, const char* key) {
+    size_t len = std::strlen(key);
+    if (std::strncmp(arg, key, len) != 0 || arg[len] != '=') return nullptr;
+    return arg + len + 1;
+}
+
+bool parseOptions(int argc, char* argv[], SimOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = nullptr;
+        if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0) {
+            printUsage(argv[0]);
+            return false;
+        } else if (std::strcmp(arg, "--headless") == 0) {
+            options.headless = true;
+        } else if (std::strcmp(arg, "--pipeline") == 0) {
+            options.pipeline = true;
+        } else if (std::strcmp(arg, "--collisions") == 0) {
+            options.collisions = true;
+        } else if (std::strcmp(arg, "--no-vsync") == 0) {
+            options.vsync = false;
+        } else if (std::strcmp(arg, "--check-allocs") == 0) {
+            options.checkAllocs = true;
+        } else if (std::strcmp(arg, "--profile-overlay") == 0) {
+            options.profileOverlay = true;
+        } else if (std::strcmp(arg, "--append") == 0) {
+            options.appendSnapshot = true;
+        } else if (std::strcmp(arg, "--mpi") == 0) {
+            options.distributed = true;
+            options.headless = true;
+        } else if ((value = valueOf(arg, "--force"))) {
+            if (!parseForceMode(value, options.force.mode)) {
+                std::cerr << "unknown force mode: " << value << "\n";
+                printUsage(argv[0]);
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--theta"))) {
+            options.force.theta = std::strtof(value, nullptr);
+        } else if ((value = valueOf(arg, "--fmm-theta"))) {
+            options.force.fmmTheta = std::strtof(value, nullptr);
+            // also rejects nan and text that does not parse
+            if (!(options.force.fmmTheta > 0.0f && options.force.fmmTheta <= FMM_MAX_THETA)) {
+                std::cerr << "--fmm-theta must be above 0 and at most " << FMM_MAX_THETA << "\n";
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--fmm-order"))) {
+            options.force.fmmOrder = std::atoi(value);
+            if (options.force.fmmOrder < 1 || options.force.fmmOrder > FMM_MAX_ORDER) {
+                std::cerr << "--fmm-order must be between 1 and " << FMM_MAX_ORDER << "\n";
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--threads"))) {
+            options.threads = (unsigned)std::strtoul(value, nullptr, 10);
+        } else if ((value = valueOf(arg, "--integrator"))) {
+            if (!parseIntegrator(value, options.integrator)) {
+                std::cerr << "unknown integrator: " << value << "\n";
+                printUsage(argv[0]);
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--dt"))) {
+            options.dt = std::strtof(value, nullptr);
+            if (!(options.dt > 0.0f)) {
+                std::cerr << "--dt must be positive\n";
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--precision"))) {
+            if (!parsePrecision(value, options.precision)) {
+                std::cerr << "unknown precision: " << value << "\n";
+                printUsage(argv[0]);
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--backend"))) {
+            if (!parseBackend(value, options.backend)) {
+                std::cerr << "unknown backend: " << value << "\n";
+                printUsage(argv[0]);
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--readback-every"))) {
+            options.readbackEvery = std::atoi(value);
+            if (options.readbackEvery < 1) {
+                std::cerr << "--readback-every must be at least 1\n";
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--time-scale"))) {
+            options.timeScale = std::strtof(value, nullptr);
+        } else if ((value = valueOf(arg, "--render"))) {
+            if (!parseRenderMode(value, options.renderMode)) {
+                std::cerr << "unknown render mode: " << value << "\n";
+                printUsage(argv[0]);
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--sphere-threshold"))) {
+            options.sphereThreshold = std::strtof(value, nullptr);
+        } else if ((value = valueOf(arg, "--profile-trace"))) {
+            options.profileTracePath = value;
+        } else if ((value = valueOf(arg, "--scenario"))) {
+            if (!parseScenario(value, options.scenario)) {
+                std::cerr << "unknown scenario: " << value << "\n";
+                printUsage(argv[0]);
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--seed"))) {
+            options.scenario.seed = std::strtoull(value, nullptr, 10);
+        } else if ((value = valueOf(arg, "--input"))) {
+            options.inputPath = value;
+        } else if ((value = valueOf(arg, "--steps"))) {
+            options.steps = std::strtoll(value, nullptr, 10);
+            if (options.steps < 1) {
+                std::cerr << "--steps must be at least 1\n";
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--output"))) {
+            options.outputPath = value;
+            if (!validOutputPattern(options.outputPath)) {
+                std::cerr << "--output allows one %d, %Nd or %0Nd step token and no other '%'\n";
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--output-every"))) {
+            options.outputEvery = std::strtoll(value, nullptr, 10);
+            if (options.outputEvery < 0) {
+                std::cerr << "--output-every must not be negative\n";
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--rebalance-every"))) {
+            options.rebalanceEvery = std::strtoll(value, nullptr, 10);
+            if (options.rebalanceEvery < 0) {
+                std::cerr << "--rebalance-every must not be negative\n";
+                return false;
+            }
+        } else if ((value = valueOf(arg, "--snapshot"))) {
+            options.snapshotPath = value;
+        } else {
+            std::cerr << "unknown option: " << arg << "\n";
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
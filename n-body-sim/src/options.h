@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include "force_engine.h"
+#include "gpu_backend.h"
+#include "integrator.h"
+#include "render_mode.h"
+#include "scenario.h"
+
+struct SimOptions {
+    ForceSettings force;
+    unsigned threads = 0;  // 0 = one per hardware thread
+    IntegratorKind integrator = IntegratorKind::Leapfrog;
+    float dt = 1.0f / 120.0f;  // simulated seconds per physics step
+    float timeScale = 1.0f;    // simulated seconds per real second
+    Precision precision = Precision::Single;  // mixed: double state, float force kernels; double: all-pairs in double too
+    bool pipeline = false;     // physics on its own thread, decoupled from rendering
+    Backend backend = Backend::Cpu;
+    int readbackEvery = 1;     // gpu: copy the state back to the host every k steps
+    bool collisions = false;   // merge overlapping bodies after every step ('c' toggles)
+
+    RenderMode renderMode = RenderMode::Spheres;
+    float sphereThreshold = 2.0f;  // points/density: pixel radius above which bodies are shaded
+    bool vsync = true;             // present frames in step with the display refresh
+
+    bool checkAllocs = false;      // report heap allocations made by steady-state steps/frames
+    bool profileOverlay = false;   // start with the profiler overlay shown ('p' toggles)
+    std::string profileTracePath;  // Chrome trace JSON written on exit
+
+    ScenarioSettings scenario;  // generated initial conditions when there is no input file
+    std::string inputPath;      // initial conditions from a CSV or snapshot file
+    bool headless = false;   // no window, run `steps` steps as fast as possible
+    long long steps = 1000;
+    std::string outputPath;  // may contain one step token, e.g. state_%06d.csv
+    long long outputEvery = 0;  // headless: also write every n steps
+    std::string snapshotPath;   // headless: binary time series, one frame per output
+    bool appendSnapshot = false;
+    bool distributed = false;      // headless across MPI ranks, see distributed.h
+    long long rebalanceEvery = 10; // distributed: steps between domain rebalances
+};
+
+// parses --key=value style arguments, returns false and prints usage on error
+bool parseOptions(int argc, char* argv[], SimOptions& options);
@@ -0,0 +1,123 @@
+#include "pipeline.h"
+#include <chrono>
+#include <cstring>
+#include "barnes_hut.h"
+#include "fmm.h"
+
+PhysicsPipeline::PhysicsPipeline(BodySystem bodies, const ForceSettings& force, IntegratorKind integrator,
+                                 const FixedTimestep& timestep, ThreadPool& pool)
+    : m_bodies(std::move(bodies)), m_timestep(timestep), m_pool(pool), m_force(force), m_integrator(integrator) {
+    // the renderer may ask for a frame before the first step completes
+    publish(0.0, 0);
+    m_frames.update();
+}
+
+PhysicsPipeline::~PhysicsPipeline() {
+    stop();
+}
+
+void PhysicsPipeline::start() {
+    if (m_running.exchange(true)) return;
+    m_thread = std::thread(&PhysicsPipeline::run, this);
+}
+
+void PhysicsPipeline::stop() {
+    m_running = false;
+    if (m_thread.joinable()) m_thread.join();
+}
+
+const PipelineFrame& PhysicsPipeline::latestFrame() {
+    m_frames.update();
+    return m_frames.readBuffer();
+}
+
+void PhysicsPipeline::setForceSettings(const ForceSettings& force) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_force = force;
+    m_controlChanged = true;
+}
+
+void PhysicsPipeline::setIntegrator(IntegratorKind kind) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_integrator = kind;
+    m_controlChanged = true;
+}
+
+void PhysicsPipeline::setCollisions(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_collisions = enabled;
+    m_controlChanged = true;
+}
+
+void PhysicsPipeline::publish(double time, long long step) {
+    PipelineFrame& frame = m_frames.writeBuffer();
+    BodySystem& out = frame.bodies;
+    size_t n = m_bodies.count;
+    out.resize(n);
+    std::memcpy(out.x.data(), m_bodies.x.data(), n * sizeof(float));
+    std::memcpy(out.y.data(), m_bodies.y.data(), n * sizeof(float));
+    std::memcpy(out.z.data(), m_bodies.z.data(), n * sizeof(float));
+    std::memcpy(out.radius.data(), m_bodies.radius.data(), n * sizeof(float));
+    std::memcpy(out.color.data(), m_bodies.color.data(), n * sizeof(std::uint32_t));
+    frame.time = time;
+    frame.step = step;
+    m_frames.publish();
+}
+
+void PhysicsPipeline::run() {
+    using Clock = std::chrono::steady_clock;
+
+    ForceSettings force;
+    IntegratorKind integratorKind;
+    bool collide;
+    {
+        std::lock_guard<std::mutex> lock(m_controlMutex);
+        force = m_force;
+        integratorKind = m_integrator;
+        collide = m_collisions;
+        m_controlChanged = false;
+    }
+    std::unique_ptr<ForceEngine> engine = createForceEngine(force, &m_pool);
+    Integrator integrator(integratorKind);
+    CollisionSystem collisions;
+
+    double time = 0.0;
+    long long step = 0;
+    Clock::time_point last = Clock::now();
+    while (m_running.load(std::memory_order_relaxed)) {
+        {
+            // never block the physics thread on the renderer
+            std::unique_lock<std::mutex> lock(m_controlMutex, std::try_to_lock);
+            if (lock.owns_lock() && m_controlChanged) {
+                if (m_force.mode != force.mode) {
+                    engine = createForceEngine(m_force, &m_pool);
+                    integrator.invalidate();
+                } else if (auto* bh = dynamic_cast<BarnesHutEngine*>(engine.get())) {
+                    bh->setTheta(m_force.theta);
+                } else if (auto* fmm = dynamic_cast<FmmEngine*>(engine.get())) {
+                    fmm->setTheta(m_force.fmmTheta);
+                }
+                force = m_force;
+                integrator.setKind(m_integrator);
+                collide = m_collisions;
+                m_controlChanged = false;
+            }
+        }
+
+        Clock::time_point now = Clock::now();
+        int steps = m_timestep.advance(std::chrono::duration<double>(now - last).count());
+        last = now;
+        if (steps == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+
+        for (int s = 0; s < steps; ++s) {
+            integrator.step(m_bodies, *engine, m_timestep.dt);
+            if (collide && collisions.resolve(m_bodies)) integrator.invalidate();
+            time += m_timestep.dt;
+            ++step;
+        }
+        publish(time, step);
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "body_system.h"
+#include "collisions.h"
+#include "force_engine.h"
+#include "integrator.h"
+
+class ThreadPool;
+
+// single-producer/single-consumer triple buffer. the producer always has a
+// buffer to write, the consumer always has a complete one to read, and the
+// two swap through one atomic index, so neither side ever waits
+template <typename T>
+class TripleBuffer {
+public:
+    // producer side
+    T& writeBuffer() { return m_buffers[m_back]; }
+    void publish() {
+        m_back = m_middle.exchange(m_back | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // consumer side: takes the newest published buffer, false if nothing new
+    bool update() {
+        if (!(m_middle.load(std::memory_order_relaxed) & FRESH_BIT)) return false;
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+    const T& readBuffer() const { return m_buffers[m_front]; }
+
+private:
+    static constexpr unsigned INDEX_MASK = 3;
+    static constexpr unsigned FRESH_BIT = 4;
+
+    T m_buffers[3];
+    unsigned m_back = 0;
+    std::atomic<unsigned> m_middle{1};
+    unsigned m_front = 2;
+};
+
+// what the renderer needs from one physics state
+struct PipelineFrame {
+    BodySystem bodies;  // positions, radius and color only
+    double time = 0.0;
+    long long step = 0;
+};
+
+// runs the fixed-timestep physics on its own thread in real time and
+// publishes a frame after every batch of steps
+class PhysicsPipeline {
+public:
+    PhysicsPipeline(BodySystem bodies, const ForceSettings& force, IntegratorKind integrator,
+                    const FixedTimestep& timestep, ThreadPool& pool);
+    ~PhysicsPipeline();
+
+    void start();
+    void stop();
+
+    // render thread: most recent complete frame, possibly the same as last time
+    const PipelineFrame& latestFrame();
+
+    // render thread: picked up by the physics thread before its next step
+    void setForceSettings(const ForceSettings& force);
+    void setIntegrator(IntegratorKind kind);
+    void setCollisions(bool enabled);
+
+private:
+    void run();
+    void publish(double time, long long step);
+
+    BodySystem m_bodies;
+    FixedTimestep m_timestep;
+    ThreadPool& m_pool;
+
+    std::mutex m_controlMutex;
+    bool m_controlChanged = false;
+    ForceSettings m_force;
+    IntegratorKind m_integrator;
+    bool m_collisions = false;
+
+    TripleBuffer<PipelineFrame> m_frames;
+    std::atomic<bool> m_running{false};
+    std::thread m_thread;
+};
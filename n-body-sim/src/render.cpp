@@ -0,0 +1,236 @@
+#include "render.h"
+#include <algorithm>
+#include <cmath>
+#include "profiler.h"
+#include "thread_pool.h"
+
+Vec3 rotateY(const Vec3& v, float angle) {
+    float c = std::cos(angle), s = std::sin(angle);
+    return { c * v.x + s * v.z, v.y, -s * v.x + c * v.z };
+}
+
+Vec3 rotateX(const Vec3& v, float angle) {
+    float c = std::cos(angle), s = std::sin(angle);
+    return { v.x, c * v.y - s * v.z, s * v.y + c * v.z };
+}
+
+CameraBasis cameraBasis(const Camera& camera) {
+    return {
+        camera.position,
+        std::cos(camera.rotation.x), std::sin(camera.rotation.x),
+        std::cos(camera.rotation.y), std::sin(camera.rotation.y)
+    };
+}
+
+// rotateX then rotateY, with the same arithmetic
+Vec3 worldToCamera(const CameraBasis& basis, const Vec3& pos) {
+    Vec3 r = pos - basis.position;
+    r = { r.x, basis.cosX * r.y - basis.sinX * r.z, basis.sinX * r.y + basis.cosX * r.z };
+    return { basis.cosY * r.x + basis.sinY * r.z, r.y, -basis.sinY * r.x + basis.cosY * r.z };
+}
+
+Vec3 worldToCamera(const Camera& camera, const Vec3& pos) {
+    return worldToCamera(cameraBasis(camera), pos);
+}
+
+Vec3 projectToScreen(const Vec3& pos, int width, int height) {
+    float factor = FOV / (FOV + pos.z);
+    return {
+        width / 2.0f + pos.x * factor,
+        height / 2.0f - pos.y * factor,
+        pos.z
+    };
+}
+
+Uint32 shadeColor(Uint32 baseColor, float factor) {
+    Uint8 r = (baseColor >> 24) & 0xFF;
+    Uint8 g = (baseColor >> 16) & 0xFF;
+    Uint8 b = (baseColor >> 8) & 0xFF;
+    Uint8 a = baseColor & 0xFF;
+    r = static_cast<Uint8>(r * factor);
+    g = static_cast<Uint8>(g * factor);
+    b = static_cast<Uint8>(b * factor);
+    return (r << 24) | (g << 16) | (b << 8) | a;
+}
+
+static Uint32* surfaceRow(SDL_Surface* surface, int y) {
+    return reinterpret_cast<Uint32*>(static_cast<Uint8*>(surface->pixels) + (size_t)y * surface->pitch);
+}
+
+void FillMarker(SDL_Surface* surface, const Vec3& screenPos, Uint32 color) {
+    int x0 = std::max(0, (int)(screenPos.x - 2));
+    int y0 = std::max(0, (int)(screenPos.y - 2));
+    int x1 = std::min(surface->w, (int)(screenPos.x - 2) + 4);
+    int y1 = std::min(surface->h, (int)(screenPos.y - 2) + 4);
+    for (int y = y0; y < y1; ++y) {
+        std::fill(surfaceRow(surface, y) + x0, surfaceRow(surface, y) + std::max(x0, x1), color);
+    }
+}
+
+void FillSphere(SDL_Surface* surface, const Camera& camera, const Object& obj) {
+    Vec3 camSpace = worldToCamera(camera, obj.position);
+    if (camSpace.z < 1.0f) return;
+    Vec3 screen = projectToScreen(camSpace, surface->w, surface->h);
+    FillMarker(surface, screen, 0xFF00FFFF);
+
+    float radius = obj.radius * SCALE * RADIUS_SCALE * (FOV / (FOV + camSpace.z));
+    if (!(radius > 0.0f)) return;
+    float r2 = radius * radius;
+    float invRadius = 1.0f / radius;
+
+    // per-object lighting setup: the surface normal (dx, -dy, dz) / radius is
+    // already unit length, so only the light direction needs normalizing
+    Vec3 toLight = (camera.light - obj.position).normalized();
+
+    // same pixel coverage as the original per-pixel loop: [c - r, c + r) per axis
+    int xBegin = (int)(screen.x - radius);
+    int xEnd = (int)(screen.x + radius);
+    int yBegin = std::max(0, (int)(screen.y - radius));
+    int yEnd = std::min(surface->h, (int)(screen.y + radius));
+
+    for (int y = yBegin; y < yEnd; ++y) {
+        float dy = y - screen.y;
+        float rowSq = r2 - dy * dy;
+        if (rowSq < 0.0f) continue;
+
+        // x extent of the disk on this row, clipped to the bounding box and surface
+        float halfWidth = std::sqrt(rowSq);
+        int spanBegin = std::max({ xBegin, (int)std::ceil(screen.x - halfWidth), 0 });
+        int spanEnd = std::min({ xEnd, (int)std::floor(screen.x + halfWidth) + 1, surface->w });
+        if (spanBegin >= spanEnd) continue;
+
+        float rowLight = -dy * invRadius * toLight.y;
+        Uint32* row = surfaceRow(surface, y);
+        for (int x = spanBegin; x < spanEnd; ++x) {
+            float dx = x - screen.x;
+            float dz = std::sqrt(std::max(0.0f, rowSq - dx * dx));
+            float intensity = std::max(0.0f, (dx * toLight.x + dz * toLight.z) * invRadius + rowLight);
+            row[x] = shadeColor(obj.color, 0.1f + 0.9f * intensity);
+        }
+    }
+}
+
+void BodyRenderer::draw(SDL_Surface* surface, const Camera& camera, const BodySystem& bodies,
+                        const PositionHistory& history, float alpha, ThreadPool* pool) {
+    size_t n = bodies.count;
+    m_screenX.resize(n);
+    m_screenY.resize(n);
+    m_radius.resize(n);
+
+    int width = surface->w;
+    int height = surface->h;
+    const CameraBasis basis = cameraBasis(camera);
+    {
+        PROFILE_SCOPE("project and cull");
+        auto project = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                Vec3 camSpace = worldToCamera(basis, history.interpolate(bodies, i, alpha));
+                m_radius[i] = -1.0f;
+                if (camSpace.z < 1.0f) continue;
+                Vec3 screen = projectToScreen(camSpace, width, height);
+                float radius = bodies.radius[i] * SCALE * RADIUS_SCALE * (FOV / (FOV + camSpace.z));
+                if (screen.x + radius < 0.0f || screen.x - radius >= width) continue;
+                if (screen.y + radius < 0.0f || screen.y - radius >= height) continue;
+                m_screenX[i] = screen.x;
+                m_screenY[i] = screen.y;
+                m_radius[i] = radius;
+            }
+        };
+        if (pool) {
+            pool->parallelFor(0, n, chunkSize(n, pool->threadCount(), 256), project);
+        } else {
+            project(0, n);
+        }
+    }
+
+    if (mode != RenderMode::Spheres) {
+        PROFILE_SCOPE("splat");
+        if (mode == RenderMode::Density) m_density.assign((size_t)width * height, 0.0f);
+
+        // bands own disjoint rows of the surface and the density buffer. splatted
+        // bodies are counting-sorted by band first, so each band only walks its
+        // own; the sort is stable, keeping index order within every pixel
+        int bands = pool ? (int)pool->threadCount() * 4 : 1;
+        int bandHeight = (height + bands - 1) / bands;
+        m_arena.reset();
+        std::uint32_t* bandStart = m_arena.allocate<std::uint32_t>(bands + 1);
+        std::fill(bandStart, bandStart + bands + 1, 0u);
+        auto splatted = [&](size_t i) {
+            if (m_radius[i] < 0.0f || m_radius[i] > sphereThreshold) return false;
+            int x = (int)m_screenX[i];
+            int y = (int)m_screenY[i];
+            return x >= 0 && x < width && y >= 0 && y < height;
+        };
+        for (size_t i = 0; i < n; ++i) {
+            if (splatted(i)) ++bandStart[(int)m_screenY[i] / bandHeight + 1];
+        }
+        for (int band = 0; band < bands; ++band) bandStart[band + 1] += bandStart[band];
+        std::uint32_t* binned = m_arena.allocate<std::uint32_t>(std::max<size_t>(1, bandStart[bands]));
+        std::uint32_t* cursor = m_arena.allocate<std::uint32_t>(bands);
+        std::copy(bandStart, bandStart + bands, cursor);
+        for (size_t i = 0; i < n; ++i) {
+            if (splatted(i)) binned[cursor[(int)m_screenY[i] / bandHeight]++] = (std::uint32_t)i;
+        }
+
+        m_bandPeak.assign(bands, 0.0f);
+        auto splat = [&](size_t begin, size_t end) {
+            for (size_t band = begin; band < end; ++band) {
+                m_bandPeak[band] = splatBand(surface, bodies, binned + bandStart[band], bandStart[band + 1] - bandStart[band]);
+            }
+        };
+        if (pool) {
+            pool->parallelFor(0, bands, 1, splat);
+        } else {
+            splat(0, bands);
+        }
+
+        if (mode == RenderMode::Density) {
+            float peak = *std::max_element(m_bandPeak.begin(), m_bandPeak.end());
+            float scale = peak > 0.0f ? 255.0f / std::log1p(peak) : 0.0f;
+            auto tonemap = [&](size_t begin, size_t end) {
+                for (size_t y = begin; y < end; ++y) {
+                    Uint32* row = surfaceRow(surface, (int)y);
+                    const float* density = m_density.data() + y * width;
+                    for (int x = 0; x < width; ++x) {
+                        if (density[x] == 0.0f) continue;
+                        Uint32 v = (Uint32)(std::log1p(density[x]) * scale);
+                        row[x] = (v << 24) | (v << 16) | (v << 8) | 0xFF;
+                    }
+                }
+            };
+            if (pool) {
+                pool->parallelFor(0, height, chunkSize(height, pool->threadCount(), 1), tonemap);
+            } else {
+                tonemap(0, height);
+            }
+        }
+    }
+
+    // large bodies keep the shaded path and are drawn on top of the splats
+    PROFILE_SCOPE("FillSphere");
+    for (size_t i = 0; i < n; ++i) {
+        if (m_radius[i] < 0.0f) continue;
+        if (mode != RenderMode::Spheres && m_radius[i] <= sphereThreshold) continue;
+        Object obj = bodies.object(i);
+        obj.position = history.interpolate(bodies, i, alpha);
+        FillSphere(surface, camera, obj);
+    }
+}
+
+float BodyRenderer::splatBand(SDL_Surface* surface, const BodySystem& bodies, const std::uint32_t* indices, size_t count) {
+    int width = surface->w;
+    float peak = 0.0f;
+    for (size_t k = 0; k < count; ++k) {
+        size_t i = indices[k];
+        int x = (int)m_screenX[i];
+        int y = (int)m_screenY[i];
+        if (mode == RenderMode::Points) {
+            surfaceRow(surface, y)[x] = bodies.color[i];
+        } else {
+            float& cell = m_density[(size_t)y * width + x];
+            cell += 1.0f;
+            peak = std::max(peak, cell);
+        }
+    }
+    return peak;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <SDL.h>
+#include <vector>
+#include "body_system.h"
+#include "frame_arena.h"
+#include "integrator.h"
+#include "render_mode.h"
+
+class ThreadPool;
+
+#define SCALE 1e-5f
+#define RADIUS_SCALE 300.0f
+#define FOV 500.0f
+
+struct Camera {
+    Vec3 position = { 0.0f, 0.0f, -EARTH_MOON_DISTANCE * SCALE * 2.5f };
+    Vec3 rotation = { 0.3f, 0.0f, 0.0f };
+    Vec3 light = { 0.0f, 0.0f, -EARTH_MOON_DISTANCE * SCALE * 3.0f };
+};
+
+// the camera rotation as cosines and sines, computed once per frame rather than
+// per body
+struct CameraBasis {
+    Vec3 position;
+    float cosX, sinX;
+    float cosY, sinY;
+};
+
+CameraBasis cameraBasis(const Camera& camera);
+
+Vec3 rotateY(const Vec3& v, float angle);
+Vec3 rotateX(const Vec3& v, float angle);
+Vec3 worldToCamera(const CameraBasis& basis, const Vec3& pos);
+Vec3 worldToCamera(const Camera& camera, const Vec3& pos);
+Vec3 projectToScreen(const Vec3& pos, int width, int height);
+
+// scales the rgb channels of a 0xRRGGBBAA color, keeps alpha
+Uint32 shadeColor(Uint32 baseColor, float factor);
+
+// the drawing functions below write straight into surface->pixels, so the
+// surface must be locked (when SDL_MUSTLOCK) and 32 bits per pixel
+void FillMarker(SDL_Surface* surface, const Vec3& screenPos, Uint32 color);
+void FillSphere(SDL_Surface* surface, const Camera& camera, const Object& obj);
+
+// draws a whole BodySystem: bodies behind the camera or off screen are culled
+// after projection, bodies whose projected radius exceeds sphereThreshold
+// pixels are shaded spheres and the rest are splatted in parallel row bands
+class BodyRenderer {
+public:
+    RenderMode mode = RenderMode::Spheres;
+    float sphereThreshold = 2.0f;
+
+    void draw(SDL_Surface* surface, const Camera& camera, const BodySystem& bodies,
+              const PositionHistory& history, float alpha, ThreadPool* pool);
+
+private:
+    // splats the given bodies, all inside one band; returns the highest density
+    // written in the band
+    float splatBand(SDL_Surface* surface, const BodySystem& bodies, const std::uint32_t* indices, size_t count);
+
+    // screen position and radius per body, radius < 0 marks culled bodies
+    std::vector<float> m_screenX, m_screenY, m_radius;
+    std::vector<float> m_density;
+    std::vector<float> m_bandPeak;
+    FrameArena m_arena;  // per-frame band bins
+};
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstring>
+
+enum class RenderMode {
+    Spheres,  // shaded sphere for every body
+    Points,   // one pixel per small body
+    Density,  // log-scaled hit count per pixel for small bodies
+};
+
+inline const char* renderModeName(RenderMode mode) {
+    switch (mode) {
+    case RenderMode::Spheres: return "spheres";
+    case RenderMode::Points: return "points";
+    case RenderMode::Density: return "density";
+    }
+    return "unknown";
+}
+
+inline bool parseRenderMode(const char* text, RenderMode& mode) {
+    if (std::strcmp(text, "spheres") == 0) {
+        mode = RenderMode::Spheres;
+    } else if (std::strcmp(text, "points") == 0) {
+        mode = RenderMode::Points;
+    } else if (std::strcmp(text, "density") == 0) {
+        mode = RenderMode::Density;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,406 @@
+#include "scenario.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "snapshot.h"
+#include "thread_pool.h"
+
+// bodies per generator chunk; every chunk has its own random stream
+#define SCENARIO_CHUNK 4096
+// generated bodies are drawn this size whatever their mass
+#define SCENARIO_BODY_RADIUS 20000.0f
+// CSV bytes read at a time, also the longest line accepted
+#define CSV_CHUNK_BYTES (1 << 20)
+
+#define PLUMMER_MASS (1000.0f * EARTH_MASS)
+#define PLUMMER_RADIUS (0.25f * EARTH_MOON_DISTANCE)
+#define PLUMMER_CUTOFF 10.0  // in Plummer radii
+
+#define DISK_CENTRAL_MASS (1000.0f * EARTH_MASS)
+#define DISK_MASS (100.0f * EARTH_MASS)
+#define DISK_SCALE_LENGTH (0.25f * EARTH_MOON_DISTANCE)
+#define DISK_INNER_RADIUS 0.1    // in scale lengths
+#define DISK_OUTER_RADIUS 5.0
+#define DISK_THICKNESS 0.02      // gaussian scale height, in scale lengths
+#define DISK_DISPERSION 0.02     // random velocity, as a fraction of the circular speed
+
+const char* scenarioName(ScenarioKind kind) {
+    switch (kind) {
+    case ScenarioKind::EarthMoon: return "earth-moon";
+    case ScenarioKind::Plummer: return "plummer";
+    case ScenarioKind::Disk: return "disk";
+    }
+    return "unknown";
+}
+
+bool parseScenario(const char* text, ScenarioSettings& settings) {
+    const char* colon = std::strchr(text, ':');
+    std::string name = colon ? std::string(text, colon) : std::string(text);
+    if (name == "earth-moon") {
+        settings.kind = ScenarioKind::EarthMoon;
+    } else if (name == "plummer") {
+        settings.kind = ScenarioKind::Plummer;
+    } else if (name == "disk" || name == "galaxy") {
+        settings.kind = ScenarioKind::Disk;
+    } else {
+        return false;
+    }
+    if (colon) {
+        char* end = nullptr;
+        unsigned long long count = std::strtoull(colon + 1, &end, 10);
+        if (end == colon + 1 || *end != '\0' || count < 2) return false;
+        settings.count = (size_t)count;
+    }
+    return true;
+}
+
+BodySystem earthMoonScenario() {
+    return BodySystem::fromObjects({
+        {{0, 0, 0}, {0, 0, 0}, EARTH_RADIUS, EARTH_MASS, 0xFFFFFFFF},
+        {{EARTH_MOON_DISTANCE, 0, 0}, {0, 1022, 0}, MOON_RADIUS, MOON_MASS, 0xFFCCCCCC},
+    });
+}
+
+// splitmix64, seeded per chunk
+struct ScenarioRandom {
+    std::uint64_t state;
+
+    ScenarioRandom(std::uint64_t seed, std::uint64_t chunk)
+        : state(seed * 0x9E3779B97F4A7C15ull ^ (chunk + 1) * 0xD1B54A32D192ED03ull) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    // in (0, 1), safe to take the log of
+    double uniform() { return ((next() >> 11) + 0.5) * (1.0 / 9007199254740992.0); }
+    double gaussian() {
+        return std::sqrt(-2.0 * std::log(uniform())) * std::cos(6.283185307179586 * uniform());
+    }
+    // uniform direction scaled to length
+    void direction(double length, double& x, double& y, double& z) {
+        double cosTheta = 2.0 * uniform() - 1.0;
+        double sinTheta = std::sqrt(std::max(0.0, 1.0 - cosTheta * cosTheta));
+        double phi = 6.283185307179586 * uniform();
+        x = length * sinTheta * std::cos(phi);
+        y = length * sinTheta * std::sin(phi);
+        z = length * cosTheta;
+    }
+};
+
+// calls fn(begin, end) for the chunks first + k * SCENARIO_CHUNK. a pool
+// may hand out several chunks at once, so they are split here again
+template <typename Fn>
+static void forEachChunk(size_t first, size_t last, ThreadPool* pool, Fn&& fn) {
+    auto run = [&](size_t from, size_t to) {
+        for (size_t begin = from; begin < to; begin += SCENARIO_CHUNK) fn(begin, std::min(to, begin + SCENARIO_CHUNK));
+    };
+    if (pool) {
+        pool->parallelFor(first, last, SCENARIO_CHUNK, run);
+    } else {
+        run(first, last);
+    }
+}
+
+// moves the centre of mass to rest at the origin. partial sums are taken per
+// chunk and added in chunk order, so this is deterministic as well
+static void removeBulkMotion(BodySystem& bodies, ThreadPool* pool) {
+    struct Moments {
+        double mass = 0, x = 0, y = 0, z = 0, vx = 0, vy = 0, vz = 0;
+    };
+    size_t n = bodies.count;
+    std::vector<Moments> partial((n + SCENARIO_CHUNK - 1) / SCENARIO_CHUNK);
+    forEachChunk(0, n, pool, [&](size_t begin, size_t end) {
+        Moments& sum = partial[begin / SCENARIO_CHUNK];
+        for (size_t i = begin; i < end; ++i) {
+            double m = bodies.mass[i];
+            sum.mass += m;
+            sum.x += m * bodies.x[i];
+            sum.y += m * bodies.y[i];
+            sum.z += m * bodies.z[i];
+            sum.vx += m * bodies.vx[i];
+            sum.vy += m * bodies.vy[i];
+            sum.vz += m * bodies.vz[i];
+        }
+    });
+    Moments total;
+    for (const Moments& sum : partial) {
+        total.mass += sum.mass;
+        total.x += sum.x;
+        total.y += sum.y;
+        total.z += sum.z;
+        total.vx += sum.vx;
+        total.vy += sum.vy;
+        total.vz += sum.vz;
+    }
+    if (!(total.mass > 0.0)) return;
+
+    float cx = (float)(total.x / total.mass), cy = (float)(total.y / total.mass), cz = (float)(total.z / total.mass);
+    float cvx = (float)(total.vx / total.mass), cvy = (float)(total.vy / total.mass), cvz = (float)(total.vz / total.mass);
+    forEachChunk(0, n, pool, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            bodies.x[i] -= cx;
+            bodies.y[i] -= cy;
+            bodies.z[i] -= cz;
+            bodies.vx[i] -= cvx;
+            bodies.vy[i] -= cvy;
+            bodies.vz[i] -= cvz;
+        }
+    });
+}
+
+// Aarseth, Henon & Wielen (1974): radii from the inverted cumulative mass,
+// speeds by rejection from the isotropic distribution function
+BodySystem plummerScenario(size_t count, std::uint64_t seed, ThreadPool* pool) {
+    BodySystem bodies;
+    bodies.resize(count);
+    const double a = PLUMMER_RADIUS;
+    const double velocityUnit = std::sqrt((double)G * PLUMMER_MASS / a);
+    const float mass = PLUMMER_MASS / (float)count;
+
+    forEachChunk(0, count, pool, [&](size_t begin, size_t end) {
+        ScenarioRandom random(seed, begin / SCENARIO_CHUNK);
+        for (size_t i = begin; i < end; ++i) {
+            double r;
+            do {
+                double u = random.uniform();
+                r = 1.0 / std::sqrt(1.0 / std::cbrt(u * u) - 1.0);
+            } while (r > PLUMMER_CUTOFF);
+
+            double q, g, w;
+            do {
+                q = random.uniform();
+                g = 0.1 * random.uniform();
+                w = 1.0 - q * q;
+            } while (g > q * q * w * w * w * std::sqrt(w));
+            double speed = q * std::sqrt(2.0 / std::sqrt(1.0 + r * r));
+
+            double px, py, pz, vx, vy, vz;
+            random.direction(r * a, px, py, pz);
+            random.direction(speed * velocityUnit, vx, vy, vz);
+            bodies.x[i] = (float)px;
+            bodies.y[i] = (float)py;
+            bodies.z[i] = (float)pz;
+            bodies.vx[i] = (float)vx;
+            bodies.vy[i] = (float)vy;
+            bodies.vz[i] = (float)vz;
+            bodies.mass[i] = mass;
+            bodies.radius[i] = SCENARIO_BODY_RADIUS;
+            bodies.color[i] = 0xFFE6C8FF;
+        }
+    });
+    removeBulkMotion(bodies, pool);
+    return bodies;
+}
+
+// body 0 is the central mass; the rest follow an exponential surface density
+// (radius ~ Gamma(2) in scale lengths) on near-circular orbits in the xy plane.
+// the enclosed disk mass is treated as if it were spherical
+BodySystem diskScenario(size_t count, std::uint64_t seed, ThreadPool* pool) {
+    BodySystem bodies;
+    bodies.resize(count);
+    bodies.set(0, Object{ { 0, 0, 0 }, { 0, 0, 0 }, 10.0f * SCENARIO_BODY_RADIUS, DISK_CENTRAL_MASS, 0xFFFFFFFF });
+    if (count < 2) return bodies;
+
+    const double h = DISK_SCALE_LENGTH;
+    const float mass = DISK_MASS / (float)(count - 1);
+
+    forEachChunk(1, count, pool, [&](size_t begin, size_t end) {
+        ScenarioRandom random(seed, (begin - 1) / SCENARIO_CHUNK);
+        for (size_t i = begin; i < end; ++i) {
+            double r;
+            do {
+                r = -std::log(random.uniform() * random.uniform());
+            } while (r < DISK_INNER_RADIUS || r > DISK_OUTER_RADIUS);
+            double phi = 6.283185307179586 * random.uniform();
+            double c = std::cos(phi), s = std::sin(phi);
+
+            double enclosed = (double)DISK_CENTRAL_MASS + (double)DISK_MASS * (1.0 - (1.0 + r) * std::exp(-r));
+            double circular = std::sqrt((double)G * enclosed / (r * h));
+            double sigma = DISK_DISPERSION * circular;
+
+            bodies.x[i] = (float)(r * h * c);
+            bodies.y[i] = (float)(r * h * s);
+            bodies.z[i] = (float)(DISK_THICKNESS * h * random.gaussian());
+            bodies.vx[i] = (float)(-circular * s + sigma * random.gaussian());
+            bodies.vy[i] = (float)(circular * c + sigma * random.gaussian());
+            bodies.vz[i] = (float)(sigma * random.gaussian());
+            bodies.mass[i] = mass;
+            bodies.radius[i] = SCENARIO_BODY_RADIUS;
+
+            // yellowish core fading to a blue rim
+            float t = (float)((r - DISK_INNER_RADIUS) / (DISK_OUTER_RADIUS - DISK_INNER_RADIUS));
+            std::uint32_t red = (std::uint32_t)(255.0f - 95.0f * t);
+            std::uint32_t green = (std::uint32_t)(224.0f - 32.0f * t);
+            std::uint32_t blue = (std::uint32_t)(160.0f + 95.0f * t);
+            bodies.color[i] = red << 24 | green << 16 | blue << 8 | 0xFF;
+        }
+    });
+    removeBulkMotion(bodies, pool);
+    return bodies;
+}
+
+BodySystem generateScenario(const ScenarioSettings& settings, ThreadPool* pool) {
+    switch (settings.kind) {
+    case ScenarioKind::Plummer: return plummerScenario(settings.count, settings.seed, pool);
+    case ScenarioKind::Disk: return diskScenario(settings.count, settings.seed, pool);
+    case ScenarioKind::EarthMoon: break;
+    }
+    return earthMoonScenario();
+}
+
+// from_chars skips neither blanks nor a leading '+', strtof did
+template <typename T>
+static const char* parseNumber(const char* cursor, const char* end, T& value) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '+')) ++cursor;
+    std::from_chars_result result = std::from_chars(cursor, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+// parses one row of [line, end) straight into slot i. mixed precision
+// systems read the row in double, so no digits are lost to the float mirror
+template <typename T>
+static bool parseBodyLine(const char* line, const char* end, BodySystem& bodies, size_t i) {
+    T values[8];
+    const char* cursor = line;
+    for (T& value : values) {
+        cursor = parseNumber(cursor, end, value);
+        if (!cursor || *cursor != ',') return false;
+        ++cursor;
+    }
+    char* colorEnd = nullptr;
+    unsigned long color = std::strtoul(cursor, &colorEnd, 0);
+    if (colorEnd == cursor) return false;
+
+    bodies.set(i, ObjectT<T>{ { values[0], values[1], values[2] }, { values[3], values[4], values[5] }, values[6], values[7], (std::uint32_t)color });
+    return true;
+}
+
+bool loadBodiesCsv(const std::string& path, BodySystem& bodies) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "cannot open " << path << "\n";
+        return false;
+    }
+
+    // rows written by writeBodiesCsv take around 100 bytes; sizing for a
+    // little more than the file can hold means the arrays rarely regrow
+    BodySystem loaded;
+    loaded.setPrecision(bodies.precision());
+    size_t capacity = 64;
+    if (std::fseek(file, 0, SEEK_END) == 0) {
+        long size = std::ftell(file);
+        if (size > 0) capacity = std::max(capacity, (size_t)size / 80);
+        std::rewind(file);
+    }
+    loaded.resize(capacity);
+
+    std::vector<char> buffer(CSV_CHUNK_BYTES + 1);
+    size_t filled = 0;
+    size_t count = 0;
+    int lineNumber = 0;
+    bool ok = true;
+    bool done = false;
+    while (ok && !done) {
+        size_t got = std::fread(buffer.data() + filled, 1, CSV_CHUNK_BYTES - filled, file);
+        filled += got;
+        done = got == 0;
+        if (done && filled == 0) break;
+        buffer[filled] = '\0';
+
+        // complete lines only, the tail carries over into the next chunk;
+        // at the end of the file the tail is the last line
+        char* line = buffer.data();
+        char* bufferEnd = buffer.data() + filled;
+        while (line < bufferEnd) {
+            char* newline = static_cast<char*>(std::memchr(line, '\n', (size_t)(bufferEnd - line)));
+            if (!newline && !done) break;
+            char* lineEnd = newline ? newline : bufferEnd;
+            *lineEnd = '\0';
+            ++lineNumber;
+
+            const char* start = line;
+            line = lineEnd + 1;
+            while (*start == ' ' || *start == '\t' || *start == '\r') ++start;
+            if (*start == '\0' || *start == '#') continue;
+            // header rows start with a column name
+            if (count == 0 && std::isalpha((unsigned char)*start)) continue;
+
+            if (count == capacity) {
+                capacity += capacity / 2;
+                loaded.resize(capacity);
+            }
+            bool parsed = loaded.precise() ? parseBodyLine<double>(start, lineEnd, loaded, count)
+                                           : parseBodyLine<float>(start, lineEnd, loaded, count);
+            if (!parsed) {
+                std::cerr << path << ":" << lineNumber << ": expected x,y,z,vx,vy,vz,radius,mass,color\n";
+                ok = false;
+                break;
+            }
+            ++count;
+        }
+        if (done) break;
+
+        filled = (size_t)(bufferEnd - line);
+        if (filled == CSV_CHUNK_BYTES) {
+            std::cerr << path << ":" << lineNumber + 1 << ": line too long\n";
+            ok = false;
+        }
+        std::memmove(buffer.data(), line, filled);
+    }
+    if (ok && std::ferror(file)) {
+        std::cerr << "cannot read " << path << "\n";
+        ok = false;
+    }
+    std::fclose(file);
+    if (!ok) return false;
+
+    loaded.resize(count);
+    bodies = std::move(loaded);
+    return true;
+}
+
+bool writeBodiesCsv(const std::string& path, const BodySystem& bodies) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "cannot write " << path << "\n";
+        return false;
+    }
+
+    // enough digits to read back the exact float, or double in mixed precision
+    out.precision(bodies.precise() ? 17 : 9);
+    out << "x,y,z,vx,vy,vz,radius,mass,color\n";
+    for (size_t i = 0; i < bodies.count; ++i) {
+        char color[16];
+        std::snprintf(color, sizeof(color), "0x%08X", bodies.color[i]);
+        Vec3d p = bodies.precisePosition(i);
+        Vec3d v = bodies.preciseVelocity(i);
+        out << p.x << ',' << p.y << ',' << p.z << ',' << v.x << ',' << v.y << ',' << v.z << ','
+            << bodies.radius[i] << ',' << bodies.mass[i] << ',' << color << '\n';
+    }
+    return (bool)out;
+}
+
+bool loadBodies(const std::string& path, BodySystem& bodies, double& time, long long& step) {
+    if (!isSnapshotFile(path)) return loadBodiesCsv(path, bodies);
+
+    SnapshotFile file;
+    if (!file.open(path)) return false;
+    if (file.frameCount() == 0) {
+        std::cerr << path << ": snapshot has no frames\n";
+        return false;
+    }
+    SnapshotFrame frame = file.frame(file.frameCount() - 1);
+    frame.copyTo(bodies);
+    time = frame.header->time;
+    step = frame.header->step;
+    return true;
+}
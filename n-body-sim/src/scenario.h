@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "body_system.h"
+
+class ThreadPool;
+
+// procedural initial conditions. generated bodies depend only on the count
+// and seed, not on the number of threads that produced them
+enum class ScenarioKind {
+    EarthMoon,  // the default two-body preset
+    Plummer,    // Plummer sphere in virial equilibrium
+    Disk,       // exponential disk on circular orbits around a central mass
+};
+
+struct ScenarioSettings {
+    ScenarioKind kind = ScenarioKind::EarthMoon;
+    size_t count = 100000;  // plummer/disk bodies, the disk's central mass included
+    std::uint64_t seed = 1;
+};
+
+const char* scenarioName(ScenarioKind kind);
+// "earth-moon", "plummer" or "disk", optionally followed by ":<count>"
+bool parseScenario(const char* text, ScenarioSettings& settings);
+
+// the default Earth-Moon system
+BodySystem earthMoonScenario();
+// pool may be null, in which case the bodies are generated on the calling thread
+BodySystem plummerScenario(size_t count, std::uint64_t seed, ThreadPool* pool);
+BodySystem diskScenario(size_t count, std::uint64_t seed, ThreadPool* pool);
+BodySystem generateScenario(const ScenarioSettings& settings, ThreadPool* pool);
+
+// text initial conditions, one body per line:
+//   x,y,z,vx,vy,vz,radius,mass,color
+// SI units, color as 0xRRGGBBAA; '#' lines and a header line are skipped.
+// the file is read in fixed-size chunks and parsed straight into the arrays
+bool loadBodiesCsv(const std::string& path, BodySystem& bodies);
+bool writeBodiesCsv(const std::string& path, const BodySystem& bodies);
+
+// loads a snapshot file (its last frame) or CSV initial conditions; time and
+// step are set from the snapshot and left untouched for CSV
+bool loadBodies(const std::string& path, BodySystem& bodies, double& time, long long& step);
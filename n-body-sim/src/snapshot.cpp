@@ -0,0 +1,333 @@
+#include "snapshot.h"
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#define SNAPSHOT_BYTE_ORDER_MARK 0x01020304u
+
+static size_t arrayStrideFor(size_t paddedCount) {
+    return (paddedCount * sizeof(float) + 63) / 64 * 64;
+}
+
+static SnapshotFileHeader makeFileHeader() {
+    SnapshotFileHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(SnapshotFileHeader);
+    header.frameHeaderSize = sizeof(SnapshotFrameHeader);
+    header.byteOrderMark = SNAPSHOT_BYTE_ORDER_MARK;
+    return header;
+}
+
+static bool validFileHeader(const SnapshotFileHeader& header) {
+    return std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0
+        && header.version == SNAPSHOT_VERSION
+        && header.headerSize == sizeof(SnapshotFileHeader)
+        && header.frameHeaderSize == sizeof(SnapshotFrameHeader)
+        && header.byteOrderMark == SNAPSHOT_BYTE_ORDER_MARK;
+}
+
+static bool consistentFrame(const SnapshotFrameHeader& header) {
+    return header.bodyCount <= header.paddedCount
+        && header.arrayStride >= header.paddedCount * sizeof(float)
+        && header.frameBytes == sizeof(SnapshotFrameHeader) + SNAPSHOT_ARRAY_COUNT * header.arrayStride;
+}
+
+// walks the frame headers of a file of size bytes whose file header is valid;
+// readAt(header, offset) reads one frame header. returns the end of the last
+// complete frame and counts the frames before it
+template <typename ReadAt>
+static std::uint64_t validFramesEnd(std::uint64_t size, ReadAt readAt, size_t& frames, std::int64_t& lastStep) {
+    std::uint64_t offset = sizeof(SnapshotFileHeader);
+    SnapshotFrameHeader header;
+    while (offset + sizeof(SnapshotFrameHeader) <= size && readAt(header, offset)) {
+        if (!consistentFrame(header) || offset + header.frameBytes > size) break;
+        ++frames;
+        lastStep = header.step;
+        offset += header.frameBytes;
+    }
+    return offset;
+}
+
+void SnapshotFrame::copyTo(BodySystem& bodies) const {
+    size_t n = (size_t)header->bodyCount;
+    bodies.resize(n);
+    std::memcpy(bodies.x.data(), x, n * sizeof(float));
+    std::memcpy(bodies.y.data(), y, n * sizeof(float));
+    std::memcpy(bodies.z.data(), z, n * sizeof(float));
+    std::memcpy(bodies.vx.data(), vx, n * sizeof(float));
+    std::memcpy(bodies.vy.data(), vy, n * sizeof(float));
+    std::memcpy(bodies.vz.data(), vz, n * sizeof(float));
+    std::memcpy(bodies.mass.data(), mass, n * sizeof(float));
+    std::memcpy(bodies.radius.data(), radius, n * sizeof(float));
+    std::memcpy(bodies.color.data(), color, n * sizeof(std::uint32_t));
+    bodies.storeMirrorsAsPrecise();
+}
+
+bool SnapshotWriter::open(const std::string& path, bool append) {
+    close();
+    m_existingFrames = 0;
+    m_lastExistingStep = 0;
+    SnapshotFileHeader header = makeFileHeader();
+    bool writeHeader = true;
+
+#ifdef _WIN32
+    if (append) {
+        std::FILE* existing = std::fopen(path.c_str(), "rb");
+        if (existing) {
+            SnapshotFileHeader old;
+            size_t got = std::fread(&old, 1, sizeof(old), existing);
+            if (got > 0 && (got != sizeof(old) || !validFileHeader(old))) {
+                std::fclose(existing);
+                std::cerr << path << ": not a compatible snapshot file\n";
+                return false;
+            }
+            writeHeader = got == 0;
+            std::uint64_t end = 0;
+            if (!writeHeader) {
+                std::uint64_t size = std::filesystem::file_size(path);
+                auto readAt = [&](SnapshotFrameHeader& frame, std::uint64_t offset) {
+                    return _fseeki64(existing, (long long)offset, SEEK_SET) == 0
+                        && std::fread(&frame, sizeof(frame), 1, existing) == 1;
+                };
+                end = validFramesEnd(size, readAt, m_existingFrames, m_lastExistingStep);
+                if (end < size) std::cerr << path << ": dropping damaged frame at byte " << end << "\n";
+            }
+            std::fclose(existing);
+            if (!writeHeader) std::filesystem::resize_file(path, end);
+        }
+    }
+    m_file = std::fopen(path.c_str(), append ? "ab" : "wb");
+    if (!m_file) {
+        std::cerr << "cannot write " << path << "\n";
+        return false;
+    }
+    if (writeHeader && std::fwrite(&header, sizeof(header), 1, m_file) != 1) return false;
+#else
+    m_fd = ::open(path.c_str(), O_CREAT | (append ? O_RDWR | O_APPEND : O_WRONLY | O_TRUNC), 0644);
+    if (m_fd < 0) {
+        std::cerr << "cannot write " << path << "\n";
+        return false;
+    }
+    if (append) {
+        struct stat st;
+        if (::fstat(m_fd, &st) == 0 && st.st_size > 0) {
+            SnapshotFileHeader old;
+            if (::pread(m_fd, &old, sizeof(old), 0) != (ssize_t)sizeof(old) || !validFileHeader(old)) {
+                std::cerr << path << ": not a compatible snapshot file\n";
+                close();
+                return false;
+            }
+            writeHeader = false;
+            // new frames go right after the last complete one, not after a torn tail
+            std::uint64_t size = (std::uint64_t)st.st_size;
+            auto readAt = [&](SnapshotFrameHeader& frame, std::uint64_t offset) {
+                return ::pread(m_fd, &frame, sizeof(frame), (off_t)offset) == (ssize_t)sizeof(frame);
+            };
+            std::uint64_t end = validFramesEnd(size, readAt, m_existingFrames, m_lastExistingStep);
+            if (end < size) {
+                std::cerr << path << ": dropping damaged frame at byte " << end << "\n";
+                if (::ftruncate(m_fd, (off_t)end) != 0) {
+                    std::cerr << "cannot truncate " << path << "\n";
+                    close();
+                    return false;
+                }
+            }
+        }
+    }
+    if (writeHeader && ::write(m_fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        close();
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool SnapshotWriter::writeFrame(const BodySystem& bodies, double time, std::int64_t step) {
+    static const std::uint8_t zeros[128] = {};
+
+    size_t padded = bodies.paddedCount();
+    size_t stride = arrayStrideFor(padded);
+
+    SnapshotFrameHeader header = {};
+    header.bodyCount = bodies.count;
+    header.paddedCount = padded;
+    header.arrayStride = stride;
+    header.frameBytes = sizeof(SnapshotFrameHeader) + SNAPSHOT_ARRAY_COUNT * stride;
+    header.time = time;
+    header.step = step;
+
+    // the hot arrays are already padded; radius and color only hold count entries
+    struct Chunk { const void* data; size_t bytes; };
+    const Chunk arrays[SNAPSHOT_ARRAY_COUNT] = {
+        { bodies.x.data(), padded * sizeof(float) },
+        { bodies.y.data(), padded * sizeof(float) },
+        { bodies.z.data(), padded * sizeof(float) },
+        { bodies.vx.data(), padded * sizeof(float) },
+        { bodies.vy.data(), padded * sizeof(float) },
+        { bodies.vz.data(), padded * sizeof(float) },
+        { bodies.mass.data(), padded * sizeof(float) },
+        { bodies.radius.data(), bodies.count * sizeof(float) },
+        { bodies.color.data(), bodies.count * sizeof(std::uint32_t) },
+    };
+
+    Chunk chunks[1 + 2 * SNAPSHOT_ARRAY_COUNT];
+    int chunkCount = 0;
+    chunks[chunkCount++] = { &header, sizeof(header) };
+    for (const Chunk& array : arrays) {
+        if (array.bytes > 0) chunks[chunkCount++] = array;
+        if (stride > array.bytes) chunks[chunkCount++] = { zeros, stride - array.bytes };
+    }
+
+#ifdef _WIN32
+    if (!m_file) return false;
+    for (int c = 0; c < chunkCount; ++c) {
+        if (std::fwrite(chunks[c].data, 1, chunks[c].bytes, m_file) != chunks[c].bytes) return false;
+    }
+    return std::fflush(m_file) == 0;
+#else
+    if (m_fd < 0) return false;
+    struct iovec iov[1 + 2 * SNAPSHOT_ARRAY_COUNT];
+    for (int c = 0; c < chunkCount; ++c) {
+        iov[c].iov_base = const_cast<void*>(chunks[c].data);
+        iov[c].iov_len = chunks[c].bytes;
+    }
+    // writev may stop early on large frames, resume where it left off
+    struct iovec* next = iov;
+    int remaining = chunkCount;
+    while (remaining > 0) {
+        ssize_t written = ::writev(m_fd, next, remaining);
+        if (written < 0) return false;
+        while (remaining > 0 && (size_t)written >= next->iov_len) {
+            written -= (ssize_t)next->iov_len;
+            ++next;
+            --remaining;
+        }
+        if (remaining > 0) {
+            next->iov_base = static_cast<std::uint8_t*>(next->iov_base) + written;
+            next->iov_len -= (size_t)written;
+        }
+    }
+    return true;
+#endif
+}
+
+void SnapshotWriter::close() {
+#ifdef _WIN32
+    if (m_file) std::fclose(m_file);
+    m_file = nullptr;
+#else
+    if (m_fd >= 0) ::close(m_fd);
+    m_fd = -1;
+#endif
+}
+
+bool SnapshotFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << path << "\n";
+        return false;
+    }
+    in.seekg(0, std::ios::end);
+    m_size = (size_t)in.tellg();
+    in.seekg(0, std::ios::beg);
+    std::uint8_t* buffer = static_cast<std::uint8_t*>(::operator new(m_size, std::align_val_t(SIMD_ALIGNMENT)));
+    in.read(reinterpret_cast<char*>(buffer), (std::streamsize)m_size);
+    m_data = buffer;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "cannot open " << path << "\n";
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotFileHeader)) {
+        std::cerr << path << ": not a snapshot file\n";
+        ::close(fd);
+        return false;
+    }
+    m_size = (size_t)st.st_size;
+    void* mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "cannot map " << path << "\n";
+        m_size = 0;
+        return false;
+    }
+    m_data = static_cast<const std::uint8_t*>(mapping);
+    m_mapped = true;
+#endif
+
+    if (m_size < sizeof(SnapshotFileHeader) || !validFileHeader(*reinterpret_cast<const SnapshotFileHeader*>(m_data))) {
+        std::cerr << path << ": not a compatible snapshot file\n";
+        close();
+        return false;
+    }
+
+    size_t offset = sizeof(SnapshotFileHeader);
+    while (offset + sizeof(SnapshotFrameHeader) <= m_size) {
+        const auto* header = reinterpret_cast<const SnapshotFrameHeader*>(m_data + offset);
+        if (!consistentFrame(*header) || offset + header->frameBytes > m_size) {
+            // typically a frame cut short by a crash during writing
+            std::cerr << path << ": ignoring damaged frame at byte " << offset << "\n";
+            break;
+        }
+        m_frameOffsets.push_back(offset);
+        offset += (size_t)header->frameBytes;
+    }
+    return true;
+}
+
+void SnapshotFile::close() {
+    if (m_data) {
+#ifdef _WIN32
+        ::operator delete(const_cast<std::uint8_t*>(m_data), std::align_val_t(SIMD_ALIGNMENT));
+#else
+        if (m_mapped) ::munmap(const_cast<std::uint8_t*>(m_data), m_size);
+#endif
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+    m_frameOffsets.clear();
+}
+
+SnapshotFrame SnapshotFile::frame(size_t index) const {
+    SnapshotFrame frame;
+    const std::uint8_t* base = m_data + m_frameOffsets[index];
+    frame.header = reinterpret_cast<const SnapshotFrameHeader*>(base);
+
+    const std::uint8_t* arrays = base + sizeof(SnapshotFrameHeader);
+    size_t stride = (size_t)frame.header->arrayStride;
+    const float** floats[] = { &frame.x, &frame.y, &frame.z, &frame.vx, &frame.vy, &frame.vz, &frame.mass, &frame.radius };
+    for (size_t a = 0; a < 8; ++a) *floats[a] = reinterpret_cast<const float*>(arrays + a * stride);
+    frame.color = reinterpret_cast<const std::uint32_t*>(arrays + 8 * stride);
+    return frame;
+}
+
+bool isSnapshotFile(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    char magic[8] = {};
+    size_t got = std::fread(magic, 1, sizeof(magic), file);
+    std::fclose(file);
+    return got == sizeof(magic) && std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+bool writeSnapshot(const std::string& path, const BodySystem& bodies, double time, std::int64_t step) {
+    SnapshotWriter writer;
+    return writer.open(path, false) && writer.writeFrame(bodies, time, step);
+}
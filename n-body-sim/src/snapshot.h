@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "body_system.h"
+
+// binary snapshot / time-series file:
+//   SnapshotFileHeader
+//   frame*: SnapshotFrameHeader, then x y z vx vy vz mass radius color,
+//           each array paddedCount wide and starting on a 64-byte boundary
+// all fields are little-endian and the layout is fixed per version, so a
+// mapped file can be read in place
+#define SNAPSHOT_MAGIC "NBODYSNP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_ARRAY_COUNT 9
+
+struct SnapshotFileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t headerSize;
+    std::uint32_t frameHeaderSize;
+    std::uint32_t byteOrderMark;  // 0x01020304 as written by the producer
+    std::uint8_t reserved[40];
+};
+
+struct SnapshotFrameHeader {
+    std::uint64_t bodyCount;
+    std::uint64_t paddedCount;
+    std::uint64_t arrayStride;  // bytes between the starts of consecutive arrays
+    std::uint64_t frameBytes;   // header included
+    double time;
+    std::int64_t step;
+    std::uint8_t reserved[16];
+};
+
+static_assert(sizeof(SnapshotFileHeader) == 64, "snapshot header layout changed");
+static_assert(sizeof(SnapshotFrameHeader) == 64, "snapshot frame layout changed");
+
+// pointers into a mapped frame, valid while the SnapshotFile is open
+struct SnapshotFrame {
+    const SnapshotFrameHeader* header = nullptr;
+    const float* x = nullptr;
+    const float* y = nullptr;
+    const float* z = nullptr;
+    const float* vx = nullptr;
+    const float* vy = nullptr;
+    const float* vz = nullptr;
+    const float* mass = nullptr;
+    const float* radius = nullptr;
+    const std::uint32_t* color = nullptr;
+
+    // copies the frame into owned, aligned arrays for further simulation; a
+    // mixed precision system keeps its precision and starts from the floats
+    void copyTo(BodySystem& bodies) const;
+};
+
+// appends frames with one vectored write per frame
+class SnapshotWriter {
+public:
+    SnapshotWriter() = default;
+    ~SnapshotWriter() { close(); }
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // append keeps the complete frames of a compatible file and cuts off a
+    // damaged last frame, so new frames follow the last readable one
+    bool open(const std::string& path, bool append);
+    bool writeFrame(const BodySystem& bodies, double time, std::int64_t step);
+    void close();
+
+    // complete frames kept by an append, and whether the last of them is at step
+    size_t existingFrames() const { return m_existingFrames; }
+    bool endsAtStep(std::int64_t step) const { return m_existingFrames > 0 && m_lastExistingStep == step; }
+
+private:
+    size_t m_existingFrames = 0;
+    std::int64_t m_lastExistingStep = 0;
+    int m_fd = -1;
+    std::FILE* m_file = nullptr;  // used where there is no writev
+};
+
+// read-only mapping of a snapshot file
+class SnapshotFile {
+public:
+    SnapshotFile() = default;
+    ~SnapshotFile() { close(); }
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    size_t frameCount() const { return m_frameOffsets.size(); }
+    SnapshotFrame frame(size_t index) const;
+
+private:
+    const std::uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+    std::vector<size_t> m_frameOffsets;
+};
+
+bool isSnapshotFile(const std::string& path);
+bool writeSnapshot(const std::string& path, const BodySystem& bodies, double time, std::int64_t step);
@@ -0,0 +1,26 @@
+#pragma once
+#include <cmath>
+
+template <typename T>
+struct Vec3T {
+    T x, y, z;
+
+    Vec3T operator+(const Vec3T& o) const { return { x + o.x, y + o.y, z + o.z }; }
+    Vec3T operator-(const Vec3T& o) const { return { x - o.x, y - o.y, z - o.z }; }
+    Vec3T operator*(T s) const { return { x * s, y * s, z * s }; }
+    Vec3T& operator+=(const Vec3T& o) { x += o.x; y += o.y; z += o.z; return *this; }
+    Vec3T& operator-=(const Vec3T& o) { x -= o.x; y -= o.y; z -= o.z; return *this; }
+
+    T lengthSquared() const { return x * x + y * y + z * z; }
+    T length() const { return std::sqrt(lengthSquared()); }
+    Vec3T normalized() const {
+        T len = length();
+        return len > T(0) ? *this * (T(1) / len) : Vec3T{ 0, 0, 0 };
+    }
+
+    template <typename U>
+    Vec3T<U> as() const { return { (U)x, (U)y, (U)z }; }
+};
+
+using Vec3 = Vec3T<float>;
+using Vec3d = Vec3T<double>;
@@ -0,0 +1,136 @@
+// google benchmark suite for the raycasting hot paths; export results with
+// --benchmark_out=results.json --benchmark_out_format=json
+#include <benchmark/benchmark.h>
+#include <SDL.h>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "ray_packet.h"
+#include "ray_query.h"
+#include "raster.h"
+#include "scene.h"
+
+#define SURFACE_WIDTH 1024
+#define SURFACE_HEIGHT 1024
+
+static std::vector<Line> RandomRays(size_t count, double length)
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> position(0, SURFACE_WIDTH);
+    std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+    std::vector<Line> rays(count);
+    for (Line &ray : rays)
+    {
+        double x = position(rng), y = position(rng), a = angle(rng);
+        ray = {x, y, x + length * cos(a), y + length * sin(a)};
+    }
+    return rays;
+}
+
+// pixels per second for a disk, or with a second argument a ring of that outline width
+static void BM_FillCircle(benchmark::State &state)
+{
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, SURFACE_WIDTH, SURFACE_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    Circle circle = {SURFACE_WIDTH / 2.0, SURFACE_HEIGHT / 2.0, (double)state.range(0)};
+    int outline = (int)state.range(1);
+    for (auto _ : state)
+    {
+        FillCircle(surface, circle, 0xFFFFFFFF, outline);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)(M_PI * circle.r * circle.r));
+    state.SetLabel("items = disk pixels");
+    SDL_FreeSurface(surface);
+}
+BENCHMARK(BM_FillCircle)->ArgsProduct({{4, 32, 256}, {0, 200}});
+
+// lines per second for random rays; long rays mostly run off the surface and get clipped
+static void BM_DrawLine(benchmark::State &state)
+{
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, SURFACE_WIDTH, SURFACE_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    std::vector<Line> rays = RandomRays(4096, (double)state.range(0));
+    bool antialias = state.range(1) != 0;
+    for (auto _ : state)
+    {
+        for (const Line &ray : rays)
+        {
+            if (antialias)
+                DrawLineAA(surface, ray, 0xFFFF00FF);
+            else
+                DrawLine(surface, ray, 0xFFFF00FF);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * rays.size());
+    state.SetLabel("items = lines");
+    SDL_FreeSurface(surface);
+}
+BENCHMARK(BM_DrawLine)->ArgsProduct({{64, 1250}, {0, 1}});
+
+// rays per second against one circle, the demo's original per-ray test
+static void BM_CheckRayCastCollision(benchmark::State &state)
+{
+    std::vector<Line> rays = RandomRays(4096, 1250);
+    Circle circle = {SURFACE_WIDTH / 2.0, SURFACE_HEIGHT / 2.0, 100};
+    int hits = 0;
+    for (auto _ : state)
+    {
+        hits = 0;
+        for (Line ray : rays)
+            hits += CheckRayCastCollision(ray, circle);
+        benchmark::DoNotOptimize(hits);
+    }
+    state.SetItemsProcessed(state.iterations() * rays.size());
+    state.counters["hits"] = hits;
+}
+BENCHMARK(BM_CheckRayCastCollision);
+
+// the same query as SIMD packets
+static void BM_IntersectCircle(benchmark::State &state)
+{
+    std::vector<Line> rays = RandomRays(4096, 1250);
+    RayBatch batch;
+    batch.Resize(rays.size());
+    for (size_t i = 0; i < rays.size(); i++)
+        batch.Set(i, rays[i]);
+    Circle circle = {SURFACE_WIDTH / 2.0, SURFACE_HEIGHT / 2.0, 100};
+    for (auto _ : state)
+    {
+        batch.ResetHits();
+        IntersectCircle(batch, circle);
+        benchmark::ClobberMemory();
+    }
+    // should match BM_CheckRayCastCollision's count, up to float rounding at tangents
+    int hits = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+        hits += batch.Hit(i);
+    if (hits == 0)
+        state.SkipWithError("no ray hit the circle");
+    state.SetItemsProcessed(state.iterations() * rays.size());
+    state.counters["hits"] = hits;
+    state.SetLabel(RayPacketKernelName());
+}
+BENCHMARK(BM_IntersectCircle);
+
+// rays per second through the grid for scenes of the given circle count
+static void BM_SceneCast(benchmark::State &state)
+{
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> position(0, SURFACE_WIDTH);
+    Scene scene;
+    for (int i = 0; i < state.range(0); i++)
+        scene.AddCircle({position(rng), position(rng), 2 + position(rng) / SURFACE_WIDTH * 6});
+    scene.Build();
+
+    std::vector<Line> rays = RandomRays(4096, 1250);
+    std::vector<double> distances(rays.size());
+    for (auto _ : state)
+    {
+        CastRays(scene, rays.data(), rays.size(), distances.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * rays.size());
+}
+BENCHMARK(BM_SceneCast)->RangeMultiplier(8)->Range(8, 32768);
+
+BENCHMARK_MAIN();
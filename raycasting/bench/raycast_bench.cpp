@@ -0,0 +1,128 @@
+// rays per second of the scene queries across scene sizes
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "ray_fan.h"
+#include "ray_packet.h"
+#include "ray_query.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+#define WORLD_SIZE 4096.0
+#define RAY_LENGTH 1024.0
+
+static void BuildScene(Scene &scene, int circles, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<double> position(0, WORLD_SIZE);
+    std::uniform_real_distribution<double> radius(2, 12);
+    std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+    scene.Clear();
+    for (int i = 0; i < circles; i++)
+        scene.AddCircle({position(rng), position(rng), radius(rng)});
+    for (int i = 0; i < circles / 4; i++)
+    {
+        double x = position(rng), y = position(rng), a = angle(rng);
+        scene.AddWall({x, y, x + 40 * cos(a), y + 40 * sin(a)});
+    }
+    scene.Build();
+}
+
+// best of a few runs, in rays per second
+template <typename Fn>
+static double Measure(size_t rays, Fn &&fn)
+{
+    double best = 0;
+    for (int run = 0; run < 3; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, rays / seconds);
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t rayCount = 200000;
+    int threads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--rays=", 7) == 0 && atol(argv[i] + 7) > 0)
+            rayCount = atol(argv[i] + 7);
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+            threads = atoi(argv[i] + 10);
+        else
+        {
+            fprintf(stderr, "usage: %s [--rays=<n>] [--threads=<n>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    ThreadPool pool(threads);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> position(0, WORLD_SIZE);
+    std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+
+    std::vector<Line> rays(rayCount);
+    for (Line &ray : rays)
+    {
+        double x = position(rng), y = position(rng), a = angle(rng);
+        ray = {x, y, x + RAY_LENGTH * cos(a), y + RAY_LENGTH * sin(a)};
+    }
+    RayBatch batch;
+    batch.Resize(rayCount);
+    std::vector<double> distances(rayCount);
+
+    printf("%zu rays of length %.0f, %s packets of %d, %u threads\n", rayCount, RAY_LENGTH, RayPacketKernelName(),
+           RayPacket::width, pool.threadCount());
+    printf("%10s %14s %14s %14s %8s\n", "circles", "serial ray/s", "pooled ray/s", "batch ray/s", "hit %");
+
+    Scene scene;
+    for (int circles : {1, 16, 256, 4096, 65536})
+    {
+        BuildScene(scene, circles, rng);
+
+        double serial = Measure(rayCount, [&] { CastRays(scene, rays.data(), rayCount, distances.data()); });
+        double pooled = Measure(rayCount, [&] { CastRays(scene, rays.data(), rayCount, distances.data(), &pool); });
+        double packets = Measure(rayCount, [&]
+        {
+            for (size_t i = 0; i < rayCount; i++)
+                batch.Set(i, rays[i]);
+            scene.Cast(batch);
+        });
+
+        size_t hits = 0;
+        for (double distance : distances)
+            hits += std::isfinite(distance);
+        printf("%10d %14.3g %14.3g %14.3g %8.1f\n", circles, serial, pooled, packets, 100.0 * hits / rayCount);
+    }
+
+    // laying out the fans of many emitters, without casting: trig per ray against the table
+    const int fanRays = 1024;
+    size_t emitters = std::max<size_t>(1, rayCount / fanRays);
+    size_t fanTotal = emitters * fanRays;
+    batch.Resize(fanTotal);
+    RayFan fan;
+    fan.Build(fanRays);
+    double trig = Measure(fanTotal, [&]
+    {
+        for (size_t e = 0; e < emitters; e++)
+            for (int k = 0; k < fanRays; k++)
+            {
+                double a = 2 * M_PI * k / fanRays, x = (double)e, y = (double)e;
+                batch.Set(e * fanRays + k, {x, y, x + RAY_LENGTH * cos(a), y + RAY_LENGTH * sin(a)});
+            }
+    });
+    double table = Measure(fanTotal, [&]
+    {
+        for (size_t e = 0; e < emitters; e++)
+            fan.Emit(batch, e * fanRays, 0, fanRays, (double)e, (double)e, RAY_LENGTH);
+    });
+    printf("fan layout of %zu x %d rays: %.3g ray/s with cos/sin, %.3g ray/s from RayFan\n", emitters, fanRays, trig, table);
+    return 0;
+}
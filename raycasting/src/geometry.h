@@ -0,0 +1,29 @@
+#pragma once
+
+struct Circle
+{
+    double x;
+    double y;
+    double r;
+};
+
+struct Line
+{
+    double sx;
+    double sy;
+    double ex;
+    double ey;
+};
+
+struct LineEquation
+{
+    double a;
+    double b;
+    double c;
+};
+
+struct Point
+{
+    double x;
+    double y;
+};
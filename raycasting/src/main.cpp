@@ -2,247 +2,281 @@
 #include <SDL.h>
 #include <iostream>
 #include <cmath>
-
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "geometry.h"
+#include "profiler.h"
+#include "presenter.h"
+#include "profiler_overlay.h"
+#include "ray_dispatch.h"
+#include "ray_packet.h"
+#include "raster.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include "visibility.h"
+
+// initial window size, the window can be resized
 #define WIDTH 900
 #define HEIGHT 600
 
-struct Circle
-{
-    double x;
-    double y;
-    double r;
-};
-
-struct Line
-{
-    double sx;
-    double sy;
-    double ex;
-    double ey;
-};
-
-struct LineEquation
-{
-    double a;
-    double b;
-    double c;
-};
-
-LineEquation GetLineEquation(const Line &line)
-{
-    double a = line.sy - line.ey;
-    double b = line.ex - line.sx;
-    double c = line.sx * line.ey - line.ex * line.sy;
-    return {a, b, c};
-}
-
 Uint32 MapRGB(SDL_Surface *surface, Uint8 r, Uint8 g, Uint8 b)
 {
     return SDL_MapRGB(surface->format, r, g, b);
 }
 
-void SetPixel(SDL_Surface *surface, int x, int y, Uint32 color)
+int main(int argc, char *argv[])
 {
-    if (x < 0 || y < 0 || x >= surface->w || y >= surface->h)
-        return;
-
-    Uint32 *pixels = (Uint32 *)surface->pixels;
-    pixels[(y * surface->w) + x] = color;
-}
-
-void FillCircle(SDL_Surface *surface, const Circle &circle, Uint32 color, int outline)
-{
-    int cx = (int)circle.x;
-    int cy = (int)circle.y;
-    int r = (int)circle.r;
-    int r2 = r * r;
-
-    int useOutline = outline == 0 ? 0 : 1;
-
-    for (int y = cy - r; y <= cy + r; y++)
+    bool showProfiler = false;
+    std::string profileTracePath;
+    int rayCount = 288;
+    int extraCircles = 0;
+    int extraWalls = 0;
+    int emitterCount = 1;
+    int threads = 0;
+    bool visibility = false;
+    bool antialias = false;
+    // strength of the fans' concentration toward the dragged circle, 'f' toggles it
+    double foveation = 0.75;
+    bool foveate = false;
+    bool vsync = true;
+    for (int i = 1; i < argc; i++)
     {
-        for (int x = cx - r; x <= cx + r; x++)
+        if (strncmp(argv[i], "--rays=", 7) == 0 && atoi(argv[i] + 7) > 0)
+            rayCount = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--circles=", 10) == 0)
+            extraCircles = atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "--walls=", 8) == 0)
+            extraWalls = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "--emitters=", 11) == 0 && atoi(argv[i] + 11) > 0)
+            emitterCount = atoi(argv[i] + 11);
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+            threads = atoi(argv[i] + 10);
+        else if (strcmp(argv[i], "--visibility") == 0)
+            visibility = true;
+        else if (strcmp(argv[i], "--antialias") == 0)
+            antialias = true;
+        else if (strncmp(argv[i], "--foveation=", 12) == 0)
         {
-            int dx = x - cx;
-            int dy = y - cy;
-            int d2 = dx * dx + dy * dy;
-            if (useOutline)
-            {
-                if (d2 <= r2 + outline && d2 >= r2 - outline)
-                {
-                    SetPixel(surface, x, y, color);
-                }
-            }
-            else
-            {
-                if (d2 <= r2)
-                {
-                    SetPixel(surface, x, y, color);
-                }
-            }
+            foveation = atof(argv[i] + 12);
+            foveate = foveation > 0;
         }
-    }
-}
-
-// bresenham's line algorithm
-void DrawLine(SDL_Surface *surface, const Line &line, Uint32 color)
-{
-    int x0 = (int)line.sx;
-    int y0 = (int)line.sy;
-    int x1 = (int)line.ex;
-    int y1 = (int)line.ey;
-
-    int dx = abs(x1 - x0);
-    int dy = abs(y1 - y0);
-
-    int sx = x0 < x1 ? 1 : -1;
-    int sy = y0 < y1 ? 1 : -1;
-    int err = dx - dy;
-
-    int steps = 0;
-    const int maxSteps = 10000;
-
-    while (true)
-    {
-        SetPixel(surface, x0, y0, color);
-        if (x0 == x1 && y0 == y1)
-            break;
-        if (++steps > maxSteps)
-            break; // prevent infinite loop
-
-        int e2 = 2 * err;
-        if (e2 > -dy)
-        {
-            err -= dy;
-            x0 += sx;
-        }
-        if (e2 < dx)
+        else if (strcmp(argv[i], "--no-vsync") == 0)
+            vsync = false;
+        else if (strcmp(argv[i], "--profile-overlay") == 0)
+            showProfiler = true;
+        else if (strncmp(argv[i], "--profile-trace=", 16) == 0)
+            profileTracePath = argv[i] + 16;
+        else
         {
-            err += dx;
-            y0 += sy;
+            std::cerr << "usage: " << argv[0] << " [--rays=<n>] [--circles=<n>] [--walls=<n>] [--emitters=<n>] [--threads=<n>] [--visibility] [--antialias] [--foveation=<0-1>] [--no-vsync] [--profile-overlay] [--profile-trace=<file.json>]" << std::endl;
+            return 1;
         }
     }
-}
-
-bool PointOnRay(double px, double py, const Line &line)
-{
-    double dx = line.ex - line.sx;
-    double dy = line.ey - line.sy;
-
-    double lenSq = dx * dx + dy * dy;
-    double dot = (px - line.sx) * dx + (py - line.sy) * dy;
-
-    return dot >= 0 && dot <= lenSq;
-}
-
-// calculate intersections of line and circle
-int CheckRayCastCollision(SDL_Surface *surface, Line &line, const Circle &circle)
-{
-    double dx = line.ex - line.sx;
-    double dy = line.ey - line.sy;
-
-    double fx = line.sx - circle.x;
-    double fy = line.sy - circle.y;
-
-    double A = dx * dx + dy * dy;
-    double B = 2 * (fx * dx + fy * dy);
-    double C = fx * fx + fy * fy - circle.r * circle.r;
-
-    double D = B * B - 4 * A * C;
-
-    if (D < 0 || std::isnan(D) || std::isinf(D))
-        return 0;
-
-    double sqrtD = sqrt(D);
-    double t = (-B - sqrtD) / (2 * A); // nearest intersection
-
-    if (t < 0 || t > 1)
-        return 0; // ignore if intersection is behind or beyond
 
-    line.ex = line.sx + t * dx;
-    line.ey = line.sy + t * dy;
-
-    if ((int)line.ex == (int)line.sx && (int)line.ey == (int)line.sy)
-        return 0;
-
-    return 1;
-}
-
-int main()
-{
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         return 1;
 
-    SDL_Window *window = SDL_CreateWindow("Raycast", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, SDL_WINDOW_SHOWN);
+    SDL_Window *window = SDL_CreateWindow("Raycast", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
     if (!window)
         return 1;
 
-    SDL_Surface *surface = SDL_GetWindowSurface(window);
-    SDL_Rect screenRect = {0, 0, WIDTH, HEIGHT};
-
-    // objects
-    Circle circle = {150, 300, 25};
-    Circle object = {750, 300, 100};
+    Presenter presenter;
+    std::string presentError;
+    if (!presenter.open(window, SDL_PIXELFORMAT_ARGB8888, vsync, presentError))
+    {
+        std::cerr << presentError << std::endl;
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+    SDL_Surface *surface = presenter.surface();
+
+    // objects; emitters are not part of the scene. emitter 0 and scene circle 0 are
+    // the ones dragged around
+    std::vector<Circle> emitters = {{150, 300, 25}};
+    Scene scene;
+    size_t object = scene.AddCircle({750, 300, 100});
+
+    // optional clutter, deterministic so runs are comparable
+    srand(1);
+    for (int i = 0; i < extraCircles; i++)
+        scene.AddCircle({(double)(rand() % WIDTH), (double)(rand() % HEIGHT), 2.0 + rand() % 6});
+    for (int i = 0; i < extraWalls; i++)
+    {
+        double x = rand() % WIDTH;
+        double y = rand() % HEIGHT;
+        double a = rand() % 360 * M_PI / 180.0;
+        double length = 10 + rand() % 60;
+        scene.AddWall({x, y, x + length * cos(a), y + length * sin(a)});
+    }
+    // extra emitters are small, so their rays reach 4 * 50 pixels
+    for (int i = 1; i < emitterCount; i++)
+        emitters.push_back({(double)(rand() % WIDTH), (double)(rand() % HEIGHT), 4});
 
     // colors
     Uint32 bgColor = MapRGB(surface, 51, 51, 51);
     Uint32 circleColor = MapRGB(surface, 255, 255, 255);
     Uint32 lineColor = MapRGB(surface, 255, 255, 0);
+    Uint32 wallColor = MapRGB(surface, 0, 160, 255);
 
     bool running = true;
+    bool redraw = true;
     SDL_Event event;
 
     // raycast circle values
-    double angle = 1.25;
+    ThreadPool pool(threads);
+    RayDispatcher dispatcher(&pool);
+    std::vector<VisibilityPolygon> polygons;
+    PolygonScratch polygonScratch;
+    std::cout << emitterCount << " x " << rayCount << " rays, " << RayPacketKernelName() << " packets of "
+              << RayPacket::width << ", " << pool.threadCount() << " threads" << std::endl;
 
     while (running)
     {
-        // standard sdl stuff
-        SDL_FillRect(surface, &screenRect, bgColor);
-
-        SDL_LockSurface(surface);
+        // a static frame is not redrawn; sleep until something happens instead
+        if (!redraw || !surface)
+            SDL_WaitEvent(NULL);
 
         // event handling
-        while (SDL_PollEvent(&event))
         {
-            if (event.type == SDL_QUIT)
-                running = false;
-            if (event.type == SDL_MOUSEMOTION && event.motion.state != 0)
+            PROFILE_SCOPE("events");
+            while (SDL_PollEvent(&event))
             {
-                if (event.motion.state == 1) {
-                    circle.x = event.motion.x;
-                    circle.y = event.motion.y;
-                } else {
-                    object.x = event.motion.x;
-                    object.y = event.motion.y;
+                if (event.type == SDL_QUIT)
+                    running = false;
+                if (event.type == SDL_WINDOWEVENT)
+                {
+                    if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                    {
+                        if (presenter.resize(event.window.data1, event.window.data2))
+                            surface = presenter.surface();
+                        else if (!presenter.error().empty())
+                            std::cerr << presenter.error() << std::endl;
+                    }
+                    redraw = true;
+                }
+                if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_p)
+                {
+                    showProfiler = !showProfiler;
+                    redraw = true;
+                }
+                // v switches between the ray fan and the visibility polygon, a toggles antialiased
+                // rays and f foveated fans
+                if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_v)
+                {
+                    visibility = !visibility;
+                    redraw = true;
+                }
+                if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_a)
+                {
+                    antialias = !antialias;
+                    redraw = true;
+                }
+                if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_f)
+                {
+                    foveate = !foveate;
+                    redraw = true;
+                }
+                if (event.type == SDL_MOUSEMOTION && event.motion.state != 0)
+                {
+                    if (event.motion.state == 1) {
+                        emitters[0].x = event.motion.x;
+                        emitters[0].y = event.motion.y;
+                    } else {
+                        scene.MoveCircle(object, event.motion.x, event.motion.y);
+                    }
+                    redraw = true;
                 }
             }
         }
 
-        // rendering
-        for (double i = 0; i <= 360; i += angle)
+        // nothing is drawn while there is no framebuffer to draw into
+        if (!redraw || !surface)
+            continue;
+        redraw = false;
+
+        // standard sdl stuff
+        {
+            PROFILE_SCOPE("clear");
+            presenter.clear(bgColor);
+        }
+
+        scene.Build();
+        if (visibility)
+        {
+            {
+                PROFILE_SCOPE("visibility");
+                polygons.resize(emitters.size());
+                pool.parallelFor(0, emitters.size(), 1, [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; i++)
+                        polygons[i].Compute(scene, emitters[i].x, emitters[i].y, emitters[i].r * 50);
+                });
+            }
+            // the fan is not kept up to date meanwhile; rather than queueing every
+            // edit for it, it recasts whole when shown again
+            if (scene.Changed())
+                scene.MarkChangedEverywhere();
+            {
+                PROFILE_SCOPE("FillPolygon");
+                for (const VisibilityPolygon &polygon : polygons)
+                    FillPolygon(surface, polygon.Corners(), lineColor, polygonScratch);
+            }
+        }
+        else
         {
-            double radians = i * M_PI / 180.0;
-            double sx = circle.x;
-            double sy = circle.y;
-            double ex = sx + circle.r * cos(radians) * 50;
-            double ey = sy + circle.r * sin(radians) * 50;
-            Line newLine = {sx, sy, ex, ey};
-            bool isHit = CheckRayCastCollision(surface, newLine, object);
-            DrawLine(surface, newLine, lineColor); // normal
+            // rendering; only rays that can see an edit or belong to a moved emitter are recast
+            {
+                PROFILE_SCOPE("raycast");
+                // a foveated fan follows the circle, so moving either end recasts it whole
+                const Circle &target = scene.Circles()[object];
+                if (foveate)
+                    dispatcher.SetFoveation(atan2(target.y - emitters[0].y, target.x - emitters[0].x), foveation);
+                else
+                    dispatcher.SetFoveation(0, 0);
+                dispatcher.Update(scene, emitters, rayCount, 50);
+                scene.ClearChanges();
+            }
+
+            // drawing stays on this thread, after every ray has landed
+            {
+                PROFILE_SCOPE("DrawRays");
+                DrawRays(surface, dispatcher.Rays(), lineColor, antialias);
+            }
+        }
+
+        {
+            PROFILE_SCOPE("FillCircle");
+            for (const Circle &emitter : emitters)
+                FillCircle(surface, emitter, circleColor, 0);
+            for (const Circle &c : scene.Circles())
+                FillCircle(surface, c, circleColor, 0);
         }
 
-        FillCircle(surface, circle, circleColor, 0);
-        FillCircle(surface, object, circleColor, 0);
+        for (const Line &wall : scene.Walls())
+            DrawLine(surface, wall, wallColor);
+
+        if (showProfiler)
+            DrawProfilerOverlay(surface);
 
-        SDL_UnlockSurface(surface);
-        SDL_UpdateWindowSurface(window);
+        {
+            PROFILE_SCOPE("present");
+            presenter.present();
+        }
 
-        // control of framerate
-        SDL_Delay(16);
+        // control of framerate; with vsync present() already waits for the display
+        if (!presenter.vsync())
+            SDL_Delay(16);
     }
 
+    presenter.close();
     SDL_DestroyWindow(window);
     SDL_Quit();
+
+    if (PROFILING_ENABLED)
+        Profiler::instance().printSummary(std::cout);
+    if (!profileTracePath.empty() && !Profiler::instance().writeChromeTrace(profileTracePath))
+        std::cerr << "cannot write " << profileTracePath << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include "raster.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define RASTER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+static Uint32 *SurfaceRow(SDL_Surface *surface, int y)
+{
+    return (Uint32 *)((Uint8 *)surface->pixels + (size_t)y * surface->pitch);
+}
+
+void FillSpan(Uint32 *row, int xBegin, int xEnd, Uint32 color)
+{
+    Uint32 *out = row + xBegin;
+    Uint32 *end = row + xEnd;
+#if RASTER_SSE2
+    __m128i wide = _mm_set1_epi32((int)color);
+    for (; out + 4 <= end; out += 4)
+        _mm_storeu_si128((__m128i *)out, wide);
+#endif
+    for (; out < end; out++)
+        *out = color;
+}
+
+// floor(sqrt(n)) for n >= 0, exact for every int
+static int IntSqrt(int n)
+{
+    int root = (int)sqrt((double)n);
+    while (root * root > n)
+        root--;
+    while ((root + 1) * (root + 1) <= n)
+        root++;
+    return root;
+}
+
+void FillCircle(SDL_Surface *surface, const Circle &circle, Uint32 color, int outline)
+{
+    int cx = (int)circle.x;
+    int cy = (int)circle.y;
+    int r = (int)circle.r;
+    int r2 = r * r;
+    if (outline < 0)
+        return; // an inverted ring is empty
+
+    int yBegin = std::max(cy - r, 0);
+    int yEnd = std::min(cy + r, surface->h - 1);
+    for (int y = yBegin; y <= yEnd; y++)
+    {
+        int dy = y - cy;
+        Uint32 *row = SurfaceRow(surface, y);
+
+        // outer half width on this row, and for the ring the inner one: |dx| < inner is empty
+        int outer = std::min(r, IntSqrt(r2 + (outline > 0 ? outline : 0) - dy * dy));
+        int inner = 0;
+        if (outline > 0 && r2 - outline - dy * dy > 0)
+        {
+            int innerSq = r2 - outline - dy * dy;
+            inner = IntSqrt(innerSq);
+            if (inner * inner < innerSq)
+                inner++;
+        }
+
+        if (inner == 0)
+        {
+            int xBegin = std::max(cx - outer, 0);
+            int xEnd = std::min(cx + outer + 1, surface->w);
+            if (xBegin < xEnd)
+                FillSpan(row, xBegin, xEnd, color);
+            continue;
+        }
+        if (inner > outer)
+            continue;
+
+        int leftBegin = std::max(cx - outer, 0);
+        int leftEnd = std::min(cx - inner + 1, surface->w);
+        if (leftBegin < leftEnd)
+            FillSpan(row, leftBegin, leftEnd, color);
+        int rightBegin = std::max(cx + inner, 0);
+        int rightEnd = std::min(cx + outer + 1, surface->w);
+        if (rightBegin < rightEnd)
+            FillSpan(row, rightBegin, rightEnd, color);
+    }
+}
+
+// liang-barsky parameters: the part of the segment inside the box is [t0, t1]
+static bool ClipRange(const Line &line, double xMin, double yMin, double xMax, double yMax, double &t0, double &t1)
+{
+    double dx = line.ex - line.sx;
+    double dy = line.ey - line.sy;
+
+    // each boundary as p * t <= q; entering boundaries raise t0, leaving ones lower t1
+    double p[4] = {-dx, dx, -dy, dy};
+    double q[4] = {line.sx - xMin, xMax - line.sx, line.sy - yMin, yMax - line.sy};
+    t0 = 0;
+    t1 = 1;
+    for (int i = 0; i < 4; i++)
+    {
+        if (p[i] == 0)
+        {
+            if (q[i] < 0)
+                return false; // parallel and outside
+            continue;
+        }
+        double t = q[i] / p[i];
+        if (p[i] < 0)
+            t0 = std::max(t0, t);
+        else
+            t1 = std::min(t1, t);
+        if (t0 > t1)
+            return false;
+    }
+    return true;
+}
+
+bool ClipLine(Line &line, double xMin, double yMin, double xMax, double yMax)
+{
+    double t0, t1;
+    if (!ClipRange(line, xMin, yMin, xMax, yMax, t0, t1))
+        return false;
+
+    double dx = line.ex - line.sx;
+    double dy = line.ey - line.sy;
+    double sx = line.sx;
+    double sy = line.sy;
+    line = {sx + t0 * dx, sy + t0 * dy, sx + t1 * dx, sy + t1 * dy};
+    return true;
+}
+
+void DrawLine(SDL_Surface *surface, const Line &line, Uint32 color)
+{
+    // cut the line in double to a guard band one surface size around the surface,
+    // so the int conversions below stay in range; endpoints inside the band are
+    // left alone, so the walk only changes for lines reaching beyond it
+    Line band = line;
+    if (!ClipLine(band, -surface->w, -surface->h, 2.0 * surface->w, 2.0 * surface->h))
+        return;
+    int x0 = (int)band.sx;
+    int y0 = (int)band.sy;
+    int x1 = (int)band.ex;
+    int y1 = (int)band.ey;
+
+    int dx = abs(x1 - x0);
+    int dy = abs(y1 - y0);
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+
+    // the walk takes one step along the major axis per pixel and stays within half a
+    // pixel of the ideal line, so a step lands on the surface exactly when its ideal
+    // point rounds onto it: clip the step range against the surface grown by half a
+    // pixel and the loop keeps the pixels the unclipped walk would draw, without bounds
+    // checks. the margin drops exact half-pixel ties on the border, which could round out
+    const double margin = 0.5 - 1e-6;
+    double t0, t1;
+    Line ideal = {(double)x0, (double)y0, (double)x1, (double)y1};
+    if (!ClipRange(ideal, -margin, -margin, surface->w - 1 + margin, surface->h - 1 + margin, t0, t1))
+        return;
+    int steps = std::max(dx, dy);
+    int first = (int)ceil(t0 * steps);
+    int last = (int)floor(t1 * steps);
+
+    // lines starting off the surface skip to step first: every step moves along the
+    // major axis, and the minor axis has moved once for each m with
+    // (2m + 1) * major < 2 * first * minor
+    int major = std::max(dx, dy), minor = std::min(dx, dy);
+    long long rounded = 2LL * first * minor - major;
+    int minorSteps = rounded <= 0 ? 0 : (int)((rounded + 2LL * major - 1) / (2LL * major));
+    int xSteps = dx >= dy ? first : minorSteps;
+    int ySteps = dx >= dy ? minorSteps : first;
+    int x = x0 + sx * xSteps, y = y0 + sy * ySteps;
+    int err = dx - dy - xSteps * dy + ySteps * dx;
+
+    int rowStep = sy * (surface->pitch / 4);
+    Uint32 *pixel = SurfaceRow(surface, y) + x;
+    for (int k = first; k <= last; k++)
+    {
+        *pixel = color;
+
+        int e2 = 2 * err;
+        if (e2 > -dy)
+        {
+            err -= dy;
+            pixel += sx;
+        }
+        if (e2 < dx)
+        {
+            err += dx;
+            pixel += rowStep;
+        }
+    }
+}
+
+// per-channel mix of two 8888 pixels, any channel order; coverage is 0..256
+static Uint32 Blend(Uint32 background, Uint32 color, Uint32 coverage)
+{
+    Uint32 keep = 256 - coverage;
+    Uint32 rb = (((background & 0x00FF00FF) * keep + (color & 0x00FF00FF) * coverage) >> 8) & 0x00FF00FF;
+    Uint32 ag = (((background >> 8) & 0x00FF00FF) * keep + ((color >> 8) & 0x00FF00FF) * coverage) & 0xFF00FF00;
+    return rb | ag;
+}
+
+void DrawLineAA(SDL_Surface *surface, const Line &line, Uint32 color)
+{
+    Line clipped = line;
+    if (!ClipLine(clipped, 0, 0, surface->w - 1, surface->h - 1))
+        return;
+
+    double x0 = clipped.sx, y0 = clipped.sy;
+    double x1 = clipped.ex, y1 = clipped.ey;
+    // walk the major axis; steep lines swap x and y and write transposed
+    bool steep = fabs(y1 - y0) > fabs(x1 - x0);
+    if (steep)
+    {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+    }
+    if (x0 > x1)
+    {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    double gradient = x1 > x0 ? (y1 - y0) / (x1 - x0) : 0;
+    int minorLimit = steep ? surface->w : surface->h;
+    int pitch = surface->pitch / 4;
+    Uint32 *pixels = (Uint32 *)surface->pixels;
+    int xEnd = (int)floor(x1 + 0.5);
+    for (int x = (int)floor(x0 + 0.5); x <= xEnd; x++)
+    {
+        // rounding the ends can reach half a pixel past the clipped line
+        double y = std::clamp(y0 + gradient * (x - x0), 0.0, (double)(minorLimit - 1));
+        int yi = (int)floor(y);
+        Uint32 coverage = (Uint32)((y - yi) * 256);
+
+        // the pair of pixels straddling the ideal line share its coverage
+        Uint32 *first = steep ? pixels + (size_t)x * pitch + yi : pixels + (size_t)yi * pitch + x;
+        *first = Blend(*first, color, 256 - coverage);
+        if (coverage > 0 && yi + 1 < minorLimit)
+        {
+            Uint32 *second = first + (steep ? 1 : pitch);
+            *second = Blend(*second, color, coverage);
+        }
+    }
+}
+
+void DrawRays(SDL_Surface *surface, const RayBatch &rays, Uint32 color, bool antialias)
+{
+    if (antialias)
+    {
+        for (size_t i = 0; i < rays.Count(); i++)
+            DrawLineAA(surface, rays.Get(i), color);
+    }
+    else
+    {
+        for (size_t i = 0; i < rays.Count(); i++)
+            DrawLine(surface, rays.Get(i), color);
+    }
+}
+
+void FillPolygon(SDL_Surface *surface, const std::vector<Point> &corners, Uint32 color, PolygonScratch &scratch)
+{
+    if (corners.size() < 3)
+        return;
+
+    // edge table, sorted by where the edges start
+    std::vector<PolygonEdge> &edges = scratch.edges;
+    edges.clear();
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        Point a = corners[i];
+        Point b = corners[(i + 1) % corners.size()];
+        if (a.y == b.y)
+            continue; // horizontal edges never cross a pixel center row
+        if (a.y > b.y)
+            std::swap(a, b);
+        edges.push_back({a.y, b.y, a.x, (b.x - a.x) / (b.y - a.y)});
+    }
+    std::sort(edges.begin(), edges.end(), [](const PolygonEdge &l, const PolygonEdge &r)
+    {
+        return l.yTop < r.yTop;
+    });
+    // all edges horizontal: the polygon covers no pixel center
+    if (edges.empty())
+        return;
+
+    double yMin = edges.front().yTop;
+    double yMax = 0;
+    for (const PolygonEdge &edge : edges)
+        yMax = std::max(yMax, edge.yBottom);
+
+    int rowBegin = std::max(0, (int)ceil(yMin - 0.5));
+    int rowEnd = std::min(surface->h, (int)ceil(yMax - 0.5));
+
+    std::vector<const PolygonEdge *> &active = scratch.active;
+    std::vector<double> &crossings = scratch.crossings;
+    active.clear();
+    size_t next = 0;
+    for (int y = rowBegin; y < rowEnd; y++)
+    {
+        double center = y + 0.5;
+
+        // active edge table: add edges starting above this row, drop finished ones
+        while (next < edges.size() && edges[next].yTop <= center)
+            active.push_back(&edges[next++]);
+        active.erase(std::remove_if(active.begin(), active.end(), [&](const PolygonEdge *edge)
+        {
+            return edge->yBottom <= center;
+        }), active.end());
+
+        crossings.clear();
+        for (const PolygonEdge *edge : active)
+            crossings.push_back(edge->x + (center - edge->yTop) * edge->slope);
+        std::sort(crossings.begin(), crossings.end());
+
+        Uint32 *row = SurfaceRow(surface, y);
+        for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+        {
+            // pixels whose centers lie in [left, right)
+            int xBegin = std::max(0, (int)ceil(crossings[i] - 0.5));
+            int xEnd = std::min(surface->w, (int)ceil(crossings[i + 1] - 0.5));
+            if (xBegin < xEnd)
+                FillSpan(row, xBegin, xEnd, color);
+        }
+    }
+}
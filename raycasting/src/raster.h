@@ -0,0 +1,46 @@
+#pragma once
+#include <SDL.h>
+#include <vector>
+#include "geometry.h"
+#include "ray_packet.h"
+
+// fills pixels [xBegin, xEnd) of a row with 16-byte stores where possible; no clipping
+void FillSpan(Uint32 *row, int xBegin, int xEnd, Uint32 color);
+
+// disk of pixels within circle.r of the center, rounded to whole pixels; with
+// outline > 0 only the ring where |dx^2 + dy^2 - r^2| <= outline. clipped to
+// the surface, one or two spans per row
+void FillCircle(SDL_Surface *surface, const Circle &circle, Uint32 color, int outline);
+
+// liang-barsky: trims the segment to [xMin, xMax] x [yMin, yMax], false when
+// nothing of it is inside
+bool ClipLine(Line &line, double xMin, double yMin, double xMax, double yMax);
+
+// bresenham between the truncated endpoints, after cutting them to a guard band
+// around the surface; the walk is clipped to the surface up front, so the inner
+// loop writes without bounds checks
+void DrawLine(SDL_Surface *surface, const Line &line, Uint32 color);
+// wu's antialiased line, blended into what is already on the surface
+void DrawLineAA(SDL_Surface *surface, const Line &line, Uint32 color);
+// every ray of the batch, cut at its hit, in one pass
+void DrawRays(SDL_Surface *surface, const RayBatch &rays, Uint32 color, bool antialias);
+
+struct PolygonEdge
+{
+    double yTop;
+    double yBottom;
+    double x;     // at yTop
+    double slope; // dx per dy
+};
+
+// edge tables kept between FillPolygon calls, so filling stays off the heap
+struct PolygonScratch
+{
+    std::vector<PolygonEdge> edges;
+    std::vector<const PolygonEdge *> active;
+    std::vector<double> crossings;
+};
+
+// scanline fill of a simple polygon with the even-odd rule; pixel centers are
+// sampled, so shared edges of adjacent polygons are not drawn twice
+void FillPolygon(SDL_Surface *surface, const std::vector<Point> &corners, Uint32 color, PolygonScratch &scratch);
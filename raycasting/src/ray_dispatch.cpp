@@ -0,0 +1,120 @@
+#include "ray_dispatch.h"
+#include <algorithm>
+#include <cmath>
+#include "scene.h"
+#include "thread_pool.h"
+
+void RayDispatcher::Cast(const Scene &scene, const std::vector<Circle> &emitters, int raysPerEmitter, double reachScale)
+{
+    size_t count = emitters.size() * (size_t)raysPerEmitter;
+    if (m_rays.Count() != count)
+        m_rays.Resize(count);
+
+    m_fan.Build(raysPerEmitter, m_focus, m_foveation);
+    auto cast = [&](size_t firstPacket, size_t lastPacket)
+    {
+        // the packets' share of every fan they overlap
+        size_t end = std::min(count, lastPacket * RayPacket::width);
+        for (size_t i = firstPacket * RayPacket::width; i < end;)
+        {
+            size_t e = i / raysPerEmitter;
+            int begin = (int)(i % raysPerEmitter);
+            int stop = (int)std::min<size_t>(raysPerEmitter, begin + (end - i));
+            const Circle &emitter = emitters[e];
+            m_fan.Emit(m_rays, e * raysPerEmitter, begin, stop, emitter.x, emitter.y, emitter.r * reachScale);
+            i += stop - begin;
+        }
+        scene.Cast(m_rays, firstPacket, lastPacket);
+    };
+
+    size_t packets = m_rays.Packets().size();
+    if (m_pool)
+        m_pool->parallelFor(0, packets, chunkSize(packets, m_pool->threadCount(), 1), cast);
+    else
+        cast(0, packets);
+
+    m_emitters = emitters;
+    m_raysPerEmitter = raysPerEmitter;
+    m_reachScale = reachScale;
+}
+
+size_t RayDispatcher::Update(const Scene &scene, const std::vector<Circle> &emitters, int raysPerEmitter, double reachScale)
+{
+    bool relayout = m_fan.Build(raysPerEmitter, m_focus, m_foveation);
+    if (relayout || scene.ChangedEverywhere() || emitters.size() != m_emitters.size() ||
+        raysPerEmitter != m_raysPerEmitter || reachScale != m_reachScale)
+    {
+        Cast(scene, emitters, raysPerEmitter, reachScale);
+        return m_rays.Count();
+    }
+
+    m_pending.clear();
+    for (size_t e = 0; e < emitters.size(); e++)
+    {
+        const Circle &emitter = emitters[e];
+        std::uint32_t first = (std::uint32_t)(e * raysPerEmitter);
+        bool moved = emitter.x != m_emitters[e].x || emitter.y != m_emitters[e].y || emitter.r != m_emitters[e].r;
+        if (moved)
+        {
+            m_emitters[e] = emitter;
+            m_fan.Emit(m_rays, first, 0, raysPerEmitter, emitter.x, emitter.y, emitter.r * reachScale);
+            for (int k = 0; k < raysPerEmitter; k++)
+                m_pending.push_back(first + k);
+            continue;
+        }
+
+        size_t before = m_pending.size();
+        for (const Circle &change : scene.Changes())
+        {
+            double dx = change.x - emitter.x;
+            double dy = change.y - emitter.y;
+            double distance = sqrt(dx * dx + dy * dy);
+            if (distance - change.r > emitter.r * reachScale)
+                continue; // out of reach
+
+            // rays within asin(r / d) of the direction to the change, plus the
+            // nearest one on either side; an emitter inside the change sees it
+            // in every direction
+            int kBegin = 0, kEnd = raysPerEmitter - 1;
+            if (distance > change.r)
+            {
+                double center = atan2(dy, dx);
+                double halfWidth = asin(change.r / distance);
+                kBegin = m_fan.Index(center - halfWidth) - 1;
+                kEnd = m_fan.Index(center + halfWidth);
+                // the span wraps past the last ray
+                if (kEnd <= kBegin)
+                    kEnd += raysPerEmitter;
+                kEnd = std::min(kEnd, kBegin + raysPerEmitter - 1);
+            }
+            for (int k = kBegin; k <= kEnd; k++)
+                m_pending.push_back(first + (std::uint32_t)(((k % raysPerEmitter) + raysPerEmitter) % raysPerEmitter));
+        }
+
+        // overlapping spans of one emitter
+        std::sort(m_pending.begin() + before, m_pending.end());
+        m_pending.erase(std::unique(m_pending.begin() + before, m_pending.end()), m_pending.end());
+    }
+
+    CastPending(scene);
+    return m_pending.size();
+}
+
+void RayDispatcher::CastPending(const Scene &scene)
+{
+    auto cast = [&](size_t begin, size_t end)
+    {
+        RayHit hit;
+        for (size_t i = begin; i < end; i++)
+        {
+            std::uint32_t ray = m_pending[i];
+            m_rays.SetHit(ray, scene.Cast(m_rays.Ray(ray), hit) ? (float)hit.t : 1.0f);
+        }
+    };
+
+    size_t count = m_pending.size();
+    if (m_pool && count > 256)
+        m_pool->parallelFor(0, count, chunkSize(count, m_pool->threadCount(), 64), cast);
+    else
+        cast(0, count);
+}
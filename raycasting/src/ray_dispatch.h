@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "geometry.h"
+#include "ray_fan.h"
+#include "ray_packet.h"
+
+class Scene;
+class ThreadPool;
+
+// casts a full fan of rays from every emitter into one preallocated batch. the
+// flat emitter * angle index is split across the pool, so one emitter divides
+// its sweep and many emitters divide among themselves; nothing is drawn here
+class RayDispatcher
+{
+public:
+    // pool may be null to cast on the calling thread
+    explicit RayDispatcher(ThreadPool *pool) : m_pool(pool) {}
+
+    // emitter i sends raysPerEmitter rays around its center, each reaching
+    // emitter.r * reachScale; reallocates only when the total changes
+    void Cast(const Scene &scene, const std::vector<Circle> &emitters, int raysPerEmitter, double reachScale);
+
+    // brings the previous result up to date and returns how many rays were recast.
+    // an emitter that moved recasts its whole fan; otherwise only rays aimed into
+    // the angular span of one of scene.Changes() are recast, so a static frame
+    // costs nothing. the caller clears the scene's changes afterwards
+    size_t Update(const Scene &scene, const std::vector<Circle> &emitters, int raysPerEmitter, double reachScale);
+
+    // concentrates every fan toward the focus angle, see RayFan; 0 keeps rays
+    // evenly spread. a changed layout recasts everything at the next Update
+    void SetFoveation(double focus, double strength)
+    {
+        m_focus = strength > 0 ? focus : 0;
+        m_foveation = strength;
+    }
+
+    // rays of emitter e are [e * raysPerEmitter, (e + 1) * raysPerEmitter),
+    // in the order of Fan()
+    const RayBatch &Rays() const { return m_rays; }
+    const RayFan &Fan() const { return m_fan; }
+
+private:
+    void CastPending(const Scene &scene);
+
+    ThreadPool *m_pool;
+    RayBatch m_rays;
+    RayFan m_fan;
+    double m_focus = 0;
+    double m_foveation = 0;
+
+    // what the current batch was cast with, for Update
+    std::vector<Circle> m_emitters;
+    int m_raysPerEmitter = 0;
+    double m_reachScale = 0;
+    std::vector<std::uint32_t> m_pending;
+};
@@ -0,0 +1,53 @@
+#include "ray_fan.h"
+#include <algorithm>
+#include <cmath>
+
+bool RayFan::Build(int count, double focus, double foveation)
+{
+    // s >= 1 would fold the fan over itself at the focus
+    foveation = std::min(std::max(foveation, 0.0), 0.99);
+    if (count == m_count && focus == m_focus && foveation == m_foveation)
+        return false;
+
+    m_count = count;
+    m_focus = focus;
+    m_foveation = foveation;
+    m_offset.resize(count);
+    m_cos.resize(count);
+    m_sin.resize(count);
+    for (int k = 0; k < count; k++)
+    {
+        double u = 2 * M_PI * k / count;
+        double offset = u - foveation * sin(u);
+        m_offset[k] = offset;
+        m_cos[k] = (float)cos(focus + offset);
+        m_sin[k] = (float)sin(focus + offset);
+    }
+    return true;
+}
+
+int RayFan::Index(double angle) const
+{
+    double offset = fmod(angle - m_focus, 2 * M_PI);
+    if (offset < 0)
+        offset += 2 * M_PI;
+    return (int)(std::lower_bound(m_offset.begin(), m_offset.end(), offset) - m_offset.begin());
+}
+
+void RayFan::Emit(RayBatch &batch, size_t first, int begin, int end, double x, double y, double reach) const
+{
+    std::vector<RayPacket> &packets = batch.Packets();
+    float sx = (float)x;
+    float sy = (float)y;
+    float length = (float)reach;
+    for (int k = begin; k < end; k++)
+    {
+        RayPacket &packet = packets[(first + k) / RayPacket::width];
+        size_t lane = (first + k) % RayPacket::width;
+        packet.sx[lane] = sx;
+        packet.sy[lane] = sy;
+        packet.dx[lane] = length * m_cos[k];
+        packet.dy[lane] = length * m_sin[k];
+        packet.t[lane] = 1.0f;
+    }
+}
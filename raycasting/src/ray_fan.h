@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include "ray_packet.h"
+
+// unit directions of a full turn of rays, computed once per layout and stored
+// SoA like the packets they are copied into, so casting a fan costs no trig. rays run
+// counterclockwise from the focus; with foveation s in [0, 1) ray k sits at
+//   focus + 2 pi u - s sin(2 pi u), u = k / count
+// which packs rays (1 + s) / (1 - s) times denser toward the focus than away
+// from it. s = 0 with focus 0 is the even fan starting at angle 0
+class RayFan
+{
+public:
+    // returns whether the layout changed; the same arguments again are free
+    bool Build(int count, double focus = 0, double foveation = 0);
+
+    int Count() const { return m_count; }
+    double Focus() const { return m_focus; }
+    double Foveation() const { return m_foveation; }
+
+    const float *Cos() const { return m_cos.data(); }
+    const float *Sin() const { return m_sin.data(); }
+    // radians of ray k, in [focus, focus + 2 pi)
+    double Angle(int k) const { return m_focus + m_offset[k]; }
+
+    // first ray at or counterclockwise of angle, in [0, Count()]; Count()
+    // when angle lies past the last ray
+    int Index(double angle) const;
+
+    // rays [begin, end) of the fan from (x, y), each reach long, into batch
+    // slots first + k; the batch must already hold them
+    void Emit(RayBatch &batch, size_t first, int begin, int end, double x, double y, double reach) const;
+
+private:
+    int m_count = 0;
+    double m_focus = 0;
+    double m_foveation = 0;
+    std::vector<double> m_offset; // angle of every ray past the focus
+    std::vector<float> m_cos;
+    std::vector<float> m_sin;
+};
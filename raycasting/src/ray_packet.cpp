@@ -0,0 +1,245 @@
+#include "ray_packet.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RAY_PACKET_SSE 1
+#define RAY_PACKET_AVX2 (RAY_PACKET_WIDTH % 8 == 0)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define RAY_PACKET_NEON 1
+#include <arm_neon.h>
+#endif
+
+void RayBatch::Resize(size_t count)
+{
+    m_count = count;
+    m_packets.resize((count + RayPacket::width - 1) / RayPacket::width);
+
+    // padding lanes: zero length, so A = 0 and t stays NaN
+    for (size_t i = count; i < m_packets.size() * RayPacket::width; i++)
+        Set(i, {0, 0, 0, 0});
+}
+
+void RayBatch::Set(size_t i, const Line &line)
+{
+    RayPacket &packet = m_packets[i / RayPacket::width];
+    size_t lane = i % RayPacket::width;
+    packet.sx[lane] = (float)line.sx;
+    packet.sy[lane] = (float)line.sy;
+    packet.dx[lane] = (float)(line.ex - line.sx);
+    packet.dy[lane] = (float)(line.ey - line.sy);
+    packet.t[lane] = 1.0f;
+}
+
+Line RayBatch::Get(size_t i) const
+{
+    const RayPacket &packet = m_packets[i / RayPacket::width];
+    size_t lane = i % RayPacket::width;
+    double sx = packet.sx[lane];
+    double sy = packet.sy[lane];
+    double t = packet.t[lane];
+    return {sx, sy, sx + t * packet.dx[lane], sy + t * packet.dy[lane]};
+}
+
+Line RayBatch::Ray(size_t i) const
+{
+    const RayPacket &packet = m_packets[i / RayPacket::width];
+    size_t lane = i % RayPacket::width;
+    double sx = packet.sx[lane];
+    double sy = packet.sy[lane];
+    return {sx, sy, sx + packet.dx[lane], sy + packet.dy[lane]};
+}
+
+bool RayBatch::Hit(size_t i) const
+{
+    return m_packets[i / RayPacket::width].t[i % RayPacket::width] < 1.0f;
+}
+
+void RayBatch::SetHit(size_t i, float t)
+{
+    m_packets[i / RayPacket::width].t[i % RayPacket::width] = t;
+}
+
+void RayBatch::ResetHits()
+{
+    for (RayPacket &packet : m_packets)
+        for (int lane = 0; lane < RayPacket::width; lane++)
+            packet.t[lane] = 1.0f;
+}
+
+#if RAY_PACKET_AVX2
+// eight lanes per register; packets wider than 8 are walked in blocks
+__attribute__((target("avx2,fma")))
+static void IntersectCircleAvx2(RayPacket *first, RayPacket *last, const Circle &circle)
+{
+    const __m256 cx = _mm256_set1_ps((float)circle.x);
+    const __m256 cy = _mm256_set1_ps((float)circle.y);
+    const __m256 r2 = _mm256_set1_ps((float)(circle.r * circle.r));
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+    for (RayPacket *it = first; it != last; it++)
+    {
+        RayPacket &packet = *it;
+        for (int i = 0; i < RayPacket::width; i += 8)
+        {
+            __m256 dx = _mm256_load_ps(packet.dx + i);
+            __m256 dy = _mm256_load_ps(packet.dy + i);
+            __m256 fx = _mm256_sub_ps(_mm256_load_ps(packet.sx + i), cx);
+            __m256 fy = _mm256_sub_ps(_mm256_load_ps(packet.sy + i), cy);
+            __m256 t = _mm256_load_ps(packet.t + i);
+
+            __m256 A = _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx));
+            __m256 halfB = _mm256_fmadd_ps(fy, dy, _mm256_mul_ps(fx, dx));
+            __m256 C = _mm256_sub_ps(_mm256_fmadd_ps(fy, fy, _mm256_mul_ps(fx, fx)), r2);
+            __m256 D = _mm256_fmsub_ps(halfB, halfB, _mm256_mul_ps(A, C));
+
+            // ordered compares reject the NaNs from D < 0 and A = 0
+            __m256 root = _mm256_div_ps(_mm256_sub_ps(_mm256_xor_ps(halfB, signBit), _mm256_sqrt_ps(D)), A);
+            __m256 hit = _mm256_and_ps(_mm256_cmp_ps(root, zero, _CMP_GE_OQ), _mm256_cmp_ps(root, t, _CMP_LT_OQ));
+            _mm256_store_ps(packet.t + i, _mm256_blendv_ps(t, root, hit));
+        }
+    }
+}
+
+static bool CpuHasAvx2()
+{
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+}
+#endif
+
+#if RAY_PACKET_SSE
+// x86-64 baseline, so no dispatch; SSE2 has no blend, the select is and/andnot/or
+static void IntersectCircleSse(RayPacket *first, RayPacket *last, const Circle &circle)
+{
+    const __m128 cx = _mm_set1_ps((float)circle.x);
+    const __m128 cy = _mm_set1_ps((float)circle.y);
+    const __m128 r2 = _mm_set1_ps((float)(circle.r * circle.r));
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+
+    for (RayPacket *it = first; it != last; it++)
+    {
+        RayPacket &packet = *it;
+        for (int i = 0; i < RayPacket::width; i += 4)
+        {
+            __m128 dx = _mm_load_ps(packet.dx + i);
+            __m128 dy = _mm_load_ps(packet.dy + i);
+            __m128 fx = _mm_sub_ps(_mm_load_ps(packet.sx + i), cx);
+            __m128 fy = _mm_sub_ps(_mm_load_ps(packet.sy + i), cy);
+            __m128 t = _mm_load_ps(packet.t + i);
+
+            __m128 A = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            __m128 halfB = _mm_add_ps(_mm_mul_ps(fx, dx), _mm_mul_ps(fy, dy));
+            __m128 C = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(fx, fx), _mm_mul_ps(fy, fy)), r2);
+            __m128 D = _mm_sub_ps(_mm_mul_ps(halfB, halfB), _mm_mul_ps(A, C));
+
+            __m128 root = _mm_div_ps(_mm_sub_ps(_mm_xor_ps(halfB, signBit), _mm_sqrt_ps(D)), A);
+            __m128 hit = _mm_and_ps(_mm_cmpge_ps(root, zero), _mm_cmplt_ps(root, t));
+            _mm_store_ps(packet.t + i, _mm_or_ps(_mm_and_ps(hit, root), _mm_andnot_ps(hit, t)));
+        }
+    }
+}
+#endif
+
+#if RAY_PACKET_NEON
+static void IntersectCircleNeon(RayPacket *first, RayPacket *last, const Circle &circle)
+{
+    const float32x4_t cx = vdupq_n_f32((float)circle.x);
+    const float32x4_t cy = vdupq_n_f32((float)circle.y);
+    const float32x4_t r2 = vdupq_n_f32((float)(circle.r * circle.r));
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    for (RayPacket *it = first; it != last; it++)
+    {
+        RayPacket &packet = *it;
+        for (int i = 0; i < RayPacket::width; i += 4)
+        {
+            float32x4_t dx = vld1q_f32(packet.dx + i);
+            float32x4_t dy = vld1q_f32(packet.dy + i);
+            float32x4_t fx = vsubq_f32(vld1q_f32(packet.sx + i), cx);
+            float32x4_t fy = vsubq_f32(vld1q_f32(packet.sy + i), cy);
+            float32x4_t t = vld1q_f32(packet.t + i);
+
+            float32x4_t A = vmlaq_f32(vmulq_f32(dx, dx), dy, dy);
+            float32x4_t halfB = vmlaq_f32(vmulq_f32(fx, dx), fy, dy);
+            float32x4_t C = vsubq_f32(vmlaq_f32(vmulq_f32(fx, fx), fy, fy), r2);
+            float32x4_t D = vmlsq_f32(vmulq_f32(halfB, halfB), A, C);
+
+            float32x4_t root = vdivq_f32(vsubq_f32(vnegq_f32(halfB), vsqrtq_f32(D)), A);
+            uint32x4_t hit = vandq_u32(vcgeq_f32(root, zero), vcltq_f32(root, t));
+            vst1q_f32(packet.t + i, vbslq_f32(hit, root, t));
+        }
+    }
+}
+#endif
+
+void IntersectCircle(RayPacket *first, RayPacket *last, const Circle &circle)
+{
+#if RAY_PACKET_AVX2
+    if (CpuHasAvx2())
+    {
+        IntersectCircleAvx2(first, last, circle);
+        return;
+    }
+#endif
+#if RAY_PACKET_SSE
+    IntersectCircleSse(first, last, circle);
+#elif RAY_PACKET_NEON
+    IntersectCircleNeon(first, last, circle);
+#else
+    for (RayPacket *it = first; it != last; it++)
+        IntersectPacket(*it, circle);
+#endif
+}
+
+void IntersectCircle(RayBatch &rays, const Circle &circle)
+{
+    RayPacket *packets = rays.Packets().data();
+    IntersectCircle(packets, packets + rays.Packets().size(), circle);
+}
+
+void IntersectWall(RayPacket *first, RayPacket *last, const Line &wall)
+{
+    float qx = (float)wall.sx;
+    float qy = (float)wall.sy;
+    float wx = (float)(wall.ex - wall.sx);
+    float wy = (float)(wall.ey - wall.sy);
+
+    for (RayPacket *it = first; it != last; it++)
+    {
+        RayPacket &packet = *it;
+        for (int i = 0; i < RayPacket::width; i++)
+        {
+            // ray p + t d meets wall q + u w where both parameters are in [0, 1]
+            float px = qx - packet.sx[i];
+            float py = qy - packet.sy[i];
+            float denom = packet.dx[i] * wy - packet.dy[i] * wx;
+            float t = (px * wy - py * wx) / denom;
+            float u = (px * packet.dy[i] - py * packet.dx[i]) / denom;
+            bool hit = t >= 0.0f && t < packet.t[i] && u >= 0.0f && u <= 1.0f;
+            packet.t[i] = hit ? t : packet.t[i];
+        }
+    }
+}
+
+void IntersectWall(RayBatch &rays, const Line &wall)
+{
+    RayPacket *packets = rays.Packets().data();
+    IntersectWall(packets, packets + rays.Packets().size(), wall);
+}
+
+const char *RayPacketKernelName()
+{
+#if RAY_PACKET_AVX2
+    if (CpuHasAvx2())
+        return "avx2";
+#endif
+#if RAY_PACKET_SSE
+    return "sse2";
+#elif RAY_PACKET_NEON
+    return "neon";
+#else
+    return "generic";
+#endif
+}
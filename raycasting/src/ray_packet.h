@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "geometry.h"
+
+// lanes per packet; 4, 8 and 16 are supported. x86 runs 4-lane SSE2 blocks, or
+// 8-lane AVX2 blocks when the width allows it, and AArch64 runs 4-lane NEON blocks
+#ifndef RAY_PACKET_WIDTH
+#define RAY_PACKET_WIDTH 8
+#endif
+
+// a packet of rays in SoA layout: lane i runs from (sx, sy) to (sx + dx, sy + dy)
+// and t is the nearest hit so far as a fraction of that segment (1 = no hit)
+template <int Width>
+struct alignas(64) RayPacketT
+{
+    static_assert(Width == 4 || Width == 8 || Width == 16, "unsupported packet width");
+    static constexpr int width = Width;
+
+    float sx[Width];
+    float sy[Width];
+    float dx[Width];
+    float dy[Width];
+    float t[Width];
+};
+
+using RayPacket = RayPacketT<RAY_PACKET_WIDTH>;
+
+// portable lane loop and the reference for the vector paths; same rules as
+// CheckRayCastCollision: the nearer root must lie on the segment, so rays
+// starting inside the circle do not hit it
+template <int Width>
+void IntersectPacket(RayPacketT<Width> &packet, const Circle &circle)
+{
+    float cx = (float)circle.x;
+    float cy = (float)circle.y;
+    float r2 = (float)(circle.r * circle.r);
+
+    for (int i = 0; i < Width; i++)
+    {
+        float fx = packet.sx[i] - cx;
+        float fy = packet.sy[i] - cy;
+        float dx = packet.dx[i];
+        float dy = packet.dy[i];
+
+        float A = dx * dx + dy * dy;
+        float halfB = fx * dx + fy * dy;
+        float C = fx * fx + fy * fy - r2;
+        float D = halfB * halfB - A * C;
+
+        // a zero-length lane gives 0 / 0 here, and NaN fails every comparison
+        float t = (-halfB - std::sqrt(std::max(D, 0.0f))) / A;
+        bool hit = D >= 0.0f && t >= 0.0f && t < packet.t[i];
+        packet.t[i] = hit ? t : packet.t[i];
+    }
+}
+
+// any number of rays, stored as whole packets; unused lanes of the last packet
+// have zero length and never hit
+class RayBatch
+{
+public:
+    void Resize(size_t count);
+    size_t Count() const { return m_count; }
+
+    void Set(size_t i, const Line &line);
+    // the ray cut at its nearest hit
+    Line Get(size_t i) const;
+    // the whole ray, ignoring hits
+    Line Ray(size_t i) const;
+    bool Hit(size_t i) const;
+    void SetHit(size_t i, float t);
+    // forget all hits, keeping the rays
+    void ResetHits();
+
+    std::vector<RayPacket> &Packets() { return m_packets; }
+    const std::vector<RayPacket> &Packets() const { return m_packets; }
+
+private:
+    std::vector<RayPacket> m_packets;
+    size_t m_count = 0;
+};
+
+// shortens every ray in the batch to its nearest hit against circle
+void IntersectCircle(RayBatch &rays, const Circle &circle);
+// same for a wall segment; portable lane loop only
+void IntersectWall(RayBatch &rays, const Line &wall);
+
+// the same on packets [first, last), so a batch can be split across threads
+void IntersectCircle(RayPacket *first, RayPacket *last, const Circle &circle);
+void IntersectWall(RayPacket *first, RayPacket *last, const Line &wall);
+
+// name of the kernel IntersectCircle dispatches to on this machine
+const char *RayPacketKernelName();
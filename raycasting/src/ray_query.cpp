@@ -0,0 +1,78 @@
+#include "ray_query.h"
+#include <cmath>
+#include <limits>
+#include "scene.h"
+#include "thread_pool.h"
+
+LineEquation GetLineEquation(const Line &line)
+{
+    double a = line.sy - line.ey;
+    double b = line.ex - line.sx;
+    double c = line.sx * line.ey - line.ex * line.sy;
+    return {a, b, c};
+}
+
+bool PointOnRay(double px, double py, const Line &line)
+{
+    double dx = line.ex - line.sx;
+    double dy = line.ey - line.sy;
+
+    double lenSq = dx * dx + dy * dy;
+    double dot = (px - line.sx) * dx + (py - line.sy) * dy;
+
+    return dot >= 0 && dot <= lenSq;
+}
+
+// calculate intersections of line and circle
+int CheckRayCastCollision(Line &line, const Circle &circle)
+{
+    double dx = line.ex - line.sx;
+    double dy = line.ey - line.sy;
+
+    double fx = line.sx - circle.x;
+    double fy = line.sy - circle.y;
+
+    double A = dx * dx + dy * dy;
+    double B = 2 * (fx * dx + fy * dy);
+    double C = fx * fx + fy * fy - circle.r * circle.r;
+
+    double D = B * B - 4 * A * C;
+
+    if (D < 0 || std::isnan(D) || std::isinf(D))
+        return 0;
+
+    double sqrtD = sqrt(D);
+    double t = (-B - sqrtD) / (2 * A); // nearest intersection
+
+    if (t < 0 || t > 1)
+        return 0; // ignore if intersection is behind or beyond
+
+    line.ex = line.sx + t * dx;
+    line.ey = line.sy + t * dy;
+
+    if ((int)line.ex == (int)line.sx && (int)line.ey == (int)line.sy)
+        return 0;
+
+    return 1;
+}
+
+void CastRays(const Scene &scene, const Line *rays, size_t count, double *distances, ThreadPool *pool)
+{
+    auto cast = [&](size_t begin, size_t end)
+    {
+        RayHit hit;
+        for (size_t i = begin; i < end; i++)
+        {
+            const Line &ray = rays[i];
+            if (scene.Cast(ray, hit))
+                distances[i] = hit.t * hypot(ray.ex - ray.sx, ray.ey - ray.sy);
+            else
+                distances[i] = std::numeric_limits<double>::infinity();
+        }
+    };
+
+    if (pool)
+        pool->parallelFor(0, count, chunkSize(count, pool->threadCount(), 64), cast);
+    else
+        cast(0, count);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include "geometry.h"
+
+class Scene;
+class ThreadPool;
+
+LineEquation GetLineEquation(const Line &line);
+
+// whether the projection of (px, py) falls between the line's endpoints
+bool PointOnRay(double px, double py, const Line &line);
+
+// cuts line at its nearest intersection with circle; returns 1 for a hit that
+// moves the end off the starting pixel
+int CheckRayCastCollision(Line &line, const Circle &circle);
+
+// batch query: distances[i] is how far rays[i] travels from its start to the
+// nearest hit in the built scene, or infinity when it reaches its end unhindered.
+// runs on pool when one is given
+void CastRays(const Scene &scene, const Line *rays, size_t count, double *distances, ThreadPool *pool = nullptr);
@@ -0,0 +1,361 @@
+#include "scene.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+// below this many primitives a packet test against everything beats the grid walk
+#define SCENE_LINEAR_LIMIT 16
+// keeps a degenerate bounding box from allocating an absurd grid
+#define SCENE_MAX_CELLS_PER_AXIS 1024
+
+bool IntersectRayCircle(const Line &ray, const Circle &circle, double &t)
+{
+    double dx = ray.ex - ray.sx;
+    double dy = ray.ey - ray.sy;
+    double fx = ray.sx - circle.x;
+    double fy = ray.sy - circle.y;
+
+    double A = dx * dx + dy * dy;
+    double halfB = fx * dx + fy * dy;
+    double C = fx * fx + fy * fy - circle.r * circle.r;
+    double D = halfB * halfB - A * C;
+    if (!(D >= 0) || A == 0)
+        return false;
+
+    t = (-halfB - sqrt(D)) / A;
+    return t >= 0 && t <= 1;
+}
+
+bool IntersectRayWall(const Line &ray, const Line &wall, double &t)
+{
+    double dx = ray.ex - ray.sx;
+    double dy = ray.ey - ray.sy;
+    double wx = wall.ex - wall.sx;
+    double wy = wall.ey - wall.sy;
+
+    double denom = dx * wy - dy * wx;
+    if (denom == 0)
+        return false; // parallel
+
+    double px = wall.sx - ray.sx;
+    double py = wall.sy - ray.sy;
+    t = (px * wy - py * wx) / denom;
+    double u = (px * dy - py * dx) / denom;
+    return t >= 0 && t <= 1 && u >= 0 && u <= 1;
+}
+
+// amanatides-woo walk over the cells the segment crosses, in order; visit gets the
+// cell index and the ray t where the ray leaves that cell, and returns false to stop.
+// an empty grid has no cells to visit
+template <typename Visit>
+static void WalkGrid(double originX, double originY, double cellSize, int columns, int rows, const Line &ray, Visit visit)
+{
+    if (columns <= 0 || rows <= 0)
+        return;
+
+    double dx = ray.ex - ray.sx;
+    double dy = ray.ey - ray.sy;
+
+    // clip the segment to the grid bounds
+    double tMin = 0, tMax = 1;
+    double lo[2] = {originX, originY};
+    double hi[2] = {originX + columns * cellSize, originY + rows * cellSize};
+    double start[2] = {ray.sx, ray.sy};
+    double dir[2] = {dx, dy};
+    for (int axis = 0; axis < 2; axis++)
+    {
+        if (dir[axis] == 0)
+        {
+            if (start[axis] < lo[axis] || start[axis] > hi[axis])
+                return;
+            continue;
+        }
+        double t0 = (lo[axis] - start[axis]) / dir[axis];
+        double t1 = (hi[axis] - start[axis]) / dir[axis];
+        if (t0 > t1)
+            std::swap(t0, t1);
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+    }
+    if (tMin > tMax)
+        return;
+
+    int cx = std::clamp((int)((ray.sx + tMin * dx - originX) / cellSize), 0, columns - 1);
+    int cy = std::clamp((int)((ray.sy + tMin * dy - originY) / cellSize), 0, rows - 1);
+
+    const double inf = std::numeric_limits<double>::infinity();
+    int stepX = dx > 0 ? 1 : -1;
+    int stepY = dy > 0 ? 1 : -1;
+    double deltaX = dx != 0 ? cellSize / fabs(dx) : inf;
+    double deltaY = dy != 0 ? cellSize / fabs(dy) : inf;
+    double nextX = dx != 0 ? (originX + (cx + (dx > 0)) * cellSize - ray.sx) / dx : inf;
+    double nextY = dy != 0 ? (originY + (cy + (dy > 0)) * cellSize - ray.sy) / dy : inf;
+
+    while (true)
+    {
+        double exit = std::min({nextX, nextY, tMax});
+        if (!visit(cy * columns + cx, exit) || exit >= tMax)
+            return;
+
+        if (nextX < nextY)
+        {
+            cx += stepX;
+            nextX += deltaX;
+            if (cx < 0 || cx >= columns)
+                return;
+        }
+        else
+        {
+            cy += stepY;
+            nextY += deltaY;
+            if (cy < 0 || cy >= rows)
+                return;
+        }
+    }
+}
+
+// smallest circle around a wall, for change tracking
+static Circle WallBounds(const Line &wall)
+{
+    double dx = wall.ex - wall.sx;
+    double dy = wall.ey - wall.sy;
+    return {(wall.sx + wall.ex) / 2, (wall.sy + wall.ey) / 2, sqrt(dx * dx + dy * dy) / 2};
+}
+
+void Scene::RecordChange(const Circle &area)
+{
+    // once everything counts as changed single areas add nothing
+    if (!m_changedEverywhere)
+        m_changes.push_back(area);
+}
+
+size_t Scene::AddCircle(const Circle &circle)
+{
+    m_circles.push_back(circle);
+    RecordChange(circle);
+    m_dirty = true;
+    return m_circles.size() - 1;
+}
+
+size_t Scene::AddWall(const Line &wall)
+{
+    m_walls.push_back(wall);
+    RecordChange(WallBounds(wall));
+    m_dirty = true;
+    return m_walls.size() - 1;
+}
+
+void Scene::MoveCircle(size_t i, double x, double y)
+{
+    if (m_circles[i].x == x && m_circles[i].y == y)
+        return;
+    RecordChange(m_circles[i]);
+    m_circles[i].x = x;
+    m_circles[i].y = y;
+    RecordChange(m_circles[i]);
+    m_dirty = true;
+}
+
+void Scene::Clear()
+{
+    m_circles.clear();
+    m_walls.clear();
+    m_changes.clear();
+    m_changedEverywhere = true;
+    m_dirty = true;
+}
+
+void Scene::MarkChangedEverywhere()
+{
+    m_changes.clear();
+    m_changedEverywhere = true;
+}
+
+void Scene::ClearChanges()
+{
+    m_changes.clear();
+    m_changedEverywhere = false;
+}
+
+void Scene::Build()
+{
+    if (!m_dirty)
+        return;
+    m_dirty = false;
+
+    size_t count = m_circles.size() + m_walls.size();
+    if (count == 0)
+    {
+        m_columns = m_rows = 0;
+        m_cellStart.assign(1, 0);
+        m_items.clear();
+        return;
+    }
+
+    double minX = std::numeric_limits<double>::max(), minY = minX;
+    double maxX = std::numeric_limits<double>::lowest(), maxY = maxX;
+    for (const Circle &c : m_circles)
+    {
+        minX = std::min(minX, c.x - c.r);
+        minY = std::min(minY, c.y - c.r);
+        maxX = std::max(maxX, c.x + c.r);
+        maxY = std::max(maxY, c.y + c.r);
+    }
+    for (const Line &w : m_walls)
+    {
+        minX = std::min({minX, w.sx, w.ex});
+        minY = std::min({minY, w.sy, w.ey});
+        maxX = std::max({maxX, w.sx, w.ex});
+        maxY = std::max({maxY, w.sy, w.ey});
+    }
+
+    double width = std::max(maxX - minX, 1.0);
+    double height = std::max(maxY - minY, 1.0);
+    m_cellSize = std::sqrt(width * height / count);
+    m_cellSize = std::max({m_cellSize, width / SCENE_MAX_CELLS_PER_AXIS, height / SCENE_MAX_CELLS_PER_AXIS});
+    m_originX = minX;
+    m_originY = minY;
+    m_columns = std::max(1, (int)std::ceil(width / m_cellSize));
+    m_rows = std::max(1, (int)std::ceil(height / m_cellSize));
+
+    // two passes over the same binning: count per cell, then fill
+    std::vector<std::uint32_t> fill;
+    auto bin = [&](bool counting)
+    {
+        auto add = [&](int cell, std::uint32_t id)
+        {
+            if (counting)
+                m_cellStart[cell + 1]++;
+            else
+                m_items[fill[cell]++] = id;
+        };
+        for (size_t i = 0; i < m_circles.size(); i++)
+        {
+            const Circle &c = m_circles[i];
+            int x0 = std::clamp((int)((c.x - c.r - m_originX) / m_cellSize), 0, m_columns - 1);
+            int x1 = std::clamp((int)((c.x + c.r - m_originX) / m_cellSize), 0, m_columns - 1);
+            int y0 = std::clamp((int)((c.y - c.r - m_originY) / m_cellSize), 0, m_rows - 1);
+            int y1 = std::clamp((int)((c.y + c.r - m_originY) / m_cellSize), 0, m_rows - 1);
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++)
+                    add(y * m_columns + x, (std::uint32_t)i);
+        }
+        for (size_t i = 0; i < m_walls.size(); i++)
+        {
+            std::uint32_t id = (std::uint32_t)(m_circles.size() + i);
+            WalkGrid(m_originX, m_originY, m_cellSize, m_columns, m_rows, m_walls[i], [&](int cell, double)
+            {
+                add(cell, id);
+                return true;
+            });
+        }
+    };
+
+    size_t cells = (size_t)m_columns * m_rows;
+    m_cellStart.assign(cells + 1, 0);
+    bin(true);
+    for (size_t c = 0; c < cells; c++)
+        m_cellStart[c + 1] += m_cellStart[c];
+    m_items.resize(m_cellStart[cells]);
+    fill.assign(m_cellStart.begin(), m_cellStart.end() - 1);
+    bin(false);
+}
+
+void Scene::Nearby(double x, double y, double reach, std::vector<std::uint32_t> &ids) const
+{
+    assert(!m_dirty && "Scene::Build() after edits");
+    ids.clear();
+    if (m_columns == 0)
+        return;
+    double x0 = (x - reach - m_originX) / m_cellSize, x1 = (x + reach - m_originX) / m_cellSize;
+    double y0 = (y - reach - m_originY) / m_cellSize, y1 = (y + reach - m_originY) / m_cellSize;
+    if (x1 < 0 || y1 < 0 || x0 >= m_columns || y0 >= m_rows)
+        return;
+    int cx0 = std::max(0, (int)x0), cx1 = std::min(m_columns - 1, (int)x1);
+    int cy0 = std::max(0, (int)y0), cy1 = std::min(m_rows - 1, (int)y1);
+    for (int cy = cy0; cy <= cy1; cy++)
+    {
+        const std::uint32_t *begin = m_items.data() + m_cellStart[cy * m_columns + cx0];
+        const std::uint32_t *end = m_items.data() + m_cellStart[cy * m_columns + cx1 + 1];
+        ids.insert(ids.end(), begin, end);
+    }
+    // primitives spanning several cells were collected once per cell
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+void Scene::TestPrimitive(std::uint32_t id, const Line &ray, RayHit &hit) const
+{
+    double t;
+    if (id < m_circles.size())
+    {
+        if (IntersectRayCircle(ray, m_circles[id], t) && t < hit.t)
+            hit = {t, false, id};
+    }
+    else
+    {
+        size_t wall = id - m_circles.size();
+        if (IntersectRayWall(ray, m_walls[wall], t) && t < hit.t)
+            hit = {t, true, wall};
+    }
+}
+
+bool Scene::CastGrid(const Line &ray, RayHit &hit) const
+{
+    hit.t = std::numeric_limits<double>::infinity();
+    if (m_columns == 0)
+        return false;
+    WalkGrid(m_originX, m_originY, m_cellSize, m_columns, m_rows, ray, [&](int cell, double exit)
+    {
+        // primitives spanning several cells are simply tested again
+        for (std::uint32_t i = m_cellStart[cell]; i < m_cellStart[cell + 1]; i++)
+            TestPrimitive(m_items[i], ray, hit);
+        // anything hit before this cell's exit cannot be beaten further along
+        return hit.t > exit;
+    });
+    return hit.t <= 1;
+}
+
+bool Scene::Cast(const Line &ray, RayHit &hit) const
+{
+    assert(!m_dirty && "Scene::Build() after edits");
+    return CastGrid(ray, hit);
+}
+
+bool Scene::CastLinear(const Line &ray, RayHit &hit) const
+{
+    hit.t = std::numeric_limits<double>::infinity();
+    size_t count = m_circles.size() + m_walls.size();
+    for (size_t i = 0; i < count; i++)
+        TestPrimitive((std::uint32_t)i, ray, hit);
+    return hit.t <= 1;
+}
+
+void Scene::Cast(RayBatch &rays) const
+{
+    Cast(rays, 0, rays.Packets().size());
+}
+
+void Scene::Cast(RayBatch &rays, size_t firstPacket, size_t lastPacket) const
+{
+    if (m_circles.size() + m_walls.size() <= SCENE_LINEAR_LIMIT)
+    {
+        RayPacket *first = rays.Packets().data() + firstPacket;
+        RayPacket *last = rays.Packets().data() + lastPacket;
+        for (const Circle &circle : m_circles)
+            IntersectCircle(first, last, circle);
+        for (const Line &wall : m_walls)
+            IntersectWall(first, last, wall);
+        return;
+    }
+
+    assert(!m_dirty && "Scene::Build() after edits");
+    RayHit hit;
+    size_t end = std::min(rays.Count(), lastPacket * RayPacket::width);
+    for (size_t i = firstPacket * RayPacket::width; i < end; i++)
+    {
+        if (CastGrid(rays.Ray(i), hit))
+            rays.SetHit(i, (float)std::min(hit.t, 1.0));
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "geometry.h"
+#include "ray_packet.h"
+
+// nearest hit of one ray: t is the fraction of the ray, index the circle or wall
+struct RayHit
+{
+    double t;
+    bool wall;
+    size_t index;
+};
+
+// circles and wall segments with a uniform grid for nearest-hit queries; edits
+// only mark the grid stale, call Build() before querying again
+class Scene
+{
+public:
+    size_t AddCircle(const Circle &circle);
+    size_t AddWall(const Line &wall);
+    void MoveCircle(size_t i, double x, double y);
+    void Clear();
+
+    const std::vector<Circle> &Circles() const { return m_circles; }
+    const std::vector<Line> &Walls() const { return m_walls; }
+
+    // areas edited since ClearChanges(), as bounding circles of what was there
+    // before and after; Clear() instead sets ChangedEverywhere()
+    const std::vector<Circle> &Changes() const { return m_changes; }
+    bool ChangedEverywhere() const { return m_changedEverywhere; }
+    bool Changed() const { return m_changedEverywhere || !m_changes.empty(); }
+    void ClearChanges();
+    // drops the areas for ChangedEverywhere(), for consumers that fell behind
+    void MarkChangedEverywhere();
+
+    // roughly one primitive per cell; does nothing when nothing changed
+    void Build();
+
+    // nearest hit along the ray, walking only the grid cells it crosses
+    bool Cast(const Line &ray, RayHit &hit) const;
+    // same answer by testing every primitive; the reference for Cast
+    bool CastLinear(const Line &ray, RayHit &hit) const;
+
+    // every primitive in the grid cells within reach of (x, y), in increasing
+    // order and numbered as circles first, then Circles().size() + wall index.
+    // a superset of what lies within reach
+    void Nearby(double x, double y, double reach, std::vector<std::uint32_t> &ids) const;
+
+    // shortens every ray of the batch to its nearest hit; small scenes are
+    // intersected packet-wise against every primitive instead of through the grid
+    void Cast(RayBatch &rays) const;
+    // only packets [firstPacket, lastPacket) of the batch; safe to call
+    // concurrently on disjoint ranges
+    void Cast(RayBatch &rays, size_t firstPacket, size_t lastPacket) const;
+
+private:
+    bool CastGrid(const Line &ray, RayHit &hit) const;
+    void RecordChange(const Circle &area);
+    void TestPrimitive(std::uint32_t id, const Line &ray, RayHit &hit) const;
+
+    std::vector<Circle> m_circles;
+    std::vector<Line> m_walls;
+    bool m_dirty = true;
+    std::vector<Circle> m_changes;
+    bool m_changedEverywhere = true;
+
+    // grid in CSR form: cell c holds m_items[m_cellStart[c] .. m_cellStart[c + 1]),
+    // walls are stored as m_circles.size() + wall index
+    double m_originX = 0, m_originY = 0;
+    double m_cellSize = 1;
+    int m_columns = 0, m_rows = 0;
+    std::vector<std::uint32_t> m_cellStart;
+    std::vector<std::uint32_t> m_items;
+};
+
+// t of the nearest point on the segment ray where it meets the circle, the same
+// rule as CheckRayCastCollision; false when there is none
+bool IntersectRayCircle(const Line &ray, const Circle &circle, double &t);
+// t along ray where it crosses the wall segment
+bool IntersectRayWall(const Line &ray, const Line &wall, double &t);
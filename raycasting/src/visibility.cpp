@@ -0,0 +1,141 @@
+#include "visibility.h"
+#include <algorithm>
+#include <cmath>
+#include "scene.h"
+
+// offset either side of an endpoint or tangent, so the rays pass just by the
+// corner and see both what it hides and what is behind it
+#define VISIBILITY_EPSILON 1e-5
+
+void VisibilityPolygon::AddEvent(double angle)
+{
+    m_angles.push_back(angle - VISIBILITY_EPSILON);
+    m_angles.push_back(angle);
+    m_angles.push_back(angle + VISIBILITY_EPSILON);
+}
+
+void VisibilityPolygon::AddPoint(double x, double y, double px, double py, double reach)
+{
+    double dx = px - x;
+    double dy = py - y;
+    // slack for crossings computed on the reach circle itself
+    if (dx * dx + dy * dy <= reach * reach * (1 + 1e-9))
+        AddEvent(atan2(dy, dx));
+}
+
+// both points where the wall meets the circle outline, not just the nearest
+void VisibilityPolygon::AddCrossings(double x, double y, double reach, const Line &wall, const Circle &circle)
+{
+    double dx = wall.ex - wall.sx;
+    double dy = wall.ey - wall.sy;
+    double fx = wall.sx - circle.x;
+    double fy = wall.sy - circle.y;
+
+    double A = dx * dx + dy * dy;
+    double halfB = fx * dx + fy * dy;
+    double C = fx * fx + fy * fy - circle.r * circle.r;
+    double D = halfB * halfB - A * C;
+    if (!(D >= 0) || A == 0)
+        return;
+
+    double root = sqrt(D);
+    for (double t : {(-halfB - root) / A, (-halfB + root) / A})
+    {
+        if (t >= 0 && t <= 1)
+            AddPoint(x, y, wall.sx + t * dx, wall.sy + t * dy, reach);
+    }
+}
+
+// both points where two circle outlines meet
+void VisibilityPolygon::AddCrossings(double x, double y, double reach, const Circle &a, const Circle &b)
+{
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double d2 = dx * dx + dy * dy;
+    double d = sqrt(d2);
+    if (d == 0 || d > a.r + b.r || d < fabs(a.r - b.r))
+        return;
+
+    // distance from a's centre to the chord through both points, and its half length
+    double along = (d2 + a.r * a.r - b.r * b.r) / (2 * d);
+    double half = sqrt(std::max(0.0, a.r * a.r - along * along));
+    double mx = a.x + along * dx / d;
+    double my = a.y + along * dy / d;
+    AddPoint(x, y, mx - half * dy / d, my + half * dx / d, reach);
+    AddPoint(x, y, mx + half * dy / d, my - half * dx / d, reach);
+}
+
+void VisibilityPolygon::Compute(const Scene &scene, double x, double y, double reach)
+{
+    m_angles.clear();
+    m_corners.clear();
+
+    // the reach circle bounds the polygon where nothing is hit
+    int reachSamples = std::max(8, (int)ceil(2 * M_PI / arcStep));
+    for (int i = 0; i < reachSamples; i++)
+        m_angles.push_back(i * 2 * M_PI / reachSamples);
+
+    // only primitives in grid cells within reach can produce events
+    scene.Nearby(x, y, reach, m_nearby);
+    size_t circleCount = scene.Circles().size();
+    size_t firstWall = std::lower_bound(m_nearby.begin(), m_nearby.end(), (std::uint32_t)circleCount) - m_nearby.begin();
+    const Circle bounds = {x, y, reach};
+    for (size_t i = firstWall; i < m_nearby.size(); i++)
+    {
+        const Line &wall = scene.Walls()[m_nearby[i] - circleCount];
+        AddPoint(x, y, wall.sx, wall.sy, reach);
+        AddPoint(x, y, wall.ex, wall.ey, reach);
+
+        // where walls cross each other, a circle or the reach circle, the nearest
+        // hit switches primitive away from any endpoint
+        for (size_t j = i + 1; j < m_nearby.size(); j++)
+        {
+            const Line &other = scene.Walls()[m_nearby[j] - circleCount];
+            double t;
+            if (IntersectRayWall(wall, other, t))
+                AddPoint(x, y, wall.sx + t * (wall.ex - wall.sx), wall.sy + t * (wall.ey - wall.sy), reach);
+        }
+        for (size_t j = 0; j < firstWall; j++)
+            AddCrossings(x, y, reach, wall, scene.Circles()[m_nearby[j]]);
+        AddCrossings(x, y, reach, wall, bounds);
+    }
+
+    for (size_t i = 0; i < firstWall; i++)
+    {
+        const Circle &circle = scene.Circles()[m_nearby[i]];
+        // overlapping circles, and circles cut by the reach circle, switch there too
+        for (size_t j = i + 1; j < firstWall; j++)
+            AddCrossings(x, y, reach, circle, scene.Circles()[m_nearby[j]]);
+        AddCrossings(x, y, reach, circle, bounds);
+
+        double dx = circle.x - x;
+        double dy = circle.y - y;
+        double distance = sqrt(dx * dx + dy * dy);
+        // circles out of reach, or around the emitter, give no edges
+        if (distance - circle.r > reach || distance <= circle.r)
+            continue;
+
+        double center = atan2(dy, dx);
+        double halfWidth = asin(circle.r / distance);
+        AddEvent(center - halfWidth);
+        AddEvent(center + halfWidth);
+
+        // the facing arc between the tangents
+        int samples = (int)(2 * halfWidth / arcStep);
+        for (int k = 1; k <= samples; k++)
+            m_angles.push_back(center - halfWidth + 2 * halfWidth * k / (samples + 1));
+    }
+
+    // angle order around the emitter; atan2 gives (-pi, pi], the reach samples [0, 2pi)
+    for (double &angle : m_angles)
+        angle = remainder(angle, 2 * M_PI);
+    std::sort(m_angles.begin(), m_angles.end());
+
+    RayHit hit;
+    for (double angle : m_angles)
+    {
+        Line ray = {x, y, x + reach * cos(angle), y + reach * sin(angle)};
+        double t = scene.Cast(ray, hit) ? hit.t : 1.0;
+        m_corners.push_back({x + t * (ray.ex - x), y + t * (ray.ey - y)});
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "geometry.h"
+
+class Scene;
+
+// visibility polygon of an emitter: rays are cast only at event angles, i.e.
+// just before, at and after every wall endpoint, circle tangent and crossing of
+// two primitives (or of one with the reach circle), plus samples along the
+// circle arcs facing the emitter and along the reach circle, which a polygon
+// can only approximate. the corners come out in angle order
+// around the emitter, so the polygon is star-shaped about it
+class VisibilityPolygon
+{
+public:
+    // angular spacing of the arc samples, in radians
+    double arcStep = 2 * 3.14159265358979323846 / 180;
+
+    // scene must be built; only geometry that can be within reach produces events
+    void Compute(const Scene &scene, double x, double y, double reach);
+
+    const std::vector<Point> &Corners() const { return m_corners; }
+
+private:
+    void AddEvent(double angle);
+    // an event at the point when it is within reach
+    void AddPoint(double x, double y, double px, double py, double reach);
+    void AddCrossings(double x, double y, double reach, const Line &wall, const Circle &circle);
+    void AddCrossings(double x, double y, double reach, const Circle &a, const Circle &b);
+
+    std::vector<std::uint32_t> m_nearby;
+    std::vector<double> m_angles;
+    std::vector<Point> m_corners;
+};